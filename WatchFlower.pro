@@ -43,6 +43,19 @@ exists(assets/demo/demo_bdd.db) {
 SOURCES  += src/main.cpp \
             src/SettingsManager.cpp \
             src/DatabaseManager.cpp \
+            src/DatabaseWriter.cpp \
+            src/DatabaseBenchmark.cpp \
+            src/DatabaseQueries.cpp \
+            src/DatabaseMaintenance.cpp \
+            src/DatabasePartitions.cpp \
+            src/DatabaseJournal.cpp \
+            src/DatabaseReadPool.cpp \
+            src/DatabaseBackendSql.cpp \
+            src/DatabaseBackendMemory.cpp \
+            src/DatabaseBackup.cpp \
+            src/DatabaseExport.cpp \
+            src/DatabaseImport.cpp \
+            src/DatabaseSeries.cpp \
             src/SystrayManager.cpp \
             src/NotificationManager.cpp \
             src/DeviceManager.cpp \
@@ -72,11 +85,26 @@ SOURCES  += src/main.cpp \
 
 HEADERS  += src/SettingsManager.h \
             src/DatabaseManager.h \
+            src/DatabaseWriter.h \
+            src/DatabaseBenchmark.h \
+            src/DatabaseQueries.h \
+            src/DatabaseMaintenance.h \
+            src/DatabasePartitions.h \
+            src/DatabaseJournal.h \
+            src/DatabaseReadPool.h \
+            src/DatabaseBackend.h \
+            src/DatabaseBackendSql.h \
+            src/DatabaseBackendMemory.h \
+            src/DatabaseBackup.h \
+            src/DatabaseExport.h \
+            src/DatabaseImport.h \
+            src/DatabaseSeries.h \
             src/SystrayManager.h \
             src/NotificationManager.h \
             src/DeviceManager.h \
             src/device.h \
             src/device_utils.h \
+            src/device_reading.h \
             src/device_filter.h \
             src/device_sensor.h \
             src/devices/device_flowercare.h \
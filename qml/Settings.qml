@@ -1338,7 +1338,7 @@ Item {
                     anchors.left: parent.left
                     anchors.right: parent.right
 
-                    text: qsTr("Export up to 90 days of data into a CSV file.")
+                    text: qsTr("Export all of your data into a CSV file.")
                     textFormat: Text.PlainText
                     wrapMode: Text.WordWrap
                     color: Theme.colorSubText
@@ -1371,7 +1371,32 @@ Item {
 
                 visible: deviceManager.hasDevices
 
+                property bool exportShare: false
+
+                Connections {
+                    target: deviceManager
+                    onExportFinished: {
+                        if (element_export.exportShare) {
+                            element_export.exportShare = false
+                            if (status) utilsShare.sendFile(path, "Send file", "text/csv", 0)
+                            return
+                        }
+
+                        if (status) {
+                            exportButton.text = qsTr("Exported")
+                            exportButton.primaryColor = Theme.colorPrimary
+                            exportButton.fullColor = true
+                            if (isDesktop) openFolderButton.visible = true
+                        } else {
+                            exportButton.text = qsTr("Export file")
+                            exportButton.primaryColor = Theme.colorWarning
+                            exportButton.fullColor = false
+                        }
+                    }
+                }
+
                 ButtonWireframe {
+                    id: exportButton
                     height: 36
                     anchors.verticalCenter: parent.verticalCenter
 
@@ -1382,13 +1407,17 @@ Item {
 
                     text: qsTr("Export file")
                     onClicked: {
+                        if (deviceManager.exporting) {
+                            deviceManager.exportDataCancel()
+                            return
+                        }
+
                         utilsApp.checkMobileStoragePermissions()
 
                         if (deviceManager.exportDataSave()) {
-                            text = qsTr("Exported")
+                            text = qsTr("Exporting...") + " (" + qsTr("cancel") + ")"
                             primaryColor = Theme.colorPrimary
-                            fullColor = true
-                            if (isDesktop) openFolderButton.visible = true
+                            fullColor = false
                         } else {
                             text = qsTr("Export file")
                             primaryColor = Theme.colorWarning
@@ -1424,8 +1453,8 @@ Item {
 
                     text: qsTr("Open with")
                     onClicked: {
-                        var file = deviceManager.exportDataOpen()
-                        utilsShare.sendFile(file, "Send file", "text/csv", 0)
+                        // Shared once written, see onExportFinished
+                        if (deviceManager.exportDataOpen() !== "") element_export.exportShare = true
                     }
                 }
             }
@@ -0,0 +1,100 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+
+#ifndef DATABASE_BACKEND_H
+#define DATABASE_BACKEND_H
+/* ************************************************************************** */
+
+#include "device_reading.h"
+
+#include <QString>
+#include <QList>
+#include <QVariantMap>
+
+/* ************************************************************************** */
+
+struct DataPoint
+{
+    qint64 ts = 0;              //!< UTC epoch (seconds)
+    float value = 0.f;
+};
+
+struct DataAggregate
+{
+    qint64 ts = 0;              //!< Start of the hour (UTC epoch) or of the (local) day
+    float min = 0.f;
+    float max = 0.f;
+    double sum = 0.0;
+    int count = 0;
+
+    float avg() const { return count ? static_cast<float>(sum / count) : 0.f; }
+};
+
+/*!
+ * \brief The DatabaseBackend class
+ *
+ * What the application needs from a storage engine: reading ingest, range and
+ * aggregate queries, and the devices metadata. Metrics are DeviceUtils::DeviceSensors
+ * bits, tables are DeviceReading::ReadingTable.
+ *
+ * Implementations must be thread safe, queries can come from worker threads.
+ */
+class DatabaseBackend
+{
+public:
+    enum BackendType {
+        BACKEND_SQLITE      = 0,
+        BACKEND_MYSQL       = 1,
+        BACKEND_MEMORY      = 2,
+    };
+
+    enum Resolution {
+        RESOLUTION_HOUR     = 0,
+        RESOLUTION_DAY      = 1,    //!< Local days
+    };
+
+    virtual ~DatabaseBackend() = default;
+
+    virtual int type() const = 0;
+
+    //! Readings may be written asynchronously
+    virtual bool write(const QList <DeviceReading> &readings) = 0;
+
+    //! Raw values in [tsFrom, tsTo[, oldest first
+    virtual QList <DataPoint> range(const QString &deviceAddr, int table, quint32 metric,
+                                    qint64 tsFrom, qint64 tsTo) = 0;
+
+    //! Hourly or daily min/max/sum/count in [tsFrom, tsTo[, oldest first
+    virtual QList <DataAggregate> aggregate(const QString &deviceAddr, int table, quint32 metric,
+                                            qint64 tsFrom, qint64 tsTo, int resolution) = 0;
+
+    //! Device metadata, keys are the 'devices' table columns
+    virtual QVariantMap getDevice(const QString &deviceAddr) = 0;
+    virtual bool setDevice(const QString &deviceAddr, const QVariantMap &values) = 0;
+    //! The device is being removed, drop what's kept about it
+    virtual void removeDevice(const QString &deviceAddr) = 0;
+    //! Delete every reading of the device (raw, rollups and latest values), but not the device
+    virtual bool clearData(const QString &deviceAddr) = 0;
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_BACKEND_H
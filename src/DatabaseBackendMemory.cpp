@@ -0,0 +1,196 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseBackendMemory.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QDateTime>
+
+#include <algorithm>
+
+/* ************************************************************************** */
+
+void DatabaseBackendMemory::insert(Series &s, qint64 ts, float value)
+{
+    // Readings mostly arrive in order, history sync being the exception
+    if (s.ts.isEmpty() || ts > s.ts.last())
+    {
+        s.ts.append(ts);
+        s.values.append(value);
+        return;
+    }
+
+    auto it = std::lower_bound(s.ts.begin(), s.ts.end(), ts);
+    int i = static_cast<int>(it - s.ts.begin());
+
+    if (*it == ts)
+    {
+        s.values[i] = value; // same primary key, replace
+    }
+    else
+    {
+        s.ts.insert(i, ts);
+        s.values.insert(i, value);
+    }
+}
+
+bool DatabaseBackendMemory::write(const QList <DeviceReading> &readings)
+{
+    QWriteLocker lock(&m_lock);
+
+    for (const auto &r: readings)
+    {
+        qint64 ts = r.roundedTimestamp().toSecsSinceEpoch();
+        QHash <quint64, Series> &device = m_series[r.deviceAddr];
+
+        for (quint32 m = r.metrics; m; m &= (m - 1))
+        {
+            quint32 metric = m & (~m + 1); // lowest bit
+            insert(device[seriesKey(r.table, metric)], ts, r.value(metric));
+        }
+    }
+
+    return true;
+}
+
+QList <DataPoint> DatabaseBackendMemory::range(const QString &deviceAddr, int table, quint32 metric,
+                                               qint64 tsFrom, qint64 tsTo)
+{
+    QList <DataPoint> points;
+
+    QReadLocker lock(&m_lock);
+
+    auto d = m_series.constFind(deviceAddr);
+    if (d == m_series.constEnd()) return points;
+    auto s = d->constFind(seriesKey(table, metric));
+    if (s == d->constEnd()) return points;
+
+    auto first = std::lower_bound(s->ts.constBegin(), s->ts.constEnd(), tsFrom);
+    auto last = std::lower_bound(first, s->ts.constEnd(), tsTo);
+    points.reserve(static_cast<int>(last - first));
+
+    for (auto it = first; it != last; ++it)
+    {
+        DataPoint p;
+        p.ts = *it;
+        p.value = s->values.at(static_cast<int>(it - s->ts.constBegin()));
+        points += p;
+    }
+
+    return points;
+}
+
+QList <DataAggregate> DatabaseBackendMemory::aggregate(const QString &deviceAddr, int table, quint32 metric,
+                                                       qint64 tsFrom, qint64 tsTo, int resolution)
+{
+    QList <DataAggregate> aggregates;
+
+    // Same buckets as the SQL rollups: UTC hours, local days
+    if (resolution == RESOLUTION_DAY)
+    {
+        tsFrom = QDateTime(QDateTime::fromSecsSinceEpoch(tsFrom).date(), QTime(0, 0)).toSecsSinceEpoch();
+    }
+    else
+    {
+        tsFrom -= tsFrom % 3600;
+    }
+
+    const QList <DataPoint> points = range(deviceAddr, table, metric, tsFrom, tsTo);
+
+    qint64 bucketEnd = 0;
+    for (const auto &p: points)
+    {
+        if (p.ts >= bucketEnd)
+        {
+            DataAggregate a;
+            if (resolution == RESOLUTION_DAY)
+            {
+                QDate day = QDateTime::fromSecsSinceEpoch(p.ts).date();
+                a.ts = QDateTime(day, QTime(0, 0)).toSecsSinceEpoch();
+                bucketEnd = QDateTime(day.addDays(1), QTime(0, 0)).toSecsSinceEpoch();
+            }
+            else
+            {
+                a.ts = p.ts - p.ts % 3600;
+                bucketEnd = a.ts + 3600;
+            }
+            a.min = a.max = p.value;
+            aggregates += a;
+        }
+
+        DataAggregate &a = aggregates.last();
+        a.min = std::min(a.min, p.value);
+        a.max = std::max(a.max, p.value);
+        a.sum += p.value;
+        a.count++;
+    }
+
+    return aggregates;
+}
+
+/* ************************************************************************** */
+
+QVariantMap DatabaseBackendMemory::getDevice(const QString &deviceAddr)
+{
+    QReadLocker lock(&m_lock);
+
+    return m_devices.value(deviceAddr);
+}
+
+bool DatabaseBackendMemory::setDevice(const QString &deviceAddr, const QVariantMap &values)
+{
+    QWriteLocker lock(&m_lock);
+
+    QVariantMap &device = m_devices[deviceAddr];
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+    {
+        device.insert(it.key(), it.value());
+    }
+
+    return true;
+}
+
+void DatabaseBackendMemory::removeDevice(const QString &deviceAddr)
+{
+    QWriteLocker lock(&m_lock);
+
+    m_series.remove(deviceAddr);
+    m_devices.remove(deviceAddr);
+}
+
+bool DatabaseBackendMemory::clearData(const QString &deviceAddr)
+{
+    QWriteLocker lock(&m_lock);
+
+    m_series.remove(deviceAddr);
+    return true;
+}
+
+void DatabaseBackendMemory::clear()
+{
+    QWriteLocker lock(&m_lock);
+
+    m_series.clear();
+    m_devices.clear();
+}
+
+/* ************************************************************************** */
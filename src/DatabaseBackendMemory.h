@@ -0,0 +1,82 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+
+#ifndef DATABASE_BACKEND_MEMORY_H
+#define DATABASE_BACKEND_MEMORY_H
+/* ************************************************************************** */
+
+#include "DatabaseBackend.h"
+
+#include <QHash>
+#include <QVector>
+#include <QReadWriteLock>
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseBackendMemory class
+ *
+ * Columnar in-memory storage: one (timestamps, values) pair of sorted arrays per
+ * device and metric. Nothing touches the disk and nothing survives a restart.
+ *
+ * Useful to run the application or the benchmarks without any I/O, and as a
+ * baseline to measure what the SQL layer costs.
+ */
+class DatabaseBackendMemory: public DatabaseBackend
+{
+    struct Series
+    {
+        QVector <qint64> ts;        //!< UTC epoch (seconds), sorted
+        QVector <float> values;
+    };
+
+    mutable QReadWriteLock m_lock;
+    QHash <QString, QHash <quint64, Series>> m_series;  //!< device > (table, metric) > series
+    QHash <QString, QVariantMap> m_devices;
+
+    //! Plant and sensor tables can have the same metric
+    static quint64 seriesKey(int table, quint32 metric) { return (quint64(table) << 32) | metric; }
+    static void insert(Series &s, qint64 ts, float value);
+
+public:
+    DatabaseBackendMemory() = default;
+
+    int type() const override { return BACKEND_MEMORY; }
+
+    bool write(const QList <DeviceReading> &readings) override;
+
+    QList <DataPoint> range(const QString &deviceAddr, int table, quint32 metric,
+                            qint64 tsFrom, qint64 tsTo) override;
+
+    QList <DataAggregate> aggregate(const QString &deviceAddr, int table, quint32 metric,
+                                    qint64 tsFrom, qint64 tsTo, int resolution) override;
+
+    QVariantMap getDevice(const QString &deviceAddr) override;
+    bool setDevice(const QString &deviceAddr, const QVariantMap &values) override;
+    void removeDevice(const QString &deviceAddr) override;
+    bool clearData(const QString &deviceAddr) override;
+
+    void clear();
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_BACKEND_MEMORY_H
@@ -0,0 +1,308 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseBackendSql.h"
+#include "DatabaseManager.h"
+#include "DatabaseWriter.h"
+#include "DatabaseQueries.h"
+#include "DatabasePartitions.h"
+
+#include <QMutexLocker>
+#include <QThread>
+#include <QDateTime>
+#include <QDebug>
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QSqlRecord>
+
+/* ************************************************************************** */
+
+DatabaseBackendSql::DatabaseBackendSql(DatabaseWriter *writer, bool mysql)
+{
+    m_writer = writer;
+    m_mysql = mysql;
+}
+
+QString DatabaseBackendSql::column(int table, quint32 metric)
+{
+    const auto cols = DatabaseWriter::columns(static_cast<DeviceReading::ReadingTable>(table));
+    for (const auto &c: cols)
+    {
+        if (c.first == metric) return c.second;
+    }
+
+    return QString();
+}
+
+int DatabaseBackendSql::getDeviceId(const QString &deviceAddr)
+{
+    QMutexLocker lock(&m_deviceIdsMutex);
+
+    auto it = m_deviceIds.constFind(deviceAddr);
+    if (it != m_deviceIds.constEnd()) return it.value();
+
+    // The id is only created by the DatabaseWriter, with the first reading it saves
+    QSqlQuery getId(DatabaseManager::getInstance()->getReadDatabase());
+    getId.prepare(DatabaseQueries::get(DatabaseQueries::DEVICEID_SELECT, m_mysql));
+    getId.bindValue(":deviceAddr", deviceAddr);
+    if (getId.exec() == false)
+        qWarning() << "> getId.exec() ERROR" << getId.lastError().type() << ":" << getId.lastError().text();
+
+    if (getId.next())
+    {
+        int deviceId = getId.value(0).toInt();
+        m_deviceIds.insert(deviceAddr, deviceId);
+        return deviceId;
+    }
+
+    return -1;
+}
+
+/* ************************************************************************** */
+
+bool DatabaseBackendSql::write(const QList <DeviceReading> &readings)
+{
+    if (!m_writer) return false;
+
+    for (const auto &r: readings)
+    {
+        m_writer->enqueue(r);
+    }
+
+    return true;
+}
+
+QList <DataPoint> DatabaseBackendSql::range(const QString &deviceAddr, int table, quint32 metric,
+                                            qint64 tsFrom, qint64 tsTo)
+{
+    QList <DataPoint> points;
+
+    int deviceId = getDeviceId(deviceAddr);
+    QString col = column(table, metric);
+    if (deviceId < 0 || col.isEmpty()) return points;
+
+    QSqlDatabase db = DatabaseManager::getInstance()->getReadDatabase();
+    DatabasePartitions *partitions = DatabasePartitions::getInstance();
+
+    const QStringList tables = partitions->tables(partitions->baseTable(table), tsFrom, tsTo);
+    for (const auto &t: tables)
+    {
+        QSqlQuery rangeData(db);
+        if (DatabasePartitions::isNarrow(t))
+        {
+            rangeData.prepare(DatabaseQueries::get(DatabaseQueries::VALUES_RANGE, m_mysql).arg(t));
+            rangeData.bindValue(":metric", metric);
+        }
+        else
+        {
+            rangeData.prepare(DatabaseQueries::get(DatabaseQueries::DATA_RANGE, m_mysql).arg(t, col));
+        }
+        rangeData.bindValue(":deviceId", deviceId);
+        rangeData.bindValue(":tsFrom", tsFrom);
+        rangeData.bindValue(":tsTo", tsTo);
+
+        if (rangeData.exec() == false)
+        {
+            qWarning() << "> rangeData.exec() ERROR" << rangeData.lastError().type() << ":" << rangeData.lastError().text();
+            continue;
+        }
+
+        while (rangeData.next())
+        {
+            DataPoint p;
+            p.ts = rangeData.value(0).toLongLong();
+            p.value = rangeData.value(1).toFloat();
+            points += p;
+        }
+    }
+
+    return points;
+}
+
+QList <DataAggregate> DatabaseBackendSql::aggregate(const QString &deviceAddr, int table, quint32 metric,
+                                                    qint64 tsFrom, qint64 tsTo, int resolution)
+{
+    QList <DataAggregate> aggregates;
+
+    // Rollups are named after the data table columns
+    int deviceId = getDeviceId(deviceAddr);
+    QString col = column(table, metric);
+    if (deviceId < 0 || col.isEmpty()) return aggregates;
+
+    QSqlQuery rollupData(DatabaseManager::getInstance()->getReadDatabase());
+    if (resolution == RESOLUTION_DAY)
+    {
+        // Every local day that overlaps [tsFrom, tsTo[
+        QDate dayFrom = QDateTime::fromSecsSinceEpoch(tsFrom).date();
+        QDate dayTo = QDateTime::fromSecsSinceEpoch(tsTo - 1).date().addDays(1);
+
+        rollupData.prepare(DatabaseQueries::get(DatabaseQueries::ROLLUP_DAYS_RANGE, m_mysql));
+        rollupData.bindValue(":dayFrom", dayFrom.toString("yyyy-MM-dd"));
+        rollupData.bindValue(":dayTo", dayTo.toString("yyyy-MM-dd"));
+    }
+    else
+    {
+        rollupData.prepare(DatabaseQueries::get(DatabaseQueries::ROLLUP_HOURS_RANGE, m_mysql));
+        rollupData.bindValue(":tsFrom", tsFrom - tsFrom % 3600);
+        rollupData.bindValue(":tsTo", tsTo);
+    }
+    rollupData.bindValue(":deviceId", deviceId);
+    rollupData.bindValue(":metric", col);
+
+    if (rollupData.exec() == false)
+    {
+        qWarning() << "> rollupData.exec() ERROR" << rollupData.lastError().type() << ":" << rollupData.lastError().text();
+        return aggregates;
+    }
+
+    while (rollupData.next())
+    {
+        DataAggregate a;
+        if (resolution == RESOLUTION_DAY)
+            a.ts = QDateTime(rollupData.value(0).toDate(), QTime(0, 0)).toSecsSinceEpoch();
+        else
+            a.ts = rollupData.value(0).toLongLong();
+        a.min = rollupData.value(1).toFloat();
+        a.max = rollupData.value(2).toFloat();
+        a.sum = rollupData.value(3).toDouble();
+        a.count = rollupData.value(4).toInt();
+        aggregates += a;
+    }
+
+    return aggregates;
+}
+
+/* ************************************************************************** */
+
+QVariantMap DatabaseBackendSql::getDevice(const QString &deviceAddr)
+{
+    QVariantMap infos;
+
+    QSqlQuery getInfos(DatabaseManager::getInstance()->getReadDatabase());
+    getInfos.prepare(DatabaseQueries::get(DatabaseQueries::DEVICE_SELECT_INFOS, m_mysql));
+    getInfos.bindValue(":deviceAddr", deviceAddr);
+
+    if (getInfos.exec() == false)
+    {
+        qWarning() << "> getInfos.exec() ERROR" << getInfos.lastError().type() << ":" << getInfos.lastError().text();
+    }
+    else if (getInfos.next())
+    {
+        QSqlRecord record = getInfos.record();
+        for (int i = 0; i < record.count(); i++)
+        {
+            infos.insert(record.fieldName(i), getInfos.value(i));
+        }
+    }
+
+    return infos;
+}
+
+bool DatabaseBackendSql::setDevice(const QString &deviceAddr, const QVariantMap &values)
+{
+    static const QStringList columns = {
+        "deviceModel", "deviceName", "deviceFirmware", "deviceBattery",
+        "associatedName", "locationName", "lastSync", "manualOrderIndex",
+        "isOutside", "settings"
+    };
+
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+    {
+        if (!columns.contains(it.key()))
+        {
+            qWarning() << "DatabaseBackendSql::setDevice() unknown column" << it.key();
+            return false;
+        }
+    }
+    if (values.isEmpty()) return true;
+
+    // The statement is prepared once, on the default connection: GUI thread only
+    DatabaseManager *dbm = DatabaseManager::getInstance();
+    if (QThread::currentThread() != dbm->thread())
+    {
+        QMetaObject::invokeMethod(dbm, [deviceAddr, values]() {
+            DatabaseManager::getInstance()->updateDevice(deviceAddr, values);
+        }, Qt::QueuedConnection);
+        return true;
+    }
+
+    QSqlQuery &updateDevice = dbm->getStatement(DatabaseQueries::DEVICE_UPDATE);
+    for (const auto &c: columns)
+    {
+        updateDevice.bindValue(":" + c, values.value(c)); // invalid QVariant: NULL, unchanged
+    }
+    updateDevice.bindValue(":deviceAddr", deviceAddr);
+
+    bool status = updateDevice.exec();
+    if (status == false)
+        qWarning() << "> updateDevice.exec() ERROR" << updateDevice.lastError().type() << ":" << updateDevice.lastError().text();
+
+    return status;
+}
+
+void DatabaseBackendSql::removeDevice(const QString &deviceAddr)
+{
+    // A device added again later must not get an old id
+    QMutexLocker lock(&m_deviceIdsMutex);
+    m_deviceIds.remove(deviceAddr);
+}
+
+bool DatabaseBackendSql::clearData(const QString &deviceAddr)
+{
+    int deviceId = getDeviceId(deviceAddr);
+    if (deviceId < 0) return true; // nothing was ever saved
+
+    // All at once, never rollups without their raw readings (or the reverse)
+    QSqlDatabase db = QSqlDatabase::database();
+    if (db.transaction() == false)
+    {
+        qWarning() << "> db.transaction() ERROR" << db.lastError().type() << ":" << db.lastError().text();
+        return false;
+    }
+
+    DatabasePartitions *partitions = DatabasePartitions::getInstance();
+    QStringList tables = partitions->tables(partitions->baseTable(DeviceReading::TABLE_PLANTDATA)) +
+                         partitions->tables(partitions->baseTable(DeviceReading::TABLE_SENSORDATA));
+    tables << "dataHourly" << "dataDaily" << "latestValues";
+
+    bool status = true;
+    for (const auto &table: qAsConst(tables))
+    {
+        QSqlQuery deleteData(db);
+        deleteData.prepare("DELETE FROM " + table + " WHERE deviceId = :deviceId");
+        deleteData.bindValue(":deviceId", deviceId);
+        if (deleteData.exec() == false)
+        {
+            qWarning() << "> deleteData.exec() ERROR" << deleteData.lastError().type() << ":" << deleteData.lastError().text();
+            status = false;
+            break;
+        }
+    }
+
+    if (status && db.commit()) return true;
+
+    db.rollback();
+    return false;
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,78 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+
+#ifndef DATABASE_BACKEND_SQL_H
+#define DATABASE_BACKEND_SQL_H
+/* ************************************************************************** */
+
+#include "DatabaseBackend.h"
+
+#include <QHash>
+#include <QMutex>
+
+class DatabaseWriter;
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseBackendSql class
+ *
+ * SQLite and MySQL storage. Readings go through the DatabaseWriter, queries use
+ * the partitions and the rollup tables, on the calling thread read connection
+ * (see DatabaseReadPool). The statements come from DatabaseQueries, in the
+ * right dialect.
+ *
+ * Device metadata writes use a cached statement on the default connection,
+ * calls made from another thread are forwarded to the GUI thread.
+ */
+class DatabaseBackendSql: public DatabaseBackend
+{
+    DatabaseWriter *m_writer = nullptr;
+    bool m_mysql = false;
+
+    QMutex m_deviceIdsMutex;
+    QHash <QString, int> m_deviceIds;
+    int getDeviceId(const QString &deviceAddr);
+
+    static QString column(int table, quint32 metric);
+
+public:
+    DatabaseBackendSql(DatabaseWriter *writer, bool mysql);
+
+    int type() const override { return m_mysql ? BACKEND_MYSQL : BACKEND_SQLITE; }
+
+    bool write(const QList <DeviceReading> &readings) override;
+
+    QList <DataPoint> range(const QString &deviceAddr, int table, quint32 metric,
+                            qint64 tsFrom, qint64 tsTo) override;
+
+    QList <DataAggregate> aggregate(const QString &deviceAddr, int table, quint32 metric,
+                                    qint64 tsFrom, qint64 tsTo, int resolution) override;
+
+    QVariantMap getDevice(const QString &deviceAddr) override;
+    bool setDevice(const QString &deviceAddr, const QVariantMap &values) override;
+    void removeDevice(const QString &deviceAddr) override;
+    bool clearData(const QString &deviceAddr) override;
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_BACKEND_SQL_H
@@ -0,0 +1,188 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseBackup.h"
+#include "DatabaseExport.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QVersionNumber>
+#include <QDebug>
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+/* ************************************************************************** */
+
+DatabaseBackup::DatabaseBackup(const DatabaseConnectionInfos &infos, const QString &directory,
+                               bool compress, int keep, QObject *parent) : QObject(parent)
+{
+    m_infos = infos;
+    m_connectionName = "WatchFlower_backup";
+    m_directory = directory;
+    m_compress = compress;
+    m_keep = keep;
+}
+
+/* ************************************************************************** */
+
+void DatabaseBackup::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QDir().mkpath(m_directory);
+
+    QString fileName = m_directory + "/" + QFileInfo(m_infos.databaseName).completeBaseName() +
+                       "_" + QDateTime::currentDateTimeUtc().toString("yyyyMMdd_hhmmss") + ".db";
+    QString partName = fileName + ".part";
+    QFile::remove(partName);
+
+    // Never leave a partial snapshot under its final name, the rotation would count it
+    bool status = snapshot(partName);
+    if (status && m_compress)
+    {
+        status = compress(partName, partName + ".gz");
+        QFile::remove(partName);
+        partName += ".gz";
+        fileName += ".gz";
+    }
+    if (status)
+    {
+        status = QFile::rename(partName, fileName);
+    }
+
+    if (status)
+    {
+        qInfo().noquote() << QString("Database backup: %1 (%2 KiB), in %3 ms")
+                                 .arg(fileName).arg(QFileInfo(fileName).size() / 1024).arg(timer.elapsed());
+        rotate();
+    }
+    else
+    {
+        QFile::remove(partName);
+        fileName.clear();
+    }
+
+    Q_EMIT finished(status, fileName);
+}
+
+/* ************************************************************************** */
+
+bool DatabaseBackup::snapshot(const QString &fileName)
+{
+    bool status = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(m_infos.driver, m_connectionName);
+        db.setDatabaseName(m_infos.databaseName);
+
+        if (db.open())
+        {
+            for (const auto &pragma: qAsConst(m_infos.pragmas))
+            {
+                QSqlQuery p(db);
+                if (p.exec(pragma) == false)
+                    qWarning() << "> pragma.exec() ERROR" << p.lastError().type() << ":" << p.lastError().text();
+            }
+
+            // With a rollback journal, VACUUM INTO would hold the writer for the whole snapshot
+            QSqlQuery journalMode(db);
+            QSqlQuery version(db);
+            if (!journalMode.exec("PRAGMA journal_mode") || !journalMode.next() ||
+                journalMode.value(0).toString().toLower() != "wal")
+            {
+                qWarning() << "DatabaseBackup: online backups need the WAL journal mode, not" << journalMode.value(0).toString();
+            }
+            // VACUUM INTO needs SQLite 3.27
+            else if (version.exec("SELECT sqlite_version()") && version.next() &&
+                     QVersionNumber::fromString(version.value(0).toString()) >= QVersionNumber(3, 27))
+            {
+                QSqlQuery vacuumInto(db);
+                vacuumInto.prepare("VACUUM INTO :file");
+                vacuumInto.bindValue(":file", fileName);
+                status = vacuumInto.exec();
+                if (status == false)
+                    qWarning() << "> vacuumInto.exec() ERROR" << vacuumInto.lastError().type() << ":" << vacuumInto.lastError().text();
+            }
+            else
+            {
+                qWarning() << "DatabaseBackup: SQLite" << version.value(0).toString() << "is too old for online backups";
+            }
+
+            db.close();
+        }
+        else
+        {
+            qWarning() << "DatabaseBackup cannot open database... Error:" << db.lastError();
+        }
+    }
+    QSqlDatabase::removeDatabase(m_connectionName);
+
+    return status;
+}
+
+bool DatabaseBackup::compress(const QString &source, const QString &destination)
+{
+    QFile in(source);
+    QFile out(destination);
+    if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << "DatabaseBackup::compress() cannot open" << source << "or" << destination;
+        return false;
+    }
+
+    // Concatenated gzip members, every gzip reader handles them as a single stream
+    while (!in.atEnd())
+    {
+        const QByteArray member = DatabaseExport::gzip(in.read(BACKUP_CHUNK_SIZE));
+        if (member.isEmpty() || out.write(member) != member.size())
+        {
+            qWarning() << "DatabaseBackup::compress() cannot write" << destination;
+            return false;
+        }
+    }
+
+    return (in.error() == QFile::NoError && out.flush());
+}
+
+void DatabaseBackup::rotate()
+{
+    if (m_keep <= 0) return; // keep them all
+
+    QString base = QFileInfo(m_infos.databaseName).completeBaseName();
+
+    // Timestamped names, so the name order is the age order
+    QDir dir(m_directory);
+    QStringList snapshots = dir.entryList({base + "_*.db", base + "_*.db.gz"}, QDir::Files, QDir::Name);
+
+    while (snapshots.size() > m_keep)
+    {
+        QString oldest = snapshots.takeFirst();
+        qDebug() << "- Removing database backup" << oldest;
+        dir.remove(oldest);
+    }
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,78 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DATABASE_BACKUP_H
+#define DATABASE_BACKUP_H
+/* ************************************************************************** */
+
+#include "DatabaseWriter.h"
+
+#include <QObject>
+#include <QString>
+
+#define BACKUP_CHUNK_SIZE       (1024*1024) // bytes, compressed one chunk at a time
+#define BACKUP_KEEP             5           // snapshots kept, the oldest ones are removed
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseBackup class
+ *
+ * Online snapshot of the SQLite database, taken with VACUUM INTO on a
+ * connection of its own, from its own thread. In WAL mode that connection is
+ * just another reader: the DatabaseWriter and the UI keep going while the
+ * snapshot is written, and the snapshot is consistent (a single read
+ * transaction). Without WAL, that read transaction would block every write
+ * for the whole snapshot, so there is no online backup in that case.
+ * The result is compacted, optionally compressed, and the older snapshots are
+ * rotated out.
+ *
+ * Compressed snapshots are standard gzip files (.db.gz, one gzip member per
+ * chunk), restored with any gzip tool.
+ */
+class DatabaseBackup: public QObject
+{
+    Q_OBJECT
+
+    DatabaseConnectionInfos m_infos;
+    QString m_connectionName;
+    QString m_directory;
+    bool m_compress = false;
+    int m_keep = BACKUP_KEEP;
+
+    bool snapshot(const QString &fileName);
+    bool compress(const QString &source, const QString &destination);
+    void rotate();
+
+public:
+    DatabaseBackup(const DatabaseConnectionInfos &infos, const QString &directory,
+                   bool compress, int keep, QObject *parent = nullptr);
+    ~DatabaseBackup() = default;
+
+public slots:
+    void run();
+
+Q_SIGNALS:
+    void finished(bool status, const QString &snapshotFile);
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_BACKUP_H
@@ -0,0 +1,678 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseBenchmark.h"
+#include "DatabaseWriter.h"
+#include "DatabasePartitions.h"
+#include "DatabaseBackendMemory.h"
+#include "device_utils.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QPair>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+/* ************************************************************************** */
+
+DatabaseBenchmark::DatabaseBenchmark(const QString &directory)
+{
+    m_directory = directory.isEmpty() ? QDir::tempPath() : directory;
+    m_now = QDateTime::currentDateTime();
+}
+
+/* ************************************************************************** */
+
+void DatabaseBenchmark::run()
+{
+    qInfo() << "Database benchmark, in" << m_directory;
+    qInfo() << "-" << m_devices << "devices," << m_days << "days of hourly readings";
+
+    QList <QPair <QString, SqliteProfile>> profiles;
+    profiles << qMakePair(QString("legacy"), SqliteProfile::legacy());
+    profiles << qMakePair(QString("current"), SqliteProfile::fromSettings());
+
+    for (const auto &p: qAsConst(profiles))
+    {
+        QString dbName = "watchflower_benchmark_" + p.first + ".db";
+
+        if (openDatabase(dbName, p.second))
+        {
+            createTables();
+
+            double single = benchInsertSingle();
+            double batched = benchInsertBatched();
+            double charts = benchChartQueries();
+
+            closeDatabase(dbName);
+
+            qInfo().noquote() << QString("> %1 (journal %2, synchronous %3)").arg(p.first, p.second.journalMode, p.second.synchronous);
+            qInfo().noquote() << QString("  - insert, one row per transaction: %1 rows/s").arg(single, 0, 'f', 0);
+            qInfo().noquote() << QString("  - insert, %1 rows per transaction: %2 rows/s").arg(WRITER_BATCH_SIZE).arg(batched, 0, 'f', 0);
+            qInfo().noquote() << QString("  - chart queries: %1 ms per device").arg(charts, 0, 'f', 2);
+        }
+    }
+
+    benchLayouts();
+    benchBackends();
+    benchHydration();
+}
+
+/* ************************************************************************** */
+
+bool DatabaseBenchmark::openDatabase(const QString &name, const SqliteProfile &profile)
+{
+    QString path = m_directory + "/" + name;
+    QFile::remove(path);
+    QFile::remove(path + "-wal");
+    QFile::remove(path + "-shm");
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", m_connectionName);
+    db.setDatabaseName(path);
+
+    if (db.open() == false)
+    {
+        qWarning() << "Cannot open benchmark database... Error:" << db.lastError();
+        return false;
+    }
+
+    return DatabaseManager::applySqliteProfile(db, profile);
+}
+
+void DatabaseBenchmark::closeDatabase(const QString &name)
+{
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(m_connectionName);
+
+    QString path = m_directory + "/" + name;
+    QFile::remove(path);
+    QFile::remove(path + "-wal");
+    QFile::remove(path + "-shm");
+}
+
+void DatabaseBenchmark::createTables()
+{
+    // Same layout as DatabaseManager::createDatabase()
+    QSqlQuery createData(QSqlDatabase::database(m_connectionName));
+    createData.prepare("CREATE TABLE plantData (" \
+                       "deviceId INTEGER NOT NULL," \
+                       "ts BIGINT NOT NULL," \
+                       "ts_full BIGINT," \
+                         "soilMoisture INT," \
+                         "soilConductivity INT," \
+                         "soilTemperature FLOAT," \
+                         "soilPH FLOAT," \
+                         "temperature FLOAT," \
+                         "humidity FLOAT," \
+                         "luminosity INT," \
+                         "watertank FLOAT," \
+                       " PRIMARY KEY(deviceId, ts)" \
+                       ") WITHOUT ROWID;");
+
+    if (createData.exec() == false)
+        qWarning() << "> createData.exec() ERROR" << createData.lastError().type() << ":" << createData.lastError().text();
+}
+
+/* ************************************************************************** */
+
+static bool insertPlantData(QSqlQuery &addData, int deviceId, const QDateTime &ts, int i)
+{
+    addData.bindValue(":deviceId", deviceId);
+    addData.bindValue(":ts", ts.toSecsSinceEpoch() - ts.toSecsSinceEpoch() % 3600);
+    addData.bindValue(":ts_full", ts.toSecsSinceEpoch());
+    addData.bindValue(":hygro", 20 + i % 30);
+    addData.bindValue(":condu", 300 + i % 200);
+    addData.bindValue(":temp", 18.f + (i % 100) / 10.f);
+    addData.bindValue(":humi", 40.f + (i % 40));
+    addData.bindValue(":lumi", (i % 24) * 1000);
+
+    bool status = addData.exec();
+    if (status == false)
+        qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
+
+    return status;
+}
+
+double DatabaseBenchmark::benchInsertSingle()
+{
+    QSqlQuery addData(QSqlDatabase::database(m_connectionName));
+    addData.prepare("REPLACE INTO plantData (deviceId, ts, ts_full, soilMoisture, soilConductivity, temperature, humidity, luminosity)"
+                    " VALUES (:deviceId, :ts, :ts_full, :hygro, :condu, :temp, :humi, :lumi)");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Autocommit, what the device drivers used to do
+    for (int i = 0; i < m_singleInserts; i++)
+    {
+        insertPlantData(addData, m_devices, m_now.addSecs(-3600 * i), i);
+    }
+
+    qint64 ms = qMax(timer.elapsed(), qint64(1));
+    return m_singleInserts * 1000.0 / ms;
+}
+
+double DatabaseBenchmark::benchInsertBatched()
+{
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    QSqlQuery addData(db);
+    addData.prepare("REPLACE INTO plantData (deviceId, ts, ts_full, soilMoisture, soilConductivity, temperature, humidity, luminosity)"
+                    " VALUES (:deviceId, :ts, :ts_full, :hygro, :condu, :temp, :humi, :lumi)");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // What the DatabaseWriter does
+    int rows = 0;
+    db.transaction();
+    for (int d = 0; d < m_devices; d++)
+    {
+        for (int h = 0; h < m_days * 24; h++)
+        {
+            insertPlantData(addData, d, m_now.addSecs(-3600 * h), h);
+
+            if (++rows % WRITER_BATCH_SIZE == 0)
+            {
+                db.commit();
+                db.transaction();
+            }
+        }
+    }
+    db.commit();
+
+    qint64 ms = qMax(timer.elapsed(), qint64(1));
+    return rows * 1000.0 / ms;
+}
+
+double DatabaseBenchmark::benchChartQueries()
+{
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // The queries behind the 'days', 'min/max' and 'all in one' graphs
+    for (int l = 0; l < m_queryLoops; l++)
+    {
+        for (int d = 0; d < m_devices; d++)
+        {
+            QSqlQuery days(db);
+            days.prepare("SELECT strftime('%Y-%m-%d', ts, 'unixepoch', 'localtime'), avg(soilMoisture) as 'avg'" \
+                         "FROM plantData " \
+                         "WHERE deviceId = :deviceId " \
+                         "GROUP BY strftime('%Y-%m-%d', ts, 'unixepoch', 'localtime') " \
+                         "ORDER BY ts DESC;");
+            days.bindValue(":deviceId", d);
+            days.exec();
+            while (days.next()) {}
+
+            QSqlQuery minmax(db);
+            minmax.prepare("SELECT strftime('%Y-%m-%d', ts, 'unixepoch', 'localtime'), " \
+                           " min(temperature), avg(temperature), max(temperature), " \
+                           " min(humidity), max(humidity) " \
+                           "FROM plantData " \
+                           "WHERE deviceId = :deviceId " \
+                           "GROUP BY strftime('%Y-%m-%d', ts, 'unixepoch', 'localtime') " \
+                           "ORDER BY ts DESC;");
+            minmax.bindValue(":deviceId", d);
+            minmax.exec();
+            while (minmax.next()) {}
+
+            QSqlQuery aio(db);
+            aio.prepare("SELECT ts_full, soilMoisture, soilConductivity, temperature, luminosity " \
+                        "FROM plantData " \
+                        "WHERE deviceId = :deviceId AND ts >= :ts;");
+            aio.bindValue(":deviceId", d);
+            aio.bindValue(":ts", m_now.addDays(-30).toSecsSinceEpoch());
+            aio.exec();
+            while (aio.next())
+            {
+                QDateTime date = QDateTime::fromSecsSinceEpoch(aio.value(0).toLongLong());
+                Q_UNUSED(date)
+            }
+        }
+    }
+
+    return timer.nsecsElapsed() / 1000000.0 / (m_queryLoops * m_devices);
+}
+
+/* ************************************************************************** */
+
+static QList <QList <quint32>> environmentalDevices()
+{
+    // Environmental sensors only fill a few of the 22 sensorData columns
+    QList <QList <quint32>> devices;
+    devices << QList <quint32>{ DeviceUtils::SENSOR_GEIGER };
+    devices << QList <quint32>{ DeviceUtils::SENSOR_TEMPERATURE, DeviceUtils::SENSOR_HUMIDITY };
+    devices << QList <quint32>{ DeviceUtils::SENSOR_TEMPERATURE, DeviceUtils::SENSOR_HUMIDITY, DeviceUtils::SENSOR_PRESSURE };
+    devices << QList <quint32>{ DeviceUtils::SENSOR_TEMPERATURE, DeviceUtils::SENSOR_CO2, DeviceUtils::SENSOR_VOC, DeviceUtils::SENSOR_HCHO };
+    devices << QList <quint32>{ DeviceUtils::SENSOR_TEMPERATURE, DeviceUtils::SENSOR_HUMIDITY, DeviceUtils::SENSOR_PM25, DeviceUtils::SENSOR_PM10, DeviceUtils::SENSOR_CO2 };
+
+    return devices;
+}
+
+void DatabaseBenchmark::benchLayouts()
+{
+    const QList <QList <quint32>> devices = environmentalDevices();
+
+    QHash <quint32, QString> columns;
+    const auto cols = DatabaseWriter::columns(DeviceReading::TABLE_SENSORDATA);
+    for (const auto &c: cols) columns.insert(c.first, c.second);
+
+    for (const QString &base: {QString("sensorData"), QString("sensorValues")})
+    {
+        bool narrow = DatabasePartitions::isNarrow(base);
+        QString dbName = "watchflower_benchmark_" + base + ".db";
+        QString path = m_directory + "/" + dbName;
+
+        if (!openDatabase(dbName, SqliteProfile::fromSettings())) continue;
+        QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+
+        QSqlQuery createData(db);
+        if (createData.exec(DatabasePartitions::createStatement(base, base, false)) == false)
+            qWarning() << "> createData.exec() ERROR" << createData.lastError().type() << ":" << createData.lastError().text();
+
+        // Insert
+        QElapsedTimer timer;
+        timer.start();
+
+        int readings = 0;
+        db.transaction();
+        for (int d = 0; d < devices.size(); d++)
+        {
+            const QList <quint32> &metrics = devices.at(d);
+
+            // One statement per device, as each one writes its own set of columns
+            QSqlQuery addData(db);
+            if (narrow)
+            {
+                addData.prepare("REPLACE INTO sensorValues (deviceId, metric, ts, value) VALUES (:deviceId, :metric, :ts, :value)");
+            }
+            else
+            {
+                QString names = "deviceId, ts";
+                QString values = ":deviceId, :ts";
+                for (quint32 m: metrics)
+                {
+                    names += ", " + columns.value(m);
+                    values += ", :" + columns.value(m);
+                }
+                addData.prepare("REPLACE INTO sensorData (" + names + ") VALUES (" + values + ")");
+            }
+
+            for (int h = 0; h < m_days * 24; h++)
+            {
+                qint64 ts = m_now.addSecs(-3600 * h).toSecsSinceEpoch();
+                float value = 20.f + (h % 100) / 10.f;
+
+                addData.bindValue(":deviceId", d);
+                addData.bindValue(":ts", ts);
+
+                if (narrow)
+                {
+                    for (quint32 m: metrics)
+                    {
+                        addData.bindValue(":metric", m);
+                        addData.bindValue(":value", value);
+                        addData.exec();
+                    }
+                }
+                else
+                {
+                    for (quint32 m: metrics)
+                    {
+                        addData.bindValue(":" + columns.value(m), value);
+                    }
+                    addData.exec();
+                }
+
+                if (++readings % WRITER_BATCH_SIZE == 0)
+                {
+                    db.commit();
+                    db.transaction();
+                }
+            }
+        }
+        db.commit();
+
+        double inserts = readings * 1000.0 / qMax(timer.elapsed(), qint64(1));
+
+        // One metric, over the last 30 days, what the charts ask for
+        qint64 ts30 = m_now.addDays(-30).toSecsSinceEpoch();
+        int queries = 0;
+        timer.restart();
+
+        for (int l = 0; l < m_queryLoops; l++)
+        {
+            for (int d = 0; d < devices.size(); d++)
+            {
+                for (quint32 m: devices.at(d))
+                {
+                    QSqlQuery metricData(db);
+                    if (narrow)
+                    {
+                        metricData.prepare("SELECT ts, value FROM sensorValues WHERE deviceId = :deviceId AND metric = :metric AND ts >= :ts");
+                        metricData.bindValue(":metric", m);
+                    }
+                    else
+                    {
+                        QString col = columns.value(m);
+                        metricData.prepare("SELECT ts, " + col + " FROM sensorData WHERE deviceId = :deviceId AND ts >= :ts AND " + col + " IS NOT NULL");
+                    }
+                    metricData.bindValue(":deviceId", d);
+                    metricData.bindValue(":ts", ts30);
+                    metricData.exec();
+                    while (metricData.next()) {}
+
+                    queries++;
+                }
+            }
+        }
+
+        double perMetric = timer.nsecsElapsed() / 1000000.0 / qMax(queries, 1);
+
+        // Fold the WAL back into the database file before measuring it
+        QSqlQuery ckpt(db);
+        ckpt.exec("PRAGMA wal_checkpoint(TRUNCATE)");
+        qint64 size = QFileInfo(path).size() + QFileInfo(path + "-wal").size();
+
+        db = QSqlDatabase();
+        closeDatabase(dbName);
+
+        qInfo().noquote() << QString("> layout %1 (%2 devices, 1 to 5 metrics each)").arg(narrow ? "narrow" : "wide").arg(devices.size());
+        qInfo().noquote() << QString("  - size on disk: %1 KiB").arg(size / 1024);
+        qInfo().noquote() << QString("  - insert, %1 readings per transaction: %2 readings/s").arg(WRITER_BATCH_SIZE).arg(inserts, 0, 'f', 0);
+        qInfo().noquote() << QString("  - one metric, 30 days: %1 ms per query").arg(perMetric, 0, 'f', 2);
+    }
+}
+
+/* ************************************************************************** */
+
+void DatabaseBenchmark::benchBackends()
+{
+    // Same workload as benchLayouts(), the SQLite numbers are right above
+    const QList <QList <quint32>> devices = environmentalDevices();
+    DatabaseBackendMemory backend;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int readings = 0;
+    QList <DeviceReading> batch;
+    for (int d = 0; d < devices.size(); d++)
+    {
+        for (int h = 0; h < m_days * 24; h++)
+        {
+            DeviceReading r(DeviceReading::TABLE_SENSORDATA, "benchmark_" + QString::number(d), m_now.addSecs(-3600 * h));
+            for (quint32 m: devices.at(d))
+            {
+                r.set(m, 20.f + (h % 100) / 10.f);
+            }
+            batch += r;
+
+            if (++readings % WRITER_BATCH_SIZE == 0)
+            {
+                backend.write(batch);
+                batch.clear();
+            }
+        }
+    }
+    backend.write(batch);
+
+    double inserts = readings * 1000.0 / qMax(timer.elapsed(), qint64(1));
+
+    qint64 ts30 = m_now.addDays(-30).toSecsSinceEpoch();
+    qint64 tsNow = m_now.toSecsSinceEpoch() + 1;
+    int queries = 0;
+    timer.restart();
+
+    for (int l = 0; l < m_queryLoops; l++)
+    {
+        for (int d = 0; d < devices.size(); d++)
+        {
+            for (quint32 m: devices.at(d))
+            {
+                backend.range("benchmark_" + QString::number(d), DeviceReading::TABLE_SENSORDATA, m, ts30, tsNow);
+                queries++;
+            }
+        }
+    }
+
+    double perRange = timer.nsecsElapsed() / 1000000.0 / qMax(queries, 1);
+    timer.restart();
+
+    for (int l = 0; l < m_queryLoops; l++)
+    {
+        for (int d = 0; d < devices.size(); d++)
+        {
+            for (quint32 m: devices.at(d))
+            {
+                backend.aggregate("benchmark_" + QString::number(d), DeviceReading::TABLE_SENSORDATA, m, ts30, tsNow,
+                                  DatabaseBackend::RESOLUTION_DAY);
+            }
+        }
+    }
+
+    double perAggregate = timer.nsecsElapsed() / 1000000.0 / qMax(queries, 1);
+
+    qInfo().noquote() << QString("> backend memory (%1 devices, 1 to 5 metrics each)").arg(devices.size());
+    qInfo().noquote() << QString("  - insert, %1 readings per write: %2 readings/s").arg(WRITER_BATCH_SIZE).arg(inserts, 0, 'f', 0);
+    qInfo().noquote() << QString("  - one metric, 30 days: %1 ms per query").arg(perRange, 0, 'f', 2);
+    qInfo().noquote() << QString("  - one metric, 30 daily aggregates: %1 ms per query").arg(perAggregate, 0, 'f', 2);
+}
+
+/* ************************************************************************** */
+
+static qint64 residentMemory()
+{
+    // Linux only, -1 elsewhere
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) return -1;
+
+    const QList <QByteArray> pages = statm.readAll().split(' ');
+    if (pages.size() < 2) return -1;
+
+    return pages.at(1).toLongLong() * 4096;
+}
+
+void DatabaseBenchmark::benchHydration()
+{
+    QString dbName = "watchflower_benchmark_fleet.db";
+    if (!openDatabase(dbName, SqliteProfile::fromSettings())) return;
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+
+    // Same layout as DatabaseManager::createDatabase()
+    QStringList creates;
+    creates << "CREATE TABLE devices (deviceAddr CHAR(38) PRIMARY KEY, deviceModel VARCHAR(255), deviceName VARCHAR(255)," \
+               " deviceFirmware VARCHAR(255), deviceBattery INT, associatedName VARCHAR(255), locationName VARCHAR(255)," \
+               " lastSync DATETIME, manualOrderIndex INT, isOutside BOOLEAN, settings VARCHAR(255))";
+    creates << "CREATE TABLE deviceIds (deviceId INTEGER PRIMARY KEY, deviceAddr CHAR(38) UNIQUE NOT NULL)";
+    creates << "CREATE TABLE plantLimits (deviceAddr CHAR(38), hygroMin INT, hygroMax INT, conduMin INT, conduMax INT," \
+               " phMin FLOAT, phMax FLOAT, tempMin INT, tempMax INT, humiMin INT, humiMax INT," \
+               " luxMin INT, luxMax INT, mmolMin INT, mmolMax INT, PRIMARY KEY(deviceAddr))";
+    creates << "CREATE TABLE latestValues (deviceId INTEGER NOT NULL, metric INT NOT NULL, ts BIGINT NOT NULL, value FLOAT," \
+               " PRIMARY KEY(deviceId, metric)) WITHOUT ROWID";
+    for (const auto &create: qAsConst(creates))
+    {
+        QSqlQuery createTable(db);
+        if (createTable.exec(create) == false)
+            qWarning() << "> createTable.exec() ERROR" << createTable.lastError().type() << ":" << createTable.lastError().text();
+    }
+
+    // The fleet: plant sensors, with limits, settings and four current values each
+    const quint32 metrics[] = { DeviceUtils::SENSOR_SOIL_MOISTURE, DeviceUtils::SENSOR_SOIL_CONDUCTIVITY,
+                                DeviceUtils::SENSOR_TEMPERATURE, DeviceUtils::SENSOR_LUMINOSITY };
+    qint64 ts = m_now.toSecsSinceEpoch();
+
+    db.transaction();
+    QSqlQuery addDevice(db);
+    addDevice.prepare("INSERT INTO devices (deviceAddr, deviceModel, deviceName, deviceFirmware, deviceBattery, associatedName, locationName, isOutside, settings)" \
+                      " VALUES (:addr, 'HHCCJCY01', 'Flower care', '3.2.2', 80, :plant, 'Living room', 0, :settings)");
+    QSqlQuery addId(db);
+    addId.prepare("INSERT INTO deviceIds (deviceId, deviceAddr) VALUES (:id, :addr)");
+    QSqlQuery addLimits(db);
+    addLimits.prepare("INSERT INTO plantLimits VALUES (:addr, 15, 50, 100, 500, 6.5, 7.5, 14, 28, 40, 60, 1000, 3000, 0, 0)");
+    QSqlQuery addLatest(db);
+    addLatest.prepare("INSERT INTO latestValues (deviceId, metric, ts, value) VALUES (:id, :metric, :ts, :value)");
+
+    for (int d = 0; d < m_fleetSize; d++)
+    {
+        QString addr = QString("C4:7C:8D:%1:%2:%3").arg((d >> 16) & 0xFF, 2, 16, QChar('0')).arg((d >> 8) & 0xFF, 2, 16, QChar('0')).arg(d & 0xFF, 2, 16, QChar('0'));
+        addDevice.bindValue(":addr", addr);
+        addDevice.bindValue(":plant", "Plant " + QString::number(d));
+        addDevice.bindValue(":settings", "{\"waterTankCapacity\": \"1.5\", \"primary\": \"hygrometer\"}");
+        addDevice.exec();
+        addId.bindValue(":id", d + 1);
+        addId.bindValue(":addr", addr);
+        addId.exec();
+        addLimits.bindValue(":addr", addr);
+        addLimits.exec();
+        for (quint32 m: metrics)
+        {
+            addLatest.bindValue(":id", d + 1);
+            addLatest.bindValue(":metric", m);
+            addLatest.bindValue(":ts", ts - d);
+            addLatest.bindValue(":value", 20.f + d % 10);
+            addLatest.exec();
+        }
+    }
+    db.commit();
+
+    qint64 tsFrom = m_now.addSecs(-12 * 3600).toSecsSinceEpoch();
+
+    // Before: each device loads its infos, limits and latest values, and parses its settings
+    qint64 memBefore = residentMemory();
+    QElapsedTimer timer;
+    timer.start();
+
+    QList <DevicePreload> eager;
+    QList <QJsonObject> eagerSettings;
+    QList <QVariantList> eagerLimits;
+    {
+        QSqlQuery listDevices(db);
+        QSqlQuery getInfos(db);
+        QSqlQuery getId(db);
+        QSqlQuery getLimits(db);
+        QSqlQuery getLatest(db);
+        getInfos.prepare(DatabaseQueries::get(DatabaseQueries::DEVICE_SELECT_INFOS));
+        getId.prepare(DatabaseQueries::get(DatabaseQueries::DEVICEID_SELECT));
+        getLimits.prepare(DatabaseQueries::get(DatabaseQueries::PLANTLIMITS_SELECT));
+        getLatest.prepare(DatabaseQueries::get(DatabaseQueries::LATEST_VALUES_SELECT));
+
+        listDevices.exec("SELECT deviceName, deviceAddr FROM devices");
+        while (listDevices.next())
+        {
+            DevicePreload p;
+            p.deviceName = listDevices.value(0).toString();
+            p.deviceAddr = listDevices.value(1).toString();
+
+            getInfos.bindValue(":deviceAddr", p.deviceAddr);
+            if (getInfos.exec() && getInfos.next())
+            {
+                for (int i = 0; i < 8; i++) p.infos += getInfos.value(i);
+                eagerSettings += QJsonDocument::fromJson(getInfos.value(7).toString().toUtf8()).object();
+            }
+            getId.bindValue(":deviceAddr", p.deviceAddr);
+            if (getId.exec() && getId.next()) p.deviceId = getId.value(0).toInt();
+            getLimits.bindValue(":deviceAddr", p.deviceAddr);
+            if (getLimits.exec() && getLimits.next())
+            {
+                QVariantList limits;
+                for (int i = 0; i < 14; i++) limits += getLimits.value(i);
+                eagerLimits += limits;
+            }
+            getLatest.bindValue(":deviceId", p.deviceId);
+            getLatest.bindValue(":ts", tsFrom);
+            getLatest.exec();
+            while (getLatest.next())
+            {
+                DataPoint v;
+                v.ts = getLatest.value(1).toLongLong();
+                v.value = getLatest.value(2).toFloat();
+                p.latest += qMakePair(getLatest.value(0).toUInt(), v);
+            }
+            eager += p;
+        }
+    }
+
+    double eagerMs = timer.nsecsElapsed() / 1000000.0;
+    qint64 eagerMem = residentMemory() - memBefore;
+
+    // After: the devices list in two queries, limits and settings are left for later
+    memBefore = residentMemory();
+    timer.restart();
+
+    QHash <QString, DevicePreload> lazy;
+    {
+        QHash <int, QString> deviceAddrs;
+        QSqlQuery allDevices(db);
+        allDevices.exec(DatabaseQueries::get(DatabaseQueries::DEVICE_SELECT_ALL));
+        while (allDevices.next())
+        {
+            DevicePreload p;
+            for (int i = 0; i < 8; i++) p.infos += allDevices.value(i);
+            p.deviceName = allDevices.value(8).toString();
+            p.deviceAddr = allDevices.value(9).toString();
+            if (!allDevices.value(10).isNull()) p.deviceId = allDevices.value(10).toInt();
+            deviceAddrs.insert(p.deviceId, p.deviceAddr);
+            lazy.insert(p.deviceAddr, p);
+        }
+
+        QSqlQuery allLatest(db);
+        allLatest.prepare(DatabaseQueries::get(DatabaseQueries::LATEST_VALUES_SELECT_ALL));
+        allLatest.bindValue(":ts", tsFrom);
+        allLatest.exec();
+        while (allLatest.next())
+        {
+            auto p = lazy.find(deviceAddrs.value(allLatest.value(3).toInt()));
+            if (p == lazy.end()) continue;
+
+            DataPoint v;
+            v.ts = allLatest.value(1).toLongLong();
+            v.value = allLatest.value(2).toFloat();
+            p->latest += qMakePair(allLatest.value(0).toUInt(), v);
+        }
+    }
+
+    double lazyMs = timer.nsecsElapsed() / 1000000.0;
+    qint64 lazyMem = residentMemory() - memBefore;
+
+    db = QSqlDatabase();
+    closeDatabase(dbName);
+
+    qInfo().noquote() << QString("> startup loading (%1 devices)").arg(m_fleetSize);
+    qInfo().noquote() << QString("  - per device queries: %1 ms, %2 KiB resident").arg(eagerMs, 0, 'f', 1).arg(eagerMem < 0 ? -1 : eagerMem / 1024);
+    qInfo().noquote() << QString("  - bulk, limits and settings on first use: %1 ms, %2 KiB resident").arg(lazyMs, 0, 'f', 1).arg(lazyMem < 0 ? -1 : lazyMem / 1024);
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,72 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DATABASE_BENCHMARK_H
+#define DATABASE_BENCHMARK_H
+/* ************************************************************************** */
+
+#include "DatabaseManager.h"
+
+#include <QString>
+#include <QDateTime>
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseBenchmark class
+ *
+ * Runs the same insert and chart workloads against scratch databases, using
+ * different storage profiles. Start WatchFlower with '--benchmark [directory]'
+ * to use it, the directory being on the storage you want to measure.
+ */
+class DatabaseBenchmark
+{
+    QString m_directory;
+    QString m_connectionName = "WatchFlower_benchmark";
+
+    int m_devices = 8;
+    int m_days = 90;                //!< One reading per hour per device
+    int m_singleInserts = 500;      //!< Single row transactions are slow, don't do too many
+    int m_queryLoops = 10;
+    int m_fleetSize = 1000;         //!< Synthetic devices, for the startup loading
+
+    QDateTime m_now;
+
+    bool openDatabase(const QString &name, const SqliteProfile &profile);
+    void closeDatabase(const QString &name);
+    void createTables();
+
+    double benchInsertSingle();
+    double benchInsertBatched();
+    double benchChartQueries();
+
+    void benchLayouts();
+    void benchBackends();
+    void benchHydration();
+
+public:
+    DatabaseBenchmark(const QString &directory);
+
+    void run();
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_BENCHMARK_H
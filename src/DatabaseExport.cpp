@@ -0,0 +1,523 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseExport.h"
+#include "DatabaseManager.h"
+#include "DatabasePartitions.h"
+#include "DatabaseWriter.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QVector>
+#include <QDebug>
+
+#include <QSqlDatabase>
+#include <QSqlError>
+
+/* ************************************************************************** */
+
+QString ExportOptions::fileExtension() const
+{
+    QString ext = (format == FORMAT_JSONL) ? "jsonl" : "csv";
+    if (gzip) ext += ".gz";
+
+    return ext;
+}
+
+/* ************************************************************************** */
+
+static quint32 crc32(const QByteArray &data)
+{
+    static const QVector <quint32> table = []() {
+        QVector <quint32> t(256);
+        for (quint32 n = 0; n < 256; n++)
+        {
+            quint32 c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    quint32 crc = 0xFFFFFFFF;
+    for (char ch: data) crc = table[(crc ^ quint8(ch)) & 0xFF] ^ (crc >> 8);
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+QByteArray DatabaseExport::gzip(const QByteArray &data)
+{
+    // qCompress(): uncompressed size (4 bytes), zlib header (2 bytes), deflate data, adler32 (4 bytes)
+    // a gzip member: gzip header (10 bytes), the same deflate data, crc32 and size (little endian)
+    const QByteArray z = qCompress(data);
+    if (z.size() < 10) return QByteArray();
+
+    QByteArray member("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+    member.append(z.constData() + 6, z.size() - 10);
+
+    quint32 crc = crc32(data);
+    quint32 size = quint32(data.size());
+    for (int i = 0; i < 4; i++) member.append(char((crc >> (8*i)) & 0xFF));
+    for (int i = 0; i < 4; i++) member.append(char((size >> (8*i)) & 0xFF));
+
+    return member;
+}
+
+static QByteArray csvField(const QString &value)
+{
+    QByteArray f = value.toUtf8();
+    if (f.contains(',') || f.contains('"') || f.contains('\n'))
+    {
+        f.replace("\"", "\"\"");
+        f = "\"" + f + "\"";
+    }
+
+    return f;
+}
+
+static QByteArray jsonString(const QString &value)
+{
+    // Let Qt do the escaping: ["value"] > "value"
+    QByteArray a = QJsonDocument(QJsonArray{value}).toJson(QJsonDocument::Compact);
+    return a.mid(1, a.size() - 2);
+}
+
+/* ************************************************************************** */
+
+DatabaseExport::DatabaseExport(const QList <ExportDevice> &devices, const ExportOptions &options,
+                               const QString &path, QObject *parent) : QObject(parent)
+{
+    m_devices = devices;
+    m_options = options;
+    m_path = path;
+    m_cancel = false;
+
+    // Output columns: the plantData ones, then the sensorData ones not already there
+    const DeviceReading::ReadingTable tables[] = { DeviceReading::TABLE_PLANTDATA, DeviceReading::TABLE_SENSORDATA };
+    for (auto table: tables)
+    {
+        const auto cols = DatabaseWriter::columns(table);
+        for (const auto &c: cols)
+        {
+            if (!m_columnIndex.contains(c.second))
+            {
+                m_columnIndex.insert(c.second, m_columns.size());
+                m_columns += c.second;
+                m_temperature += (c.first == DeviceUtils::SENSOR_TEMPERATURE || c.first == DeviceUtils::SENSOR_SOIL_TEMPERATURE);
+            }
+            if (table == DeviceReading::TABLE_SENSORDATA)
+                m_metricIndex.insert(c.first, m_columnIndex.value(c.second));
+        }
+    }
+}
+
+/* ************************************************************************** */
+
+void DatabaseExport::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    bool status = false;
+    bool opened = false;    // only remove a file this run created (or truncated)
+    qint64 rows = 0;
+
+    m_file.setFileName(m_path);
+    if (!m_options.manifest.isEmpty() && !loadManifest())
+    {
+        // Don't start over from scratch, nor overwrite it
+        qWarning() << "DatabaseExport cannot read manifest:" << m_options.manifest;
+    }
+    else if (m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        opened = true;
+        m_buffer.reserve(EXPORT_BUFFER_SIZE + 64*1024);
+
+        if (m_options.format == ExportOptions::FORMAT_CSV)
+        {
+            m_buffer += "timestamp,deviceAddr,deviceName";
+            for (int i = 0; i < m_columns.size(); i++)
+            {
+                m_buffer += "," + m_columns.at(i).toUtf8();
+                if (m_temperature.at(i)) m_buffer += m_options.fahrenheit ? " (℉)" : " (℃)";
+            }
+            m_buffer += "\n";
+        }
+
+        // Only the partitions that may have something new for at least one device
+        qint64 plantFrom = std::numeric_limits<qint64>::max();
+        qint64 sensorFrom = std::numeric_limits<qint64>::max();
+        for (const auto &d: qAsConst(m_devices))
+        {
+            plantFrom = qMin(plantFrom, deviceFrom(d.deviceAddr, DeviceReading::TABLE_PLANTDATA));
+            sensorFrom = qMin(sensorFrom, deviceFrom(d.deviceAddr, DeviceReading::TABLE_SENSORDATA));
+        }
+
+        DatabasePartitions *partitions = DatabasePartitions::getInstance();
+        const QStringList plantTables = partitions->tables("plantData", plantFrom);
+        const QStringList sensorTables = partitions->tables(partitions->baseTable(DeviceReading::TABLE_SENSORDATA), sensorFrom);
+
+        int steps = m_devices.size() * (plantTables.size() + sensorTables.size());
+        int step = 0;
+
+        for (const auto &d: qAsConst(m_devices))
+        {
+            for (const auto &t: plantTables)
+            {
+                if (!exportTable(d, DeviceReading::TABLE_PLANTDATA, t, rows) || m_cancel) break;
+                Q_EMIT progress(float(++step) / steps);
+            }
+            for (const auto &t: sensorTables)
+            {
+                if (!exportTable(d, DeviceReading::TABLE_SENSORDATA, t, rows) || m_cancel) break;
+                Q_EMIT progress(float(++step) / steps);
+            }
+            if (m_cancel || m_failed) break;
+        }
+
+        status = (!m_cancel && !m_failed && writeBuffer() && m_file.flush());
+        m_file.close();
+
+        // The delta file only counts once the manifest knows about it
+        if (status && !m_options.manifest.isEmpty())
+            status = saveManifest(rows);
+    }
+    else
+    {
+        qWarning() << "DatabaseExport cannot open export file:" << m_path;
+    }
+
+    if (status)
+    {
+        qInfo().noquote() << QString("Data export: %1 readings to %2 (%3 KiB), in %4 ms")
+                                 .arg(rows).arg(m_path).arg(QFileInfo(m_path).size() / 1024).arg(timer.elapsed());
+    }
+    else
+    {
+        if (m_cancel) qInfo() << "Data export canceled";
+        if (opened) m_file.remove();
+    }
+
+    Q_EMIT finished(status, m_path, rows);
+}
+
+/* ************************************************************************** */
+
+QString DatabaseExport::cursorKey(const QString &deviceAddr, DeviceReading::ReadingTable table)
+{
+    // Whatever the sensorData layout
+    return deviceAddr + "/" + ((table == DeviceReading::TABLE_PLANTDATA) ? "plantData" : "sensorData");
+}
+
+qint64 DatabaseExport::deviceFrom(const QString &deviceAddr, DeviceReading::ReadingTable table) const
+{
+    QString key = cursorKey(deviceAddr, table);
+
+    auto c = m_cursors.constFind(key);
+    if (c == m_cursors.constEnd()) return m_options.tsFrom;
+
+    // Back over the late window, but only as far as the manifest knows what was exported
+    qint64 from = qMax(c.value() + 1 - EXPORT_LATE_WINDOW, m_since.value(key, c.value() + 1));
+    return qMax(m_options.tsFrom, from);
+}
+
+bool DatabaseExport::loadManifest()
+{
+    QFile file(m_options.manifest);
+    if (!file.exists()) return true; // first incremental export
+
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    if (!doc.isObject()) return false;
+    m_manifest = doc.object();
+
+    const QJsonObject devices = m_manifest.value("devices").toObject();
+    for (auto d = devices.constBegin(); d != devices.constEnd(); ++d)
+    {
+        const QJsonObject tables = d.value().toObject();
+        for (auto t = tables.constBegin(); t != tables.constEnd(); ++t)
+        {
+            QString key = d.key() + "/" + t.key();
+
+            if (t.value().isObject())
+            {
+                const QJsonObject cursor = t.value().toObject();
+                m_cursors.insert(key, cursor.value("cursor").toVariant().toLongLong());
+                m_since.insert(key, cursor.value("since").toVariant().toLongLong());
+
+                QSet <qint64> &window = m_window[key];
+                const QJsonArray ts = cursor.value("window").toArray();
+                for (const auto &v: ts) window.insert(v.toVariant().toLongLong());
+            }
+            else
+            {
+                // Version 1: just the cursor, nothing known before it
+                m_cursors.insert(key, t.value().toVariant().toLongLong());
+            }
+        }
+    }
+
+    return true;
+}
+
+bool DatabaseExport::saveManifest(qint64 rows)
+{
+    QSet <QString> keys;
+    for (auto c = m_cursors.constBegin(); c != m_cursors.constEnd(); ++c) keys.insert(c.key());
+    for (auto m = m_marks.constBegin(); m != m_marks.constEnd(); ++m) keys.insert(m.key());
+
+    QJsonObject devices = m_manifest.value("devices").toObject();
+    for (const auto &key: qAsConst(keys))
+    {
+        // Rows are in ts order, but the late ones come before the previous cursor
+        qint64 cursor = qMax(m_cursors.value(key, -1), m_marks.value(key, -1));
+        qint64 windowFrom = cursor + 1 - EXPORT_LATE_WINDOW;
+        qint64 since = m_since.value(key, m_cursors.contains(key) ? m_cursors.value(key) + 1 : m_options.tsFrom);
+
+        QJsonArray window;
+        const QSet <qint64> exported = m_window.value(key) + m_exported.value(key);
+        for (qint64 ts: exported)
+        {
+            if (ts >= windowFrom) window.append(double(ts));
+        }
+
+        QJsonObject c;
+        c.insert("cursor", double(cursor));
+        c.insert("since", double(qMax(since, windowFrom)));
+        c.insert("window", window);
+
+        QString deviceAddr = key.section('/', 0, 0);
+        QJsonObject tables = devices.value(deviceAddr).toObject();
+        tables.insert(key.section('/', 1), c);
+        devices.insert(deviceAddr, tables);
+    }
+
+    QJsonObject file;
+    file.insert("file", QFileInfo(m_path).fileName());
+    file.insert("created", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    file.insert("format", m_options.fileExtension());
+    file.insert("rows", double(rows));
+    file.insert("bytes", double(QFileInfo(m_path).size()));
+
+    QJsonArray files = m_manifest.value("files").toArray();
+    files.append(file);
+
+    m_manifest.insert("version", 2);
+    m_manifest.insert("devices", devices);
+    m_manifest.insert("files", files);
+
+    // Written aside then renamed, a crash leaves the previous manifest intact
+    QSaveFile out(m_options.manifest);
+    if (!out.open(QIODevice::WriteOnly) || out.write(QJsonDocument(m_manifest).toJson()) < 0 || !out.commit())
+    {
+        qWarning() << "DatabaseExport cannot write manifest:" << m_options.manifest << out.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+/* ************************************************************************** */
+
+bool DatabaseExport::exportTable(const ExportDevice &device, DeviceReading::ReadingTable table,
+                                 const QString &partition, qint64 &rows)
+{
+    if (device.deviceId < 0) return true;
+
+    const auto tableColumns = DatabaseWriter::columns(table);
+    bool narrow = DatabasePartitions::isNarrow(partition);
+
+    QString select;
+    if (narrow)
+    {
+        select = "SELECT ts, metric, value FROM " + partition;
+    }
+    else
+    {
+        QStringList cols;
+        cols << "ts";
+        // Actual time of the plant readings, not the rounded one
+        if (table == DeviceReading::TABLE_PLANTDATA) cols << "coalesce(ts_full, ts)";
+        for (const auto &c: tableColumns) cols << c.second;
+
+        select = "SELECT " + cols.join(", ") + " FROM " + partition;
+    }
+
+    // Forward only, so the driver doesn't keep the rows we already went through
+    QSqlQuery data(DatabaseManager::getInstance()->getReadDatabase());
+    data.setForwardOnly(true);
+    data.prepare(select + " WHERE deviceId = :deviceId AND ts >= :ts ORDER BY ts");
+    data.bindValue(":deviceId", device.deviceId);
+    data.bindValue(":ts", deviceFrom(device.deviceAddr, table));
+    if (data.exec() == false)
+    {
+        qWarning() << "> export.exec() ERROR" << data.lastError().type() << ":" << data.lastError().text();
+        m_failed = true;
+        return false;
+    }
+
+    // Device fields, the same on every row
+    QByteArray prefix;
+    if (m_options.format == ExportOptions::FORMAT_JSONL)
+        prefix = "\"deviceAddr\":" + jsonString(device.deviceAddr) + ",\"deviceName\":" + jsonString(device.deviceName);
+    else
+        prefix = "," + csvField(device.deviceAddr) + "," + csvField(device.deviceName);
+
+    QVariantList values;
+    for (int i = 0; i < m_columns.size(); i++) values += QVariant();
+
+    // Late window: what an earlier run already exported is skipped
+    const QString key = cursorKey(device.deviceAddr, table);
+    const qint64 cursor = m_cursors.value(key, -1);
+    const QSet <qint64> window = m_window.value(key);
+    QSet <qint64> &exported = m_exported[key];
+
+    qint64 count = 0;
+    qint64 n = 0;
+    qint64 mark = -1;
+    if (narrow)
+    {
+        // One row per metric, back to one line per reading
+        qint64 current = -1;
+        while (data.next())
+        {
+            qint64 ts = data.value(0).toLongLong();
+            if (ts <= cursor && window.contains(ts)) continue;
+
+            if (ts != current)
+            {
+                if (current >= 0)
+                {
+                    writeRow(prefix, current, values);
+                    exported.insert(current);
+                    for (auto &v: values) v = QVariant();
+                    count++;
+                }
+                current = ts;
+            }
+
+            mark = ts;
+
+            auto idx = m_metricIndex.constFind(data.value(1).toUInt());
+            if (idx != m_metricIndex.constEnd()) values[idx.value()] = data.value(2);
+
+            if ((++n % EXPORT_CANCEL_ROWS) == 0 && m_cancel) return false;
+        }
+        if (current >= 0)
+        {
+            writeRow(prefix, current, values);
+            exported.insert(current);
+            count++;
+        }
+    }
+    else
+    {
+        QVector <int> idx;
+        for (const auto &c: tableColumns) idx += m_columnIndex.value(c.second);
+        int first = (table == DeviceReading::TABLE_PLANTDATA) ? 2 : 1;
+
+        while (data.next())
+        {
+            qint64 ts = data.value(0).toLongLong();
+            if (ts <= cursor && window.contains(ts)) continue;
+
+            for (auto &v: values) v = QVariant();
+            for (int i = 0; i < idx.size(); i++) values[idx.at(i)] = data.value(i + first);
+
+            writeRow(prefix, data.value(first - 1).toLongLong(), values);
+            exported.insert(ts);
+            mark = ts;
+            count++;
+
+            if ((++n % EXPORT_CANCEL_ROWS) == 0 && m_cancel) return false;
+        }
+    }
+
+    // Rows are in ts order, and partitions oldest first
+    if (mark > m_marks.value(key, -1)) m_marks.insert(key, mark);
+
+    rows += count;
+    return !m_failed;
+}
+
+void DatabaseExport::writeRow(const QByteArray &device, qint64 ts, const QVariantList &values)
+{
+    if (m_options.format == ExportOptions::FORMAT_JSONL)
+    {
+        m_buffer += "{\"ts\":" + QByteArray::number(ts) +
+                    ",\"time\":\"" + QDateTime::fromSecsSinceEpoch(ts, Qt::UTC).toString(Qt::ISODate).toLatin1() + "\"," + device;
+    }
+    else
+    {
+        m_buffer += QDateTime::fromSecsSinceEpoch(ts).toString("yyyy-MM-dd hh:mm:ss").toLatin1() + device;
+    }
+
+    for (int i = 0; i < values.size(); i++)
+    {
+        const QVariant &v = values.at(i);
+
+        QByteArray value;
+        if (!v.isNull())
+        {
+            if (m_temperature.at(i) && m_options.fahrenheit)
+                value = QByteArray::number(v.toDouble() * 1.8 + 32.0, 'g', 6);
+            else if (v.type() == QVariant::LongLong || v.type() == QVariant::Int)
+                value = QByteArray::number(v.toLongLong());
+            else
+                value = QByteArray::number(v.toDouble(), 'g', 6);
+        }
+
+        if (m_options.format == ExportOptions::FORMAT_JSONL)
+        {
+            if (!value.isEmpty()) m_buffer += ",\"" + m_columns.at(i).toLatin1() + "\":" + value;
+        }
+        else
+        {
+            m_buffer += "," + value;
+        }
+    }
+
+    m_buffer += (m_options.format == ExportOptions::FORMAT_JSONL) ? "}\n" : "\n";
+
+    if (m_buffer.size() >= EXPORT_BUFFER_SIZE) writeBuffer();
+}
+
+bool DatabaseExport::writeBuffer()
+{
+    if (m_buffer.isEmpty()) return !m_failed;
+
+    const QByteArray out = m_options.gzip ? gzip(m_buffer) : m_buffer;
+    if (m_file.write(out) != out.size())
+    {
+        qWarning() << "DatabaseExport write ERROR" << m_file.errorString();
+        m_failed = true;
+    }
+    m_buffer.resize(0);
+
+    return !m_failed;
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,151 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DATABASE_EXPORT_H
+#define DATABASE_EXPORT_H
+/* ************************************************************************** */
+
+#include "device_reading.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QFile>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QSqlQuery>
+
+#include <atomic>
+
+#define EXPORT_BUFFER_SIZE      (1024*1024) // bytes, written (and compressed) at once
+#define EXPORT_CANCEL_ROWS      4096        // rows between two cancellation checks
+#define EXPORT_LATE_WINDOW      (3*24*3600) // s before an incremental cursor, scanned again for late readings
+
+/* ************************************************************************** */
+
+//! A device to export, resolved on the GUI thread
+struct ExportDevice
+{
+    QString deviceAddr;
+    QString deviceName;
+    int deviceId = -1;
+};
+
+struct ExportOptions
+{
+    enum ExportFormat {
+        FORMAT_CSV          = 0,    //!< One header line, one line per reading
+        FORMAT_JSONL        = 1,    //!< JSON Lines, one object per reading
+    };
+
+    int format = FORMAT_CSV;
+    bool gzip = false;
+    qint64 tsFrom = 0;              //!< UTC epoch (seconds), readings before that are left out
+    bool fahrenheit = false;        //!< Temperatures in the user's unit
+
+    //! Incremental export: the cursors are read from and saved to that manifest
+    QString manifest;
+
+    //! "csv", "jsonl", "csv.gz"...
+    QString fileExtension() const;
+};
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseExport class
+ *
+ * Streams the raw readings of a set of devices (plant and environmental data)
+ * to a CSV or JSON Lines file, optionally gzipped. Runs on a worker thread,
+ * reading through a forward only cursor on the read pool connection, and
+ * writing through a large buffer, so nothing is ever held in memory besides
+ * that buffer.
+ *
+ * Both tables are exported to the same columns, a reading only fills the
+ * ones its table has. Gzip output is a series of gzip members, one per
+ * buffer, which every gzip reader handles as a single stream.
+ *
+ * Incremental exports keep a JSON manifest next to their (dated) delta files.
+ * It lists these files, and for each device and table the last exported
+ * timestamp (the rounded 'ts' of the data tables), so each delta file only
+ * gets what came after it. A reading can be written after newer ones (a late
+ * history sync), so the EXPORT_LATE_WINDOW before the cursor is scanned again
+ * on each run, and the manifest also keeps the timestamps already exported in
+ * that window, which are skipped. Readings later than that are missed.
+ */
+class DatabaseExport: public QObject
+{
+    Q_OBJECT
+
+    QList <ExportDevice> m_devices;
+    ExportOptions m_options;
+    QString m_path;
+    std::atomic <bool> m_cancel;
+
+    QFile m_file;
+    QByteArray m_buffer;
+    bool m_failed = false;
+    bool writeBuffer();
+
+    QStringList m_columns;              //!< Output columns, after the timestamp and device ones
+    QHash <QString, int> m_columnIndex;
+    QHash <quint32, int> m_metricIndex; //!< sensorValues metric > output column
+    QList <bool> m_temperature;         //!< Output columns converted to the user's unit
+
+    QJsonObject m_manifest;
+    QHash <QString, qint64> m_cursors;  //!< deviceAddr/table > last exported ts, from the manifest
+    QHash <QString, qint64> m_since;    //!< deviceAddr/table > start of the known part of the late window
+    QHash <QString, QSet <qint64>> m_window;     //!< deviceAddr/table > ts exported in the late window, from the manifest
+    QHash <QString, qint64> m_marks;    //!< deviceAddr/table > last exported ts, this time
+    QHash <QString, QSet <qint64>> m_exported;  //!< deviceAddr/table > ts exported, this time
+    static QString cursorKey(const QString &deviceAddr, DeviceReading::ReadingTable table);
+    qint64 deviceFrom(const QString &deviceAddr, DeviceReading::ReadingTable table) const;
+    bool loadManifest();
+    bool saveManifest(qint64 rows);
+
+    bool exportTable(const ExportDevice &device, DeviceReading::ReadingTable table,
+                     const QString &partition, qint64 &rows);
+    void writeRow(const QByteArray &device, qint64 ts, const QVariantList &values);
+
+public:
+    DatabaseExport(const QList <ExportDevice> &devices, const ExportOptions &options,
+                   const QString &path, QObject *parent = nullptr);
+    ~DatabaseExport() = default;
+
+    //! Thread safe, the export stops (and its file is removed) as soon as possible
+    void cancel() { m_cancel = true; }
+
+    //! One gzip member, for an in memory block
+    static QByteArray gzip(const QByteArray &data);
+
+public slots:
+    void run();
+
+Q_SIGNALS:
+    void progress(float progress);
+    void finished(bool status, const QString &path, qint64 rows);
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_EXPORT_H
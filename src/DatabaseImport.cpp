@@ -0,0 +1,425 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseImport.h"
+#include "DatabaseManager.h"
+#include "DatabaseWriter.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+/* ************************************************************************** */
+
+int ImportOptions::formatFromPath(const QString &path)
+{
+    if (path.endsWith(".jsonl", Qt::CaseInsensitive) ||
+        path.endsWith(".ndjson", Qt::CaseInsensitive) ||
+        path.endsWith(".json", Qt::CaseInsensitive)) return FORMAT_JSONL;
+
+    return FORMAT_CSV;
+}
+
+/* ************************************************************************** */
+
+static QList <QByteArray> csvSplit(const QByteArray &line)
+{
+    QList <QByteArray> fields;
+    QByteArray f;
+    bool quoted = false;
+
+    for (int i = 0; i < line.size(); i++)
+    {
+        char c = line.at(i);
+        if (quoted)
+        {
+            if (c != '"') f += c;
+            else if (i+1 < line.size() && line.at(i+1) == '"') f += line.at(++i); // escaped quote
+            else quoted = false;
+        }
+        else if (c == '"') quoted = true;
+        else if (c == ',') { fields += f; f.clear(); }
+        else f += c;
+    }
+    fields += f;
+
+    return fields;
+}
+
+static const char *timeFields[] = { "timestamp", "ts", "time", "date" };
+static const char *addrFields[] = { "deviceAddr", "address", "mac" };
+
+/* ************************************************************************** */
+
+DatabaseImport::DatabaseImport(const QList <ImportDevice> &devices, const ImportOptions &options,
+                               const QString &path, QObject *parent) : QObject(parent)
+{
+    for (const auto &d: devices) m_devices.insert(d.deviceAddr.toUpper(), d);
+    m_options = options;
+    m_path = path;
+    m_cancel = false;
+}
+
+/* ************************************************************************** */
+
+qint64 DatabaseImport::parseTime(const QString &time)
+{
+    bool ok = false;
+    qint64 ts = time.trimmed().toLongLong(&ok);
+    if (ok) return (ts > 100000000000LL) ? (ts / 1000) : ts; // milliseconds
+
+    double d = time.trimmed().toDouble(&ok);
+    if (ok) return qint64(d);
+
+    // Our CSV exports (local time), then ISO 8601 (with an offset, or local time)
+    QDateTime dt = QDateTime::fromString(time.trimmed(), "yyyy-MM-dd hh:mm:ss");
+    if (!dt.isValid()) dt = QDateTime::fromString(time.trimmed(), Qt::ISODate);
+    if (!dt.isValid()) return -1;
+
+    return dt.toSecsSinceEpoch();
+}
+
+bool DatabaseImport::validValue(quint32 metric, double value)
+{
+    if (!std::isfinite(value)) return false;
+
+    switch (metric)
+    {
+    case DeviceUtils::SENSOR_TEMPERATURE:
+    case DeviceUtils::SENSOR_SOIL_TEMPERATURE:
+        return (value > -80.0 && value < 100.0); // ℃
+    case DeviceUtils::SENSOR_HUMIDITY:
+    case DeviceUtils::SENSOR_SOIL_MOISTURE:
+        return (value >= 0.0 && value <= 100.0); // %
+    case DeviceUtils::SENSOR_SOIL_PH:
+        return (value >= 0.0 && value <= 14.0);
+    case DeviceUtils::SENSOR_WIND_DIRECTION:
+        return (value >= 0.0 && value <= 360.0); // °
+    default:
+        return (value >= 0.0);
+    }
+}
+
+int DatabaseImport::column(const QString &name, int unit)
+{
+    const QString key = name.toLower() + "/" + QString::number(unit);
+
+    auto it = m_columnIndex.constFind(key);
+    if (it != m_columnIndex.constEnd()) return it.value();
+
+    ImportColumn c;
+    bool found = false;
+
+    const DeviceReading::ReadingTable tables[] = { DeviceReading::TABLE_PLANTDATA, DeviceReading::TABLE_SENSORDATA };
+    for (auto table: tables)
+    {
+        const auto cols = DatabaseWriter::columns(table);
+        for (const auto &col: cols)
+        {
+            if (col.second.compare(name, Qt::CaseInsensitive) == 0)
+            {
+                c.metric[table] = col.first;
+                c.temperature = (col.first == DeviceUtils::SENSOR_TEMPERATURE || col.first == DeviceUtils::SENSOR_SOIL_TEMPERATURE);
+                found = true;
+            }
+        }
+    }
+
+    // Unknown columns are cached too, as ignored
+    int index = -1;
+    if (found)
+    {
+        c.fahrenheit = (unit == UNIT_FAHRENHEIT) || (unit == UNIT_DEFAULT && m_options.fahrenheit);
+        index = m_columns.size();
+        m_columns += c;
+    }
+    m_columnIndex.insert(key, index);
+
+    return index;
+}
+
+/* ************************************************************************** */
+
+void DatabaseImport::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    bool status = false;
+    m_tsMax = QDateTime::currentSecsSinceEpoch() + IMPORT_TS_AHEAD;
+
+    m_file.setFileName(m_path);
+    if (m_file.open(QIODevice::ReadOnly))
+    {
+        float size = float(qMax(m_file.size(), qint64(1)));
+        bool header = (m_options.format == ImportOptions::FORMAT_CSV);
+
+        QByteArray line;
+        while (!m_cancel && !m_failed && readLine(line))
+        {
+            if (line.trimmed().isEmpty()) continue;
+
+            if (header)
+            {
+                header = false;
+                if (!readHeader(line))
+                {
+                    qWarning() << "DatabaseImport: the CSV header needs a timestamp and a deviceAddr column";
+                    m_failed = true;
+                }
+                continue;
+            }
+
+            if (m_options.format == ImportOptions::FORMAT_JSONL)
+                parseJson(line);
+            else
+                parseCsv(line);
+
+            if (m_batch.size() >= IMPORT_BATCH_SIZE)
+            {
+                writeBatch();
+                Q_EMIT progress(m_file.pos() / size);
+            }
+        }
+
+        if (!m_cancel && !m_failed) writeBatch();
+        status = (!m_cancel && !m_failed);
+
+        m_file.close();
+    }
+    else
+    {
+        qWarning() << "DatabaseImport cannot open import file:" << m_path;
+    }
+
+    if (status)
+    {
+        qInfo().noquote() << QString("Data import: %1 readings from %2 (%3 lines rejected), in %4 ms")
+                                 .arg(m_imported).arg(m_path).arg(m_rejected).arg(timer.elapsed());
+    }
+    else if (m_cancel)
+    {
+        qInfo() << "Data import canceled";
+    }
+
+    Q_EMIT finished(status, m_imported, m_rejected);
+}
+
+/* ************************************************************************** */
+
+bool DatabaseImport::readLine(QByteArray &line)
+{
+    if (m_file.atEnd()) return false;
+
+    line = m_file.readLine();
+    m_line++;
+
+    // A quoted CSV field may span several lines
+    if (m_options.format == ImportOptions::FORMAT_CSV)
+    {
+        while ((line.count('"') % 2) && !m_file.atEnd())
+        {
+            line += m_file.readLine();
+            m_line++;
+        }
+    }
+
+    while (line.endsWith('\n') || line.endsWith('\r')) line.chop(1);
+
+    return true;
+}
+
+bool DatabaseImport::readHeader(const QByteArray &line)
+{
+    const QList <QByteArray> fields = csvSplit(line);
+    m_fieldColumns.fill(-1, fields.size());
+
+    for (int i = 0; i < fields.size(); i++)
+    {
+        QString name = QString::fromUtf8(fields.at(i)).remove(QChar(0xFEFF)).trimmed(); // BOM
+
+        // "temperature (℉)"
+        int unit = UNIT_DEFAULT;
+        int p = name.indexOf('(');
+        if (p > 0)
+        {
+            QString u = name.mid(p + 1).remove(')').trimmed();
+            if (u == "℉" || u == "°F" || u == "F") unit = UNIT_FAHRENHEIT;
+            else if (u == "℃" || u == "°C" || u == "C") unit = UNIT_CELSIUS;
+            name = name.left(p).trimmed();
+        }
+
+        bool known = false;
+        for (const char *f: timeFields)
+        {
+            if (m_timeField < 0 && name.compare(f, Qt::CaseInsensitive) == 0) { m_timeField = i; known = true; }
+        }
+        for (const char *f: addrFields)
+        {
+            if (m_addrField < 0 && name.compare(f, Qt::CaseInsensitive) == 0) { m_addrField = i; known = true; }
+        }
+
+        if (!known) m_fieldColumns[i] = column(name, unit);
+    }
+
+    return (m_timeField >= 0 && m_addrField >= 0);
+}
+
+void DatabaseImport::parseCsv(const QByteArray &line)
+{
+    const QList <QByteArray> fields = csvSplit(line);
+    if (fields.size() <= qMax(m_timeField, m_addrField))
+    {
+        reject("missing fields");
+        return;
+    }
+
+    m_values.clear();
+    for (int i = 0; i < fields.size() && i < m_fieldColumns.size(); i++)
+    {
+        if (m_fieldColumns.at(i) < 0 || fields.at(i).isEmpty()) continue;
+
+        bool ok = false;
+        double v = fields.at(i).trimmed().toDouble(&ok);
+        if (ok) m_values += qMakePair(m_fieldColumns.at(i), v);
+    }
+
+    addRecord(QString::fromUtf8(fields.at(m_addrField)), QString::fromUtf8(fields.at(m_timeField)));
+}
+
+void DatabaseImport::parseJson(const QByteArray &line)
+{
+    QJsonParseError error;
+    const QJsonObject obj = QJsonDocument::fromJson(line, &error).object();
+    if (error.error != QJsonParseError::NoError || obj.isEmpty())
+    {
+        reject("invalid JSON");
+        return;
+    }
+
+    QJsonValue time;
+    for (const char *f: timeFields)
+    {
+        if (time.isUndefined()) time = obj.value(f);
+    }
+    QJsonValue addr;
+    for (const char *f: addrFields)
+    {
+        if (addr.isUndefined()) addr = obj.value(f);
+    }
+
+    m_values.clear();
+    for (auto it = obj.constBegin(); it != obj.constEnd(); ++it)
+    {
+        if (!it.value().isDouble()) continue;
+
+        int c = column(it.key(), UNIT_DEFAULT);
+        if (c >= 0) m_values += qMakePair(c, it.value().toDouble());
+    }
+
+    addRecord(addr.toString(), time.isDouble() ? QString::number(qint64(time.toDouble())) : time.toString());
+}
+
+/* ************************************************************************** */
+
+void DatabaseImport::addRecord(const QString &deviceAddr, const QString &time)
+{
+    auto d = m_devices.constFind(deviceAddr.trimmed().toUpper());
+    if (d == m_devices.constEnd())
+    {
+        // Only one warning per address
+        if (!m_unknownDevices.contains(deviceAddr))
+        {
+            m_unknownDevices.insert(deviceAddr);
+            qWarning() << "DatabaseImport: unknown device" << deviceAddr;
+        }
+        m_rejected++;
+        return;
+    }
+
+    qint64 ts = parseTime(time);
+    if (ts < IMPORT_TS_MIN || ts > m_tsMax)
+    {
+        reject("invalid timestamp " + time);
+        return;
+    }
+
+    // Local time, like the live readings (see DeviceReading::roundedTimestamp())
+    DeviceReading r(static_cast<DeviceReading::ReadingTable>(d->table), d->deviceAddr,
+                    QDateTime::fromSecsSinceEpoch(ts), d->interval);
+
+    for (const auto &v: qAsConst(m_values))
+    {
+        const ImportColumn &c = m_columns.at(v.first);
+        quint32 metric = c.metric[d->table];
+        if (!metric) continue;
+
+        double value = v.second;
+        if (c.temperature && c.fahrenheit) value = (value - 32.0) / 1.8;
+
+        if (validValue(metric, value)) r.set(metric, float(value));
+    }
+
+    if (!r.metrics)
+    {
+        reject("no valid value");
+        return;
+    }
+
+    m_batch += r;
+    m_imported++;
+}
+
+void DatabaseImport::reject(const QString &reason)
+{
+    m_rejected++;
+
+    if (m_rejected <= IMPORT_WARNINGS)
+        qWarning() << "DatabaseImport: line" << m_line << "rejected:" << reason;
+}
+
+bool DatabaseImport::writeBatch()
+{
+    if (m_batch.isEmpty()) return true;
+
+    // Primary key order, so the rows of a device end up next to each other
+    std::sort(m_batch.begin(), m_batch.end(), [](const DeviceReading &a, const DeviceReading &b) {
+        if (a.table != b.table) return a.table < b.table;
+        if (a.deviceAddr != b.deviceAddr) return a.deviceAddr < b.deviceAddr;
+        return a.timestamp < b.timestamp;
+    });
+
+    if (!DatabaseManager::getInstance()->importReadings(m_batch))
+    {
+        qWarning() << "DatabaseImport cannot write to the database";
+        m_failed = true;
+    }
+    m_batch.clear();
+
+    return !m_failed;
+}
+
+/* ************************************************************************** */
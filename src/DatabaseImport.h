@@ -0,0 +1,160 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DATABASE_IMPORT_H
+#define DATABASE_IMPORT_H
+/* ************************************************************************** */
+
+#include "device_reading.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QPair>
+#include <QHash>
+#include <QSet>
+#include <QFile>
+#include <QByteArray>
+
+#include <atomic>
+
+#define IMPORT_BATCH_SIZE       5000        // readings per transaction
+#define IMPORT_TS_MIN           946684800   // 2000-01-01, anything older is a broken timestamp
+#define IMPORT_TS_AHEAD         86400       // s, readings further in the future are rejected
+#define IMPORT_WARNINGS         10          // rejected lines logged, the others are only counted
+
+/* ************************************************************************** */
+
+//! A device readings can be imported to, resolved on the GUI thread
+struct ImportDevice
+{
+    QString deviceAddr;
+    int table = DeviceReading::TABLE_PLANTDATA;
+    int interval = 3600;            //!< Readings are rounded like the live ones
+};
+
+struct ImportOptions
+{
+    enum ImportFormat {
+        FORMAT_CSV          = 0,    //!< One header line, one line per reading
+        FORMAT_JSONL        = 1,    //!< JSON Lines, one object per reading
+    };
+
+    int format = FORMAT_CSV;
+    bool fahrenheit = false;        //!< Unit of the temperatures that don't say
+
+    //! From the file extension, CSV if unsure
+    static int formatFromPath(const QString &path);
+};
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseImport class
+ *
+ * Bulk import of historical readings, from CSV or JSON Lines files: our own
+ * exports (see DatabaseExport), or anything using the same column names.
+ * Runs on a worker thread, reading the file line by line.
+ *
+ * Each line needs a timestamp (UTC epoch in seconds or milliseconds, ISO 8601,
+ * or local "yyyy-MM-dd hh:mm:ss"), the address of a known device, and at least
+ * one valid value. Temperature columns can state their unit in the CSV header
+ * ("temperature (℉)"). Lines that don't pass are counted and skipped.
+ *
+ * Readings go through the DatabaseWriter (so partitions, rollups and latest
+ * values are handled like the live ones) in large transactions, sorted in
+ * primary key order. Committed batches stay committed if the import fails or
+ * is cancelled, importing the same file again just replaces them.
+ */
+class DatabaseImport: public QObject
+{
+    Q_OBJECT
+
+    enum TemperatureUnit {
+        UNIT_DEFAULT        = 0,    //!< ImportOptions::fahrenheit
+        UNIT_CELSIUS        = 1,
+        UNIT_FAHRENHEIT     = 2,
+    };
+
+    struct ImportColumn
+    {
+        quint32 metric[2] = { 0, 0 };   //!< For each DeviceReading::ReadingTable (0 if the table doesn't have it)
+        bool temperature = false;
+        bool fahrenheit = false;
+    };
+
+    QHash <QString, ImportDevice> m_devices;    //!< Upper case address > device
+    ImportOptions m_options;
+    QString m_path;
+    std::atomic <bool> m_cancel;
+
+    QFile m_file;
+    qint64 m_line = 0;
+    qint64 m_tsMax = 0;
+    bool m_failed = false;
+
+    QList <ImportColumn> m_columns;
+    QHash <QString, int> m_columnIndex;         //!< Lower case name > m_columns index
+    int column(const QString &name, int unit);
+
+    // CSV fields
+    int m_timeField = -1;
+    int m_addrField = -1;
+    QVector <int> m_fieldColumns;               //!< Field > m_columns index (-1 if ignored)
+    bool readHeader(const QByteArray &line);
+
+    QVector <QPair <int, double>> m_values;     //!< Current line, m_columns index > value
+    QList <DeviceReading> m_batch;
+    QSet <QString> m_unknownDevices;
+    qint64 m_imported = 0;
+    qint64 m_rejected = 0;
+
+    bool readLine(QByteArray &line);
+    void parseCsv(const QByteArray &line);
+    void parseJson(const QByteArray &line);
+    void addRecord(const QString &deviceAddr, const QString &time);
+    void reject(const QString &reason);
+    bool writeBatch();
+
+public:
+    DatabaseImport(const QList <ImportDevice> &devices, const ImportOptions &options,
+                   const QString &path, QObject *parent = nullptr);
+    ~DatabaseImport() = default;
+
+    //! Thread safe, the import stops after the current batch
+    void cancel() { m_cancel = true; }
+
+    //! UTC epoch (seconds) from any of the accepted formats, -1 if none
+    static qint64 parseTime(const QString &time);
+    static bool validValue(quint32 metric, double value);
+
+public slots:
+    void run();
+
+Q_SIGNALS:
+    void progress(float progress);
+    void finished(bool status, qint64 imported, qint64 rejected);
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_IMPORT_H
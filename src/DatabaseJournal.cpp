@@ -0,0 +1,182 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseJournal.h"
+
+#include <QtEndian>
+#include <QDebug>
+
+#include <cstring>
+
+#if defined(Q_OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/* ************************************************************************** */
+
+// Record layout (little endian):
+//   0  magic       u32
+//   4  table       u8
+//   5  reserved    u8
+//   6  interval    u16     seconds
+//   8  timestamp   i64     UTC epoch, milliseconds
+//  16  metrics     u32     DeviceUtils::DeviceSensors bitfield
+//  20  values      32 x f32
+// 148  deviceAddr  38 x char, zero padded
+// 186  reserved    u16
+// 188  checksum    u16     CRC-16 of the 188 first bytes
+// 190  reserved    u16
+
+#define RECORD_CHECKSUM_OFFSET  188
+
+DatabaseJournal::DatabaseJournal(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+}
+
+DatabaseJournal::~DatabaseJournal()
+{
+    if (m_file.isOpen())
+    {
+        sync(flush());
+        m_file.close();
+    }
+}
+
+/* ************************************************************************** */
+
+QByteArray DatabaseJournal::serialize(const DeviceReading &r)
+{
+    QByteArray record(JOURNAL_RECORD_SIZE, '\0');
+    uchar *d = reinterpret_cast<uchar *>(record.data());
+
+    qToLittleEndian<quint32>(JOURNAL_MAGIC, d + 0);
+    d[4] = static_cast<uchar>(r.table);
+    qToLittleEndian<quint16>(static_cast<quint16>(qBound(0, r.interval, 65535)), d + 6);
+    qToLittleEndian<qint64>(r.timestamp.toMSecsSinceEpoch(), d + 8);
+    qToLittleEndian<quint32>(r.metrics, d + 16);
+    for (int i = 0; i < 32; i++)
+    {
+        quint32 v;
+        std::memcpy(&v, &r.values[i], sizeof(v));
+        qToLittleEndian<quint32>(v, d + 20 + i*4);
+    }
+    QByteArray addr = r.deviceAddr.toLatin1().left(38);
+    std::memcpy(d + 148, addr.constData(), addr.size());
+
+    qToLittleEndian<quint16>(qChecksum(record.constData(), RECORD_CHECKSUM_OFFSET), d + RECORD_CHECKSUM_OFFSET);
+
+    return record;
+}
+
+bool DatabaseJournal::deserialize(const char *data, DeviceReading &r)
+{
+    const uchar *d = reinterpret_cast<const uchar *>(data);
+
+    if (qFromLittleEndian<quint32>(d + 0) != JOURNAL_MAGIC) return false;
+    if (qFromLittleEndian<quint16>(d + RECORD_CHECKSUM_OFFSET) != qChecksum(data, RECORD_CHECKSUM_OFFSET)) return false;
+
+    r.table = d[4];
+    r.interval = qFromLittleEndian<quint16>(d + 6);
+    r.timestamp = QDateTime::fromMSecsSinceEpoch(qFromLittleEndian<qint64>(d + 8));
+    r.metrics = qFromLittleEndian<quint32>(d + 16);
+    for (int i = 0; i < 32; i++)
+    {
+        quint32 v = qFromLittleEndian<quint32>(d + 20 + i*4);
+        std::memcpy(&r.values[i], &v, sizeof(v));
+    }
+    r.deviceAddr = QString::fromLatin1(data + 148, static_cast<int>(qstrnlen(data + 148, 38)));
+
+    return true;
+}
+
+/* ************************************************************************** */
+
+QList <DeviceReading> DatabaseJournal::open()
+{
+    QList <DeviceReading> readings;
+
+    if (m_file.exists() && m_file.open(QIODevice::ReadOnly))
+    {
+        qint64 records = m_file.size() / JOURNAL_RECORD_SIZE;
+        for (qint64 i = 0; i < records; i++)
+        {
+            QByteArray record = m_file.read(JOURNAL_RECORD_SIZE);
+            DeviceReading r;
+
+            if (record.size() != JOURNAL_RECORD_SIZE || !deserialize(record.constData(), r))
+            {
+                qWarning() << "DatabaseJournal: record" << i << "is corrupted, replay stops there";
+                break;
+            }
+
+            readings += r;
+        }
+        m_file.close();
+    }
+
+    if (m_file.open(QIODevice::ReadWrite | QIODevice::Append) == false)
+    {
+        qWarning() << "DatabaseJournal cannot open" << m_file.fileName() << ":" << m_file.errorString();
+        return readings;
+    }
+
+    // Cut the torn or corrupted tail (if any), new records go right after the valid ones
+    m_file.resize(readings.size() * JOURNAL_RECORD_SIZE);
+
+    return readings;
+}
+
+bool DatabaseJournal::append(const DeviceReading &r)
+{
+    if (!m_file.isOpen()) return false;
+
+    return (m_file.write(serialize(r)) == JOURNAL_RECORD_SIZE);
+}
+
+int DatabaseJournal::flush()
+{
+    if (!m_file.isOpen() || !m_file.flush()) return -1;
+
+    return m_file.handle();
+}
+
+bool DatabaseJournal::sync(int handle)
+{
+    if (handle < 0) return false;
+
+#if defined(Q_OS_WIN)
+    return (_commit(handle) == 0);
+#else
+    return (::fsync(handle) == 0);
+#endif
+}
+
+bool DatabaseJournal::clear()
+{
+    if (!m_file.isOpen()) return false;
+
+    return m_file.resize(0);
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,78 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+
+#ifndef DATABASE_JOURNAL_H
+#define DATABASE_JOURNAL_H
+/* ************************************************************************** */
+
+#include "device_reading.h"
+
+#include <QString>
+#include <QList>
+#include <QFile>
+
+#define JOURNAL_MAGIC           0x57464a31  // "WFJ1"
+#define JOURNAL_RECORD_SIZE     192         // bytes
+#define JOURNAL_SYNC_INTERVAL   1000        // ms between two group fsync
+#define JOURNAL_COMPACT_SIZE    (64*1024)   // bytes, compact as soon as the journal is that big
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseJournal class
+ *
+ * Append only file of fixed size reading records, each one with its checksum.
+ * Every queued reading is appended to it (a buffered write), the file is
+ * fsynced in groups, and truncated once the database holds everything it
+ * contains. After a crash, the valid records are replayed, the first torn or
+ * corrupted record ends the replay.
+ *
+ * Not thread safe, the DatabaseWriter serializes the calls.
+ */
+class DatabaseJournal
+{
+    QFile m_file;
+
+    static QByteArray serialize(const DeviceReading &r);
+    static bool deserialize(const char *data, DeviceReading &r);
+
+public:
+    DatabaseJournal(const QString &fileName);
+    ~DatabaseJournal();
+
+    //! Read back what's in the journal, then open it for writing
+    QList <DeviceReading> open();
+
+    bool append(const DeviceReading &r);
+
+    //! Push the buffered records to the OS, returns the handle to sync (-1 on error)
+    int flush();
+    static bool sync(int handle);
+
+    //! Everything in the journal is in the database now
+    bool clear();
+
+    qint64 size() const { return m_file.size(); }
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_JOURNAL_H
@@ -0,0 +1,293 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseMaintenance.h"
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QSettings>
+#include <QElapsedTimer>
+#include <QVersionNumber>
+#include <QDebug>
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+/* ************************************************************************** */
+
+DatabaseMaintenance::DatabaseMaintenance(const QString &connectionName, const QString &databaseFile, QObject *parent) : QObject(parent)
+{
+    m_connectionName = connectionName;
+    m_databaseFile = databaseFile;
+
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+    if (settings.status() == QSettings::NoError && settings.contains("database/lastMaintenance"))
+        m_lastRun = settings.value("database/lastMaintenance").toDateTime();
+
+    m_idleTimer = new QTimer(this);
+    m_idleTimer->setSingleShot(true);
+    connect(m_idleTimer, &QTimer::timeout, this, &DatabaseMaintenance::idleTimeout);
+
+    m_stepTimer = new QTimer(this);
+    m_stepTimer->setSingleShot(true);
+    connect(m_stepTimer, &QTimer::timeout, this, &DatabaseMaintenance::step);
+}
+
+DatabaseMaintenance::~DatabaseMaintenance()
+{
+    //
+}
+
+/* ************************************************************************** */
+
+void DatabaseMaintenance::setIdle(bool idle)
+{
+    if (m_idle == idle) return;
+    m_idle = idle;
+
+    if (m_idle)
+    {
+        // Wait a bit, the devices are often refreshed one after another
+        m_idleTimer->start(MAINTENANCE_IDLE_DELAY * 1000);
+    }
+    else
+    {
+        // Pause, the current run (if any) will resume on the next idle period
+        m_idleTimer->stop();
+        m_stepTimer->stop();
+    }
+}
+
+void DatabaseMaintenance::idleTimeout()
+{
+    if (!m_idle) return;
+
+    if (m_step != STEP_DONE)
+    {
+        // Resume
+        m_stepTimer->start(0);
+    }
+    else if (!m_lastRun.isValid() || m_lastRun.secsTo(QDateTime::currentDateTime()) >= MAINTENANCE_INTERVAL)
+    {
+        startRun();
+    }
+    else
+    {
+        // Check again later
+        m_idleTimer->start((MAINTENANCE_INTERVAL - m_lastRun.secsTo(QDateTime::currentDateTime())) * 1000);
+    }
+}
+
+/* ************************************************************************** */
+
+qint64 DatabaseMaintenance::databaseSize() const
+{
+    return QFileInfo(m_databaseFile).size() + QFileInfo(m_databaseFile + "-wal").size();
+}
+
+void DatabaseMaintenance::startRun()
+{
+    qDebug() << "DatabaseMaintenance::startRun()";
+
+    m_sizeBefore = databaseSize();
+    m_timeSpent = 0;
+
+    // quick_check(table) needs SQLite 3.33, otherwise check everything at once
+    m_integrityTables.clear();
+    QSqlQuery version(QSqlDatabase::database(m_connectionName));
+    if (version.exec("SELECT sqlite_version()") && version.next() &&
+        QVersionNumber::fromString(version.value(0).toString()) >= QVersionNumber(3, 33))
+    {
+        QSqlQuery tables(QSqlDatabase::database(m_connectionName));
+        tables.exec("SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%'");
+        while (tables.next())
+        {
+            m_integrityTables += tables.value(0).toString();
+        }
+    }
+    else
+    {
+        m_integrityTables += QString();
+    }
+
+    m_step = STEP_AUTOVACUUM;
+    m_stepTimer->start(0);
+}
+
+void DatabaseMaintenance::finishRun()
+{
+    // Fold the WAL back into the database file, so the file size means something
+    QSqlQuery ckpt(QSqlDatabase::database(m_connectionName));
+    ckpt.exec("PRAGMA wal_checkpoint(TRUNCATE)");
+
+    qint64 sizeAfter = databaseSize();
+
+    qInfo().noquote() << QString("Database maintenance: %1 KiB > %2 KiB, in %3 ms")
+                             .arg(m_sizeBefore / 1024).arg(sizeAfter / 1024).arg(m_timeSpent);
+
+    m_step = STEP_DONE;
+    m_lastRun = QDateTime::currentDateTime();
+
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+    if (settings.status() == QSettings::NoError)
+        settings.setValue("database/lastMaintenance", m_lastRun);
+
+    if (m_idle) m_idleTimer->start(MAINTENANCE_INTERVAL * 1000);
+}
+
+void DatabaseMaintenance::step()
+{
+    if (!m_idle || m_step == STEP_DONE) return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    bool stepDone = true;
+    switch (m_step)
+    {
+    case STEP_AUTOVACUUM:
+        stepDone = stepAutoVacuum();
+        break;
+    case STEP_VACUUM:
+        stepDone = stepVacuum();
+        break;
+    case STEP_ANALYZE:
+        stepDone = stepAnalyze();
+        break;
+    case STEP_INTEGRITY:
+        stepDone = stepIntegrity();
+        break;
+    }
+
+    m_timeSpent += timer.elapsed();
+
+    if (stepDone) m_step++;
+
+    if (m_step == STEP_DONE)
+        finishRun();
+    else
+        m_stepTimer->start(MAINTENANCE_STEP_INTERVAL);
+}
+
+/* ************************************************************************** */
+
+bool DatabaseMaintenance::stepAutoVacuum()
+{
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+
+    QSqlQuery mode(db);
+    if (mode.exec("PRAGMA auto_vacuum") == false || !mode.next()) return true;
+
+    m_incremental = (mode.value(0).toInt() == 2);
+    if (m_incremental) return true;
+
+    // Databases created before we had maintenance use auto_vacuum = NONE,
+    // switching mode needs a full VACUUM, which can't be split in steps and
+    // blocks the writer until it's done: only on small databases, or on demand
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+    bool requested = settings.value("database/maintenanceFullVacuum", false).toBool();
+    if (databaseSize() > MAINTENANCE_FULL_VACUUM_SIZE && !requested)
+    {
+        qDebug() << "DatabaseMaintenance: auto_vacuum = NONE, set 'database/maintenanceFullVacuum' to switch";
+        return true;
+    }
+
+    qDebug() << "DatabaseMaintenance: switching to auto_vacuum = INCREMENTAL";
+
+    QSqlQuery setMode(db);
+    setMode.exec("PRAGMA auto_vacuum = INCREMENTAL");
+
+    QSqlQuery vacuum(db);
+    if (vacuum.exec("VACUUM") == false)
+    {
+        qWarning() << "> vacuum.exec() ERROR" << vacuum.lastError().type() << ":" << vacuum.lastError().text();
+        return true;
+    }
+
+    m_incremental = true;
+    if (requested) settings.remove("database/maintenanceFullVacuum");
+
+    return true;
+}
+
+bool DatabaseMaintenance::stepVacuum()
+{
+    // Does nothing without auto_vacuum = INCREMENTAL, and the free pages would never go away
+    if (!m_incremental) return true;
+
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+
+    QSqlQuery vacuum(db);
+    if (vacuum.exec("PRAGMA incremental_vacuum(" + QString::number(MAINTENANCE_VACUUM_PAGES) + ")") == false)
+    {
+        qWarning() << "> incremental_vacuum.exec() ERROR" << vacuum.lastError().type() << ":" << vacuum.lastError().text();
+        return true;
+    }
+    while (vacuum.next()) {}
+
+    QSqlQuery freePages(db);
+    if (freePages.exec("PRAGMA freelist_count") && freePages.next())
+        return (freePages.value(0).toInt() == 0);
+
+    return true;
+}
+
+bool DatabaseMaintenance::stepAnalyze()
+{
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+
+    // Limit the number of rows ANALYZE looks at, so it stays short on big tables
+    QSqlQuery limit(db);
+    limit.exec("PRAGMA analysis_limit = " + QString::number(MAINTENANCE_ANALYSIS_LIMIT));
+
+    QSqlQuery analyze(db);
+    if (analyze.exec("ANALYZE") == false)
+        qWarning() << "> analyze.exec() ERROR" << analyze.lastError().type() << ":" << analyze.lastError().text();
+
+    QSqlQuery optimize(db);
+    if (optimize.exec("PRAGMA optimize") == false)
+        qWarning() << "> optimize.exec() ERROR" << optimize.lastError().type() << ":" << optimize.lastError().text();
+
+    return true;
+}
+
+bool DatabaseMaintenance::stepIntegrity()
+{
+    if (m_integrityTables.isEmpty()) return true;
+
+    QString table = m_integrityTables.takeFirst();
+
+    QSqlQuery check(QSqlDatabase::database(m_connectionName));
+    if (check.exec(table.isEmpty() ? "PRAGMA quick_check" : "PRAGMA quick_check(" + table + ")") == false)
+        qWarning() << "> quick_check.exec() ERROR" << check.lastError().type() << ":" << check.lastError().text();
+
+    while (check.next())
+    {
+        QString result = check.value(0).toString();
+        if (result != "ok")
+            qWarning() << "> DatabaseMaintenance integrity:" << table << ":" << result;
+    }
+
+    return m_integrityTables.isEmpty();
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,97 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DATABASE_MAINTENANCE_H
+#define DATABASE_MAINTENANCE_H
+/* ************************************************************************** */
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QTimer>
+
+#define MAINTENANCE_IDLE_DELAY          30          // s without device activity before we start
+#define MAINTENANCE_INTERVAL            (24*3600)   // s between two runs
+#define MAINTENANCE_STEP_INTERVAL       100         // ms between two steps
+#define MAINTENANCE_VACUUM_PAGES        256         // pages released per step
+#define MAINTENANCE_ANALYSIS_LIMIT      1000        // rows looked at per index by ANALYZE
+#define MAINTENANCE_FULL_VACUUM_SIZE    (16*1024*1024) // bytes, bigger databases only switch to auto_vacuum on demand
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseMaintenance class
+ *
+ * SQLite housekeeping: incremental vacuum, statistics and integrity checks.
+ * Lives in the DatabaseWriter thread and uses its connection, so it never
+ * competes with the writes. A run is split into small steps, that only
+ * happen while the devices are idle, and is paused as soon as they are not.
+ */
+class DatabaseMaintenance: public QObject
+{
+    Q_OBJECT
+
+    enum MaintenanceStep {
+        STEP_AUTOVACUUM = 0,    //!< One time switch to auto_vacuum = INCREMENTAL (full VACUUM, small databases only)
+        STEP_VACUUM,            //!< PRAGMA incremental_vacuum, until there is no free page left (auto_vacuum = INCREMENTAL only)
+        STEP_ANALYZE,           //!< ANALYZE (bounded) then PRAGMA optimize
+        STEP_INTEGRITY,         //!< PRAGMA quick_check, one table per step
+        STEP_DONE
+    };
+
+    QString m_connectionName;
+    QString m_databaseFile;
+
+    bool m_idle = false;
+    QTimer *m_idleTimer = nullptr;
+    QTimer *m_stepTimer = nullptr;
+
+    int m_step = STEP_DONE;
+    QStringList m_integrityTables;
+    qint64 m_sizeBefore = 0;
+    qint64 m_timeSpent = 0;
+    QDateTime m_lastRun;
+    bool m_incremental = false;     //!< auto_vacuum = INCREMENTAL
+
+    qint64 databaseSize() const;
+
+    void startRun();
+    void finishRun();
+
+    bool stepAutoVacuum();
+    bool stepVacuum();
+    bool stepAnalyze();
+    bool stepIntegrity();
+
+private slots:
+    void idleTimeout();
+    void step();
+
+public:
+    DatabaseMaintenance(const QString &connectionName, const QString &databaseFile, QObject *parent = nullptr);
+    ~DatabaseMaintenance();
+
+    void setIdle(bool idle);
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_MAINTENANCE_H
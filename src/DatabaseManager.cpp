@@ -21,19 +21,28 @@
 
 #include "DatabaseManager.h"
 #include "SettingsManager.h"
-
+#include "DatabaseQueries.h"
+#include "DatabasePartitions.h"
+#include "DatabaseSeries.h"
+#include "DatabaseBackendSql.h"
+#include "DatabaseBackendMemory.h"
+#include "DatabaseBackup.h"
+
+#include <QCoreApplication>
 #include <QDir>
 #include <QFile>
 #include <QString>
 #include <QDateTime>
 #include <QStandardPaths>
+#include <QRegularExpression>
+#include <QSettings>
 #include <QDebug>
 
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlError>
 
-#define CURRENT_DB_VERSION 2
+#define CURRENT_DB_VERSION 6
 
 /* ************************************************************************** */
 
@@ -51,13 +60,528 @@ DatabaseManager *DatabaseManager::getInstance()
 
 DatabaseManager::DatabaseManager()
 {
-    openDatabase_sqlite();
-    //openDatabase_mysql();
+    int backend = loadBackendType();
+    if (backend == DatabaseBackend::BACKEND_MEMORY)
+        openDatabase_memory();
+    else if (backend == DatabaseBackend::BACKEND_MYSQL)
+        openDatabase_mysql();
+    else
+        openDatabase_sqlite();
+
+    // Make sure the queued readings are written before we exit
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &DatabaseManager::stopWriter);
+
+    // Periodic backups, if enabled ("database/backupInterval", in hours)
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+    int backupInterval = settings.value("database/backupInterval", 0).toInt();
+    if (backupInterval > 0)
+    {
+        bool compress = settings.value("database/backupCompress", true).toBool();
+
+        m_backupTimer = new QTimer(this);
+        connect(m_backupTimer, &QTimer::timeout, this, [this, compress]() { backupDatabase(compress); });
+        m_backupTimer->start(backupInterval * 3600 * 1000);
+    }
 }
 
 DatabaseManager::~DatabaseManager()
 {
-    //
+    stopWriter();
+    delete m_backend;
+}
+
+/* ************************************************************************** */
+
+SqliteProfile SqliteProfile::legacy()
+{
+    SqliteProfile p;
+    p.journalMode = "DELETE";
+    p.synchronous = "FULL";
+    p.mmapSize = 0;
+    p.cacheSize = 2000;
+    p.tempStore = "DEFAULT";
+    p.walAutoCheckpoint = 1000;
+    p.walCheckpointInterval = 0;
+    return p;
+}
+
+QStringList SqliteProfile::pragmas() const
+{
+    QStringList p;
+    p << "PRAGMA synchronous = " + synchronous;
+    p << "PRAGMA mmap_size = " + QString::number(mmapSize);
+    p << "PRAGMA cache_size = -" + QString::number(cacheSize); // negative means KiB
+    p << "PRAGMA temp_store = " + tempStore;
+    p << "PRAGMA busy_timeout = " + QString::number(busyTimeout);
+    if (journalMode.compare("WAL", Qt::CaseInsensitive) == 0)
+        p << "PRAGMA wal_autocheckpoint = " + QString::number(walAutoCheckpoint);
+    return p;
+}
+
+SqliteProfile SqliteProfile::fromSettings()
+{
+    SqliteProfile p;
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+
+    if (settings.status() == QSettings::NoError)
+    {
+        if (settings.contains("database/journalMode"))
+            p.journalMode = settings.value("database/journalMode").toString();
+        if (settings.contains("database/synchronous"))
+            p.synchronous = settings.value("database/synchronous").toString();
+        if (settings.contains("database/mmapSize"))
+            p.mmapSize = settings.value("database/mmapSize").toLongLong();
+        if (settings.contains("database/cacheSize"))
+            p.cacheSize = settings.value("database/cacheSize").toInt();
+        if (settings.contains("database/tempStore"))
+            p.tempStore = settings.value("database/tempStore").toString();
+        if (settings.contains("database/busyTimeout"))
+            p.busyTimeout = settings.value("database/busyTimeout").toInt();
+        if (settings.contains("database/walAutoCheckpoint"))
+            p.walAutoCheckpoint = settings.value("database/walAutoCheckpoint").toInt();
+        if (settings.contains("database/walCheckpointInterval"))
+            p.walCheckpointInterval = settings.value("database/walCheckpointInterval").toInt();
+    }
+
+    return p;
+}
+
+void DatabaseManager::loadSqliteProfile()
+{
+    m_sqliteProfile = SqliteProfile::fromSettings();
+}
+
+QString DatabaseManager::loadJournalFile(const QString &fileName) const
+{
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+
+    if (settings.status() == QSettings::NoError)
+    {
+        if (settings.contains("database/ingestJournal") && !settings.value("database/ingestJournal").toBool())
+            return QString();
+    }
+
+    QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    if (path.isEmpty() || !QDir().mkpath(path)) return QString();
+
+    return path + "/" + fileName;
+}
+
+int DatabaseManager::loadBackendType() const
+{
+    int backend = DatabaseBackend::BACKEND_SQLITE;
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+
+    if (settings.status() == QSettings::NoError)
+    {
+        QString name = settings.value("database/backend").toString();
+        if (name == "memory") backend = DatabaseBackend::BACKEND_MEMORY;
+        else if (name == "mysql") backend = DatabaseBackend::BACKEND_MYSQL;
+    }
+
+    return backend;
+}
+
+int DatabaseManager::loadSensorLayout()
+{
+    int layout = DatabasePartitions::LAYOUT_WIDE;
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+
+    if (settings.status() == QSettings::NoError)
+    {
+        if (settings.value("database/sensorLayout").toString() == "narrow")
+            layout = DatabasePartitions::LAYOUT_NARROW;
+    }
+
+    return layout;
+}
+
+RetentionPolicy DatabaseManager::loadRetentionPolicy() const
+{
+    RetentionPolicy policy;
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+
+    if (settings.status() == QSettings::NoError)
+    {
+        if (settings.contains("database/retentionRawDays"))
+            policy.rawDays = settings.value("database/retentionRawDays").toInt();
+        if (settings.contains("database/retentionHourlyMonths"))
+            policy.hourlyMonths = settings.value("database/retentionHourlyMonths").toInt();
+    }
+
+    // Hourly rollups are rebuilt from the raw readings, they must outlive them
+    if (policy.hourlyMonths > 0 && (policy.rawDays <= 0 || policy.rawDays > policy.hourlyMonths * 28))
+    {
+        qWarning() << "> retention: hourly rollups can't be dropped before the raw readings, keeping them" << (policy.rawDays <= 0 ? "forever" : "longer");
+        policy.hourlyMonths = (policy.rawDays <= 0) ? 0 : (policy.rawDays / 28 + 1);
+    }
+
+    return policy;
+}
+
+bool DatabaseManager::applySqliteProfile(QSqlDatabase &db, const SqliteProfile &profile)
+{
+    bool status = true;
+
+    // journal_mode is persistent, and must be set before any other connection is opened
+    QSqlQuery journal(db);
+    if (journal.exec("PRAGMA journal_mode = " + profile.journalMode) && journal.next())
+    {
+        if (journal.value(0).toString().compare(profile.journalMode, Qt::CaseInsensitive) != 0)
+        {
+            qWarning() << "> journal_mode" << profile.journalMode << "not supported, using" << journal.value(0).toString();
+            status = false;
+        }
+    }
+    else
+    {
+        qWarning() << "> journal.exec() ERROR" << journal.lastError().type() << ":" << journal.lastError().text();
+        status = false;
+    }
+
+    const QStringList pragmas = profile.pragmas();
+    for (const auto &pragma: pragmas)
+    {
+        QSqlQuery p(db);
+        if (p.exec(pragma) == false)
+        {
+            qWarning() << "> pragma.exec() ERROR" << p.lastError().type() << ":" << p.lastError().text();
+            status = false;
+        }
+    }
+
+    return status;
+}
+
+/* ************************************************************************** */
+
+void DatabaseManager::startWriter()
+{
+    if (m_writerThread) stopWriter();
+
+    m_writerThread = new QThread();
+    m_writer = new DatabaseWriter(m_dbInfos);
+    m_writer->setRetentionPolicy(loadRetentionPolicy());
+    m_writer->moveToThread(m_writerThread);
+
+    connect(m_writerThread, &QThread::started, m_writer, &DatabaseWriter::start);
+    connect(m_writerThread, &QThread::finished, m_writer, &DatabaseWriter::deleteLater);
+    connect(m_writer, &DatabaseWriter::dataWritten, this, &DatabaseManager::dataWritten);
+    // Cached chart series of these devices are stale: drop them from the writer thread,
+    // right after the commit, so a chart can't cache the old data in between
+    connect(m_writer, &DatabaseWriter::dataWritten, m_writer, [](const QStringList &deviceAddrs) {
+        DatabaseSeries::getInstance()->invalidate(deviceAddrs);
+    }, Qt::DirectConnection);
+
+    delete m_backend;
+    m_backend = new DatabaseBackendSql(m_writer, m_dbExternalOpen);
+
+    m_writerThread->start();
+}
+
+void DatabaseManager::stopWriter()
+{
+    if (m_writerThread)
+    {
+        Q_EMIT writerStopping();
+
+        delete m_backend;
+        m_backend = nullptr;
+        DatabaseSeries::getInstance()->invalidate();
+
+        QMetaObject::invokeMethod(m_writer, "stop", Qt::BlockingQueuedConnection);
+
+        m_writerThread->quit();
+        m_writerThread->wait();
+
+        delete m_writerThread;
+        m_writerThread = nullptr;
+        m_writer = nullptr;
+    }
+}
+
+void DatabaseManager::addReading(const DeviceReading &reading)
+{
+    if (m_backend)
+    {
+        m_backend->write({reading});
+
+        // The SQL backends signal it once the batch is committed
+        if (m_dbMemoryOpen)
+        {
+            DatabaseSeries::getInstance()->invalidate({reading.deviceAddr});
+            Q_EMIT dataWritten({reading.deviceAddr});
+        }
+    }
+}
+
+void DatabaseManager::endHistorySession(const QString &deviceAddr, const QDateTime &lastSync)
+{
+    if (m_writer)
+    {
+        // Commits the remaining history entries, then the lastSync, in one transaction
+        m_writer->endHistorySession(deviceAddr, lastSync);
+    }
+}
+
+bool DatabaseManager::importReadings(const QList <DeviceReading> &batch)
+{
+    // Imports stop before the writer does (see writerStopping())
+    if (!m_writer || QThread::currentThread() == m_writerThread) return false;
+
+    bool status = false;
+    QMetaObject::invokeMethod(m_writer, [this, &batch, &status]() {
+        status = m_writer->importReadings(batch);
+    }, Qt::BlockingQueuedConnection);
+
+    return status;
+}
+
+/* ************************************************************************** */
+
+QSqlQuery &DatabaseManager::getStatement(DatabaseQueries::QueryId id)
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+
+    auto it = m_statements.find(id);
+    if (it == m_statements.end())
+    {
+        it = m_statements.insert(id, QSqlQuery(QSqlDatabase::database()));
+        if (it->prepare(DatabaseQueries::get(id, m_dbExternalOpen)) == false)
+            qWarning() << "> prepare() ERROR" << DatabaseQueries::name(id) << it->lastError().type() << ":" << it->lastError().text();
+    }
+
+    return it.value();
+}
+
+bool DatabaseManager::execStatement(DatabaseQueries::QueryId id, const QList <QPair <QString, QVariant>> &values)
+{
+    if (!m_dbInternalOpen && !m_dbExternalOpen) return false;
+
+    QSqlQuery &q = getStatement(id);
+    for (const auto &v: values) q.bindValue(v.first, v.second);
+
+    bool status = q.exec();
+    if (status == false)
+        qWarning() << "> exec() ERROR" << DatabaseQueries::name(id) << q.lastError().type() << ":" << q.lastError().text();
+
+    q.finish();
+    return status;
+}
+
+bool DatabaseManager::addDevice(const QString &deviceAddr, const QString &deviceName)
+{
+    if (m_dbMemoryOpen)
+    {
+        if (!m_backend->getDevice(deviceAddr).isEmpty()) return false;
+        return m_backend->setDevice(deviceAddr, {{"deviceName", deviceName}});
+    }
+    if (!m_dbInternalOpen && !m_dbExternalOpen) return false;
+
+    QSqlQuery &queryDevice = getStatement(DatabaseQueries::DEVICE_SELECT_NAME);
+    queryDevice.bindValue(":deviceAddr", deviceAddr);
+    queryDevice.exec();
+    bool exists = queryDevice.next();
+    queryDevice.finish();
+
+    if (exists) return false;
+
+    return execStatement(DatabaseQueries::DEVICE_INSERT, {{":deviceAddr", deviceAddr}, {":deviceName", deviceName}});
+}
+
+bool DatabaseManager::removeDevice(const QString &deviceAddr)
+{
+    DatabaseSeries::getInstance()->invalidate({deviceAddr});
+    if (m_backend) m_backend->removeDevice(deviceAddr);
+
+    if (m_dbMemoryOpen) return true;
+    return execStatement(DatabaseQueries::DEVICE_DELETE, {{":deviceAddr", deviceAddr}});
+}
+
+bool DatabaseManager::clearDeviceData(const QString &deviceAddr)
+{
+    if (!m_backend) return false;
+
+    bool status = m_backend->clearData(deviceAddr);
+    DatabaseSeries::getInstance()->invalidate({deviceAddr});
+
+    return status;
+}
+
+bool DatabaseManager::updateDevice(const QString &deviceAddr, const QVariantMap &values)
+{
+    if (!m_backend) return false;
+    return m_backend->setDevice(deviceAddr, values);
+}
+
+/* ************************************************************************** */
+
+QList <QPair <QString, QString>> DatabaseManager::preloadDevices(int minutes)
+{
+    QList <QPair <QString, QString>> devices;
+    m_preloads.clear();
+
+    if (!m_dbInternalOpen && !m_dbExternalOpen) return devices;
+
+    // Two queries in total, whatever the number of devices
+    QHash <int, QString> deviceAddrs;
+
+    QSqlQuery &allDevices = getStatement(DatabaseQueries::DEVICE_SELECT_ALL);
+    if (allDevices.exec() == false)
+        qWarning() << "> allDevices.exec() ERROR" << allDevices.lastError().type() << ":" << allDevices.lastError().text();
+
+    while (allDevices.next())
+    {
+        DevicePreload p;
+        for (int i = 0; i < 8; i++) p.infos += allDevices.value(i);
+        p.deviceName = allDevices.value(8).toString();
+        p.deviceAddr = allDevices.value(9).toString();
+        if (!allDevices.value(10).isNull()) p.deviceId = allDevices.value(10).toInt();
+
+        if (p.deviceId >= 0) deviceAddrs.insert(p.deviceId, p.deviceAddr);
+        devices += qMakePair(p.deviceName, p.deviceAddr);
+        m_preloads.insert(p.deviceAddr, p);
+    }
+    allDevices.finish();
+
+    QSqlQuery &allLatest = getStatement(DatabaseQueries::LATEST_VALUES_SELECT_ALL);
+    allLatest.bindValue(":ts", QDateTime::currentDateTime().addSecs(-60 * minutes).toSecsSinceEpoch());
+    if (allLatest.exec() == false)
+        qWarning() << "> allLatest.exec() ERROR" << allLatest.lastError().type() << ":" << allLatest.lastError().text();
+
+    while (allLatest.next())
+    {
+        auto p = m_preloads.find(deviceAddrs.value(allLatest.value(3).toInt()));
+        if (p == m_preloads.end()) continue;
+
+        DataPoint v;
+        v.ts = allLatest.value(1).toLongLong();
+        v.value = allLatest.value(2).toFloat();
+        p->latest += qMakePair(allLatest.value(0).toUInt(), v);
+    }
+    allLatest.finish();
+
+    return devices;
+}
+
+bool DatabaseManager::takePreload(const QString &deviceAddr, DevicePreload &preload)
+{
+    auto p = m_preloads.find(deviceAddr);
+    if (p == m_preloads.end()) return false;
+
+    preload = p.value();
+    m_preloads.erase(p);
+
+    return true;
+}
+
+/* ************************************************************************** */
+
+void DatabaseManager::setIdle(bool idle)
+{
+    if (m_writer)
+    {
+        // Database maintenance only runs while no device is being scanned or refreshed
+        QMetaObject::invokeMethod(m_writer, "setIdle", Qt::QueuedConnection, Q_ARG(bool, idle));
+    }
+}
+
+/* ************************************************************************** */
+
+/*!
+ * \brief Run every DeviceSensor statement through 'EXPLAIN QUERY PLAN'.
+ * \return false if one of them does a full table scan.
+ *
+ * SQLite only. Start WatchFlower with '--check-db' to use it.
+ * The database is opened read only, on its own connection: it is not migrated,
+ * and the writer isn't started. Run WatchFlower once after an update first.
+ */
+bool DatabaseManager::checkQueryPlans()
+{
+    QString dbPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/datas.db";
+    if (!QSqlDatabase::isDriverAvailable("QSQLITE") || !QFile::exists(dbPath))
+    {
+        qWarning() << "checkQueryPlans() needs the SQLite database";
+        return false;
+    }
+
+    bool status = checkQueryPlans(dbPath);
+    QSqlDatabase::removeDatabase("checkQueryPlans");
+
+    return status;
+}
+
+bool DatabaseManager::checkQueryPlans(const QString &databaseFile)
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "checkQueryPlans");
+    db.setDatabaseName(databaseFile);
+    db.setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (db.open() == false)
+    {
+        qWarning() << "Cannot open database... Error:" << db.lastError();
+        return false;
+    }
+
+    bool status = true;
+
+    // Statements run against the newest existing partitions
+    DatabasePartitions *partitions = DatabasePartitions::getInstance();
+    partitions->setSensorLayout(loadSensorLayout());
+    if (partitions->load(db) == false) return false;
+
+    QRegularExpression placeholders(":\\w+");
+    QRegularExpression fullScan("^SCAN (TABLE )?(?!CONSTANT ROW|SUBQUERY)\\w+");
+
+    for (int i = 0; i < DatabaseQueries::QUERY_COUNT; i++)
+    {
+        DatabaseQueries::QueryId id = static_cast<DatabaseQueries::QueryId>(i);
+
+        const QList <QStringList> argsList = DatabaseQueries::sampleArgs(id);
+        for (const auto &args: argsList)
+        {
+            QString sql = DatabaseQueries::get(id);
+            for (const auto &a: args) sql = sql.arg(a);
+
+            QSqlQuery plan(db);
+            if (plan.prepare("EXPLAIN QUERY PLAN " + sql) == false)
+            {
+                qWarning() << "> plan.prepare() ERROR" << DatabaseQueries::name(id) << plan.lastError().type() << ":" << plan.lastError().text();
+                status = false;
+                continue;
+            }
+
+            // The plan doesn't depend on the values, but every placeholder must be bound
+            QRegularExpressionMatchIterator it = placeholders.globalMatch(sql);
+            while (it.hasNext())
+            {
+                plan.bindValue(it.next().captured(0), QVariant());
+            }
+
+            if (plan.exec() == false)
+            {
+                qWarning() << "> plan.exec() ERROR" << DatabaseQueries::name(id) << plan.lastError().type() << ":" << plan.lastError().text();
+                status = false;
+                continue;
+            }
+
+            while (plan.next())
+            {
+                QString detail = plan.value(3).toString();
+                if (fullScan.match(detail).hasMatch() && !DatabaseQueries::isBulkScan(id))
+                {
+                    qWarning().noquote() << "> full scan in" << DatabaseQueries::name(id) << args.join(", ") << ":" << detail;
+                    status = false;
+                }
+            }
+        }
+    }
+
+    return status;
+}
+
+QVariantMap DatabaseManager::getSeriesCacheStats() const
+{
+    return DatabaseSeries::getInstance()->cacheStats();
 }
 
 /* ************************************************************************** */
@@ -89,8 +613,12 @@ bool DatabaseManager::openDatabase_sqlite()
             {
                 dbPath += "/datas.db";
 
+                loadSqliteProfile();
+                DatabasePartitions::getInstance()->setSensorLayout(loadSensorLayout());
+
                 QSqlDatabase dbFile(QSqlDatabase::addDatabase("QSQLITE"));
                 dbFile.setDatabaseName(dbPath);
+                dbFile.setConnectOptions("QSQLITE_BUSY_TIMEOUT=" + QString::number(m_sqliteProfile.busyTimeout));
 
                 if (dbFile.isOpen())
                 {
@@ -102,6 +630,10 @@ bool DatabaseManager::openDatabase_sqlite()
                     {
                         m_dbInternalOpen = true;
 
+                        // Storage profile /////////////////////////////////////
+
+                        applySqliteProfile(dbFile, m_sqliteProfile);
+
                         // Migrations //////////////////////////////////////////
 
                         // Must be done before the creation, so we migrate old data tables
@@ -112,25 +644,22 @@ bool DatabaseManager::openDatabase_sqlite()
                         // Check if our tables exists //////////////////////////
 
                         createDatabase();
+                        migrateSensorLayout();
 
-                        // Sanitize database ///////////////////////////////////
+                        // Writer thread ///////////////////////////////////////
 
-                        if (QDate::currentDate().year() >= 2021)
-                        {
-                            // DATETIME: YYY-MM-JJ HH:MM:SS
+                        m_dbInfos = DatabaseConnectionInfos();
+                        m_dbInfos.driver = "QSQLITE";
+                        m_dbInfos.databaseName = dbPath;
+                        m_dbInfos.pragmas = m_sqliteProfile.pragmas();
+                        if (m_sqliteProfile.journalMode.compare("WAL", Qt::CaseInsensitive) == 0)
+                            m_dbInfos.walCheckpointInterval = m_sqliteProfile.walCheckpointInterval;
+                        m_dbInfos.journalFile = loadJournalFile("datas.journal");
 
-                            // Delete everything 90+ days old
-                            QSqlQuery sanitizePlantDataPast;
-                            sanitizePlantDataPast.prepare("DELETE FROM plantData WHERE ts < DATE('now', '-90 days')");
-                            if (sanitizePlantDataPast.exec() == false)
-                                qWarning() << "> sanitizeDataPast.exec() ERROR" << sanitizePlantDataPast.lastError().type() << ":" << sanitizePlantDataPast.lastError().text();
+                        startWriter();
+                        m_readPool.reset(m_dbInfos);
 
-                            // Delete everything that's in the future
-                            QSqlQuery sanitizePlantDataFuture;
-                            sanitizePlantDataFuture.prepare("DELETE FROM plantData WHERE ts > DATE('now', '+1 days')");
-                            if (sanitizePlantDataFuture.exec() == false)
-                                qWarning() << "> sanitizeDataFuture.exec() ERROR" << sanitizePlantDataFuture.lastError().type() << ":" << sanitizePlantDataFuture.lastError().text();
-                        }
+                        // Retention (and sanitizing) is done by the writer, in the background
                     }
                     else
                     {
@@ -171,13 +700,20 @@ bool DatabaseManager::openDatabase_mysql()
         }
 
         SettingsManager *sm = SettingsManager::getInstance();
+        DatabasePartitions::getInstance()->setSensorLayout(loadSensorLayout());
+
+        QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
 
         QSqlDatabase db = QSqlDatabase::addDatabase("QMYSQL");
         db.setHostName(sm->getExternalDb());
-        db.setPort(3306);
-        db.setDatabaseName("watchflower");
-        db.setUserName("watchflower");
-        db.setPassword("watchflower");
+        db.setPort(settings.value("database/mysqlPort", 3306).toInt());
+        db.setDatabaseName(settings.value("database/mysqlDatabase", "watchflower").toString());
+        db.setUserName(settings.value("database/mysqlUser", "watchflower").toString());
+        db.setPassword(settings.value("database/mysqlPassword", "watchflower").toString());
+        // Don't hang on a server that went away, the writer reconnects on its own
+        db.setConnectOptions("MYSQL_OPT_CONNECT_TIMEOUT=" + QString::number(MYSQL_TIMEOUT) +
+                             ";MYSQL_OPT_READ_TIMEOUT=" + QString::number(MYSQL_TIMEOUT) +
+                             ";MYSQL_OPT_WRITE_TIMEOUT=" + QString::number(MYSQL_TIMEOUT));
 
         if (db.isOpen())
         {
@@ -199,14 +735,22 @@ bool DatabaseManager::openDatabase_mysql()
                 // Check if our tables exists //////////////////////////////////
 
                 createDatabase();
-
-                // Delete everything that's in the future //////////////////////
-
-                // TODO
-
-                // Sanitize database ///////////////////////////////////////////
-
-                // We don't sanetize MySQL databases
+                migrateSensorLayout();
+
+                // Writer thread ///////////////////////////////////////////////
+
+                m_dbInfos = DatabaseConnectionInfos();
+                m_dbInfos.driver = "QMYSQL";
+                m_dbInfos.databaseName = db.databaseName();
+                m_dbInfos.hostName = db.hostName();
+                m_dbInfos.port = db.port();
+                m_dbInfos.userName = db.userName();
+                m_dbInfos.password = db.password();
+                m_dbInfos.connectOptions = db.connectOptions();
+                m_dbInfos.journalFile = loadJournalFile("mysql.journal");
+
+                startWriter();
+                m_readPool.reset(m_dbInfos);
             }
             else
             {
@@ -225,8 +769,58 @@ bool DatabaseManager::openDatabase_mysql()
 
 /* ************************************************************************** */
 
+bool DatabaseManager::openDatabase_memory()
+{
+    // Nothing is persisted, meant for tests and for devices without storage
+    qDebug() << "> Using the in-memory storage engine";
+
+    delete m_backend;
+    m_backend = new DatabaseBackendMemory();
+    m_dbMemoryOpen = true;
+
+    return m_dbMemoryOpen;
+}
+
+/* ************************************************************************** */
+
+bool DatabaseManager::backupDatabase(bool compress)
+{
+    // SQLite only, MySQL servers have their own tools
+    if (!m_dbInternalOpen || m_backupThread) return false;
+
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+    QString directory = settings.value("database/backupDirectory",
+                                       QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/backups").toString();
+    int keep = settings.value("database/backupKeep", BACKUP_KEEP).toInt();
+
+    m_backupThread = new QThread();
+    DatabaseBackup *backup = new DatabaseBackup(m_dbInfos, directory, compress, keep);
+    backup->moveToThread(m_backupThread);
+
+    connect(m_backupThread, &QThread::started, backup, &DatabaseBackup::run);
+    connect(backup, &DatabaseBackup::finished, this, &DatabaseManager::backupFinished);
+    connect(backup, &DatabaseBackup::finished, m_backupThread, &QThread::quit, Qt::DirectConnection);
+    connect(m_backupThread, &QThread::finished, backup, &DatabaseBackup::deleteLater);
+    connect(m_backupThread, &QThread::finished, this, [this]() {
+        m_backupThread->deleteLater();
+        m_backupThread = nullptr;
+    });
+
+    // Low priority, the writer and the UI come first
+    m_backupThread->start(QThread::LowPriority);
+
+    return true;
+}
+
+/* ************************************************************************** */
+
 void DatabaseManager::closeDatabase()
 {
+    if (m_backupThread) m_backupThread->wait();
+    stopWriter();
+    m_readPool.reset();
+    m_statements.clear();
+
     QSqlDatabase db = QSqlDatabase::database();
     if (db.isValid())
     {
@@ -246,6 +840,11 @@ void DatabaseManager::closeDatabase()
 
 void DatabaseManager::resetDatabase()
 {
+    if (m_backupThread) m_backupThread->wait();
+    stopWriter();
+    m_readPool.reset();
+    m_statements.clear();
+
     QSqlDatabase db = QSqlDatabase::database();
     if (db.isValid())
     {
@@ -286,8 +885,8 @@ bool DatabaseManager::tableExists(const QString &tableName)
         }
         else if (m_dbExternalOpen) // mysql
         {
-            checkTable.exec("SELECT * FROM information_schema.tables WHERE table_schema = 'watchflower' AND table_name = '" + tableName + "' LIMIT 1;");
-            //checkTable.exec("SELECT * FROM information_schema.TABLES WHERE TABLE_NAME = '" + tableName + "' AND TABLE_SCHEMA in (SELECT DATABASE());");
+            // The configured database, whatever its name
+            checkTable.exec("SELECT * FROM information_schema.tables WHERE table_schema = DATABASE() AND table_name = '" + tableName + "' LIMIT 1;");
         }
         if (checkTable.next())
         {
@@ -342,29 +941,36 @@ void DatabaseManager::createDatabase()
             qWarning() << "> createDevices.exec() ERROR" << createDevices.lastError().type() << ":" << createDevices.lastError().text();
     }
 
-    if (!tableExists("plantData"))
+    if (!tableExists("deviceIds"))
     {
-        qDebug() << "+ Adding 'plantData' table to local database";
+        qDebug() << "+ Adding 'deviceIds' table to local database";
+
+        // Addresses are mapped to integers once and never removed, data tables only use the integer
+        QSqlQuery createDeviceIds;
+        createDeviceIds.prepare("CREATE TABLE deviceIds (" \
+                                "deviceId INTEGER PRIMARY KEY" + QString(m_dbExternalOpen ? " AUTO_INCREMENT" : "") + "," \
+                                "deviceAddr CHAR(38) UNIQUE NOT NULL" \
+                                ");");
+
+        if (createDeviceIds.exec() == false)
+            qWarning() << "> createDeviceIds.exec() ERROR" << createDeviceIds.lastError().type() << ":" << createDeviceIds.lastError().text();
+    }
 
-        QSqlQuery createData;
-        createData.prepare("CREATE TABLE plantData (" \
-                           "deviceAddr CHAR(38)," \
-                           "ts DATETIME," \
-                           "ts_full DATETIME," \
-                             "soilMoisture INT," \
-                             "soilConductivity INT," \
-                             "soilTemperature FLOAT," \
-                             "soilPH FLOAT," \
-                             "temperature FLOAT," \
-                             "humidity FLOAT," \
-                             "luminosity INT," \
-                             "watertank FLOAT," \
-                           " PRIMARY KEY(deviceAddr, ts), " \
-                           " FOREIGN KEY(deviceAddr) REFERENCES devices(deviceAddr) ON DELETE CASCADE ON UPDATE NO ACTION " \
-                           ");");
+    // Raw readings go in monthly partitions of 'plantData' and 'sensorData' (see DatabasePartitions)
+    if (!tableExists("dataPartitions"))
+    {
+        qDebug() << "+ Adding 'dataPartitions' table to local database";
+
+        QSqlQuery createPartitions;
+        createPartitions.prepare("CREATE TABLE dataPartitions (" \
+                                 "tableName VARCHAR(32) PRIMARY KEY," \
+                                 "baseTable VARCHAR(16) NOT NULL," \
+                                 "tsFrom BIGINT NOT NULL," \
+                                 "tsTo BIGINT NOT NULL" \
+                                 ");");
 
-        if (createData.exec() == false)
-            qWarning() << "> createData.exec() ERROR" << createData.lastError().type() << ":" << createData.lastError().text();
+        if (createPartitions.exec() == false)
+            qWarning() << "> createPartitions.exec() ERROR" << createPartitions.lastError().type() << ":" << createPartitions.lastError().text();
     }
 
     if (!tableExists("plantLimits"))
@@ -394,41 +1000,77 @@ void DatabaseManager::createDatabase()
         if (createLimits.exec() == false)
             qWarning() << "> createLimits.exec() ERROR" << createLimits.lastError().type() << ":" << createLimits.lastError().text();
     }
-    if (!tableExists("sensorData"))
-    {
-        qDebug() << "+ Adding 'sensorData' table to local database";
-        QSqlQuery createSensorData;
-        createSensorData.prepare("CREATE TABLE sensorData (" \
-                                 "deviceID INT," \
-                                 "deviceAddr CHAR(38)," \
-                                   "timestamp DATETIME," \
-                                   "temperature FLOAT," \
-                                   "humidity FLOAT," \
-                                   "pressure FLOAT," \
-                                   "luminosity INT," \
-                                   "uv FLOAT," \
-                                   "sound FLOAT," \
-                                   "water FLOAT," \
-                                   "windDirection FLOAT," \
-                                   "windSpeed FLOAT," \
-                                   "pm1 FLOAT," \
-                                   "pm25 FLOAT," \
-                                   "pm10 FLOAT," \
-                                   "o2 FLOAT," \
-                                   "o3 FLOAT," \
-                                   "co FLOAT," \
-                                   "co2 FLOAT," \
-                                   "no2 FLOAT," \
-                                   "so2 FLOAT," \
-                                   "voc FLOAT," \
-                                   "hcho FLOAT," \
-                                   "geiger FLOAT," \
-                                 " FOREIGN KEY(deviceAddr) REFERENCES devices(deviceAddr) ON DELETE CASCADE ON UPDATE NO ACTION " \
-                                 ");");
 
-        if (createSensorData.exec() == false)
-            qWarning() << "> createSensorData.exec() ERROR" << createSensorData.lastError().type() << ":" << createSensorData.lastError().text();
+    QString withoutRowid = m_dbInternalOpen ? " WITHOUT ROWID" : "";
+
+    // Rollups, for both data tables, maintained by the DatabaseWriter
+    // Averages are vSum / vCount, hours are UTC epoch (seconds), days are local dates
+    if (!tableExists("dataHourly"))
+    {
+        qDebug() << "+ Adding 'dataHourly' table to local database";
+        QSqlQuery createHourly;
+        createHourly.prepare("CREATE TABLE dataHourly (" \
+                             "deviceId INTEGER NOT NULL," \
+                             "metric VARCHAR(16) NOT NULL," \
+                             "ts BIGINT NOT NULL," \
+                               "vMin FLOAT," \
+                               "vMax FLOAT," \
+                               "vSum DOUBLE," \
+                               "vCount INT," \
+                             " PRIMARY KEY(deviceId, metric, ts), " \
+                             " FOREIGN KEY(deviceId) REFERENCES deviceIds(deviceId) ON DELETE CASCADE ON UPDATE NO ACTION " \
+                             ")" + withoutRowid + ";");
+
+        if (createHourly.exec() == false)
+            qWarning() << "> createHourly.exec() ERROR" << createHourly.lastError().type() << ":" << createHourly.lastError().text();
+    }
+    if (!tableExists("dataDaily"))
+    {
+        qDebug() << "+ Adding 'dataDaily' table to local database";
+        QSqlQuery createDaily;
+        createDaily.prepare("CREATE TABLE dataDaily (" \
+                            "deviceId INTEGER NOT NULL," \
+                            "metric VARCHAR(16) NOT NULL," \
+                            "day DATE NOT NULL," \
+                              "vMin FLOAT," \
+                              "vMax FLOAT," \
+                              "vSum DOUBLE," \
+                              "vCount INT," \
+                            " PRIMARY KEY(deviceId, metric, day), " \
+                            " FOREIGN KEY(deviceId) REFERENCES deviceIds(deviceId) ON DELETE CASCADE ON UPDATE NO ACTION " \
+                            ")" + withoutRowid + ";");
+
+        if (createDaily.exec() == false)
+            qWarning() << "> createDaily.exec() ERROR" << createDaily.lastError().type() << ":" << createDaily.lastError().text();
+    }
+
+    // Newest value of each metric, for each device, maintained by the DatabaseWriter
+    // metric is BIGINT: SENSOR_GEIGER (1 << 31) doesn't fit in a MySQL (signed) INT
+    bool fillLatest = false;
+    if (!tableExists("latestValues"))
+    {
+        qDebug() << "+ Adding 'latestValues' table to local database";
+        QSqlQuery createLatest;
+        createLatest.prepare("CREATE TABLE latestValues (" \
+                             "deviceId INTEGER NOT NULL," \
+                             "metric BIGINT NOT NULL," \
+                             "ts BIGINT NOT NULL," \
+                               "value FLOAT," \
+                             " PRIMARY KEY(deviceId, metric), " \
+                             " FOREIGN KEY(deviceId) REFERENCES deviceIds(deviceId) ON DELETE CASCADE ON UPDATE NO ACTION " \
+                             ")" + withoutRowid + ";");
+
+        if (createLatest.exec() == false)
+            qWarning() << "> createLatest.exec() ERROR" << createLatest.lastError().type() << ":" << createLatest.lastError().text();
+        else
+            fillLatest = true;
     }
+
+    DatabasePartitions::getInstance()->load(QSqlDatabase::database());
+
+    // Existing databases: built from the data we already have
+    // (migrations run inside their own transaction, migrateDatabase() does it once they're done)
+    if (fillLatest && !m_migrating) rebuildLatestValues();
 }
 
 /* ************************************************************************** */
@@ -450,8 +1092,15 @@ void DatabaseManager::migrateDatabase()
     if (dbVersion > 0 && dbVersion != CURRENT_DB_VERSION)
     {
         bool migration_status = false;
+        m_migrating = true;
 
         if (dbVersion == 1) migration_status = migrate_v1v2();
+        if (dbVersion == 2 || (dbVersion == 1 && migration_status)) migration_status = migrate_v2v3();
+        if (dbVersion == 3 || (dbVersion < 3 && migration_status)) migration_status = migrate_v3v4();
+        if (dbVersion == 4 || (dbVersion < 4 && migration_status)) migration_status = migrate_v4v5();
+        if (dbVersion == 5 || (dbVersion < 5 && migration_status)) migration_status = migrate_v5v6();
+
+        m_migrating = false;
 
         // Then update version
         if (migration_status)
@@ -461,6 +1110,10 @@ void DatabaseManager::migrateDatabase()
             updateDbVersion.bindValue(":dbVersion", CURRENT_DB_VERSION);
             if (updateDbVersion.exec() == false)
                 qWarning() << "> updateDbVersion.exec() ERROR" << updateDbVersion.lastError().type() << ":" << updateDbVersion.lastError().text();
+
+            // TABLE latestValues
+            // Filled once the whole chain is committed, from the (partitioned) data tables
+            rebuildLatestValues();
         }
     }
 }
@@ -527,7 +1180,433 @@ bool DatabaseManager::migrate_v2v3()
 {
     qWarning() << "DatabaseManager::migrate_v2v3()";
 
-    return false;
+    QSqlDatabase db = QSqlDatabase::database();
+    if (db.transaction() == false)
+    {
+        qWarning() << "> db.transaction() ERROR" << db.lastError().type() << ":" << db.lastError().text();
+        return false;
+    }
+
+    // Move the v2 data tables out of the way, then create the v3 ones
+    QSqlQuery qmRen1("ALTER TABLE plantData RENAME TO plantData_v2");
+    if (qmRen1.lastError().isValid())
+    {
+        qWarning() << "> qmRen1.exec() ERROR" << qmRen1.lastError().type() << ":" << qmRen1.lastError().text();
+        db.rollback();
+        return false;
+    }
+    QSqlQuery qmRen2("ALTER TABLE sensorData RENAME TO sensorData_v2");
+    if (qmRen2.lastError().isValid())
+    {
+        qWarning() << "> qmRen2.exec() ERROR" << qmRen2.lastError().type() << ":" << qmRen2.lastError().text();
+        db.rollback();
+
+        // MySQL commits DDL statements right away, the rollback can't undo the first rename
+        if (m_dbExternalOpen) QSqlQuery qmUndo1("ALTER TABLE plantData_v2 RENAME TO plantData");
+        return false;
+    }
+
+    // v3 data tables, not partitioned yet (see migrate_v4v5())
+    QSqlQuery qmNew1(DatabasePartitions::createStatement("plantData", "plantData", m_dbExternalOpen));
+    QSqlQuery qmNew2(DatabasePartitions::createStatement("sensorData", "sensorData", m_dbExternalOpen));
+    if (qmNew1.lastError().isValid() || qmNew2.lastError().isValid())
+    {
+        qWarning() << "> qmNew.exec() ERROR" << qmNew1.lastError().text() << qmNew2.lastError().text();
+        db.rollback();
+
+        if (m_dbExternalOpen)
+        {
+            // The new tables are empty, the v2 ones go back in their place
+            QSqlQuery qmUndo0("DROP TABLE IF EXISTS plantData, sensorData");
+            QSqlQuery qmUndo1("ALTER TABLE plantData_v2 RENAME TO plantData");
+            QSqlQuery qmUndo2("ALTER TABLE sensorData_v2 RENAME TO sensorData");
+        }
+        return false;
+    }
+
+    createDatabase();
+
+    // TABLE deviceIds
+    // Every address we know of, from the devices and from the data tables
+    QSqlQuery qmIds("INSERT INTO deviceIds (deviceAddr)" \
+                    " SELECT deviceAddr FROM devices WHERE deviceAddr IS NOT NULL" \
+                    " UNION SELECT deviceAddr FROM plantData_v2 WHERE deviceAddr IS NOT NULL" \
+                    " UNION SELECT deviceAddr FROM sensorData_v2 WHERE deviceAddr IS NOT NULL");
+    if (qmIds.lastError().isValid())
+        qWarning() << "> qmIds.exec() ERROR" << qmIds.lastError().type() << ":" << qmIds.lastError().text();
+
+    // DATETIME strings (local time) > UTC epoch
+    QString insertOrIgnore = m_dbInternalOpen ? "INSERT OR IGNORE" : "INSERT IGNORE";
+    QString ts = m_dbInternalOpen ? "CAST(strftime('%s', d.ts, 'utc') AS INTEGER)" : "UNIX_TIMESTAMP(d.ts)";
+    QString ts_full = m_dbInternalOpen ? "CAST(strftime('%s', d.ts_full, 'utc') AS INTEGER)" : "UNIX_TIMESTAMP(d.ts_full)";
+    QString timestamp = m_dbInternalOpen ? "CAST(strftime('%s', d.timestamp, 'utc') AS INTEGER)" : "UNIX_TIMESTAMP(d.timestamp)";
+
+    // TABLE plantData
+    // FIELD deviceAddr > deviceId
+    // FIELD ts, ts_full > epoch
+    QSqlQuery qmDat1(insertOrIgnore + " INTO plantData (deviceId, ts, ts_full, soilMoisture, soilConductivity, soilTemperature, soilPH, temperature, humidity, luminosity, watertank)" \
+                     " SELECT i.deviceId, " + ts + ", " + ts_full + ", d.soilMoisture, d.soilConductivity, d.soilTemperature, d.soilPH, d.temperature, d.humidity, d.luminosity, d.watertank" \
+                     " FROM plantData_v2 d JOIN deviceIds i ON i.deviceAddr = d.deviceAddr" \
+                     " WHERE d.ts IS NOT NULL");
+    if (qmDat1.lastError().isValid())
+        qWarning() << "> qmDat1.exec() ERROR" << qmDat1.lastError().type() << ":" << qmDat1.lastError().text();
+
+    // TABLE sensorData
+    // FIELD deviceID, deviceAddr > deviceId
+    // FIELD timestamp > ts (epoch)
+    QSqlQuery qmSen1(insertOrIgnore + " INTO sensorData (deviceId, ts, temperature, humidity, pressure, luminosity, uv, sound, water, windDirection, windSpeed, pm1, pm25, pm10, o2, o3, co, co2, no2, so2, voc, hcho, geiger)" \
+                     " SELECT i.deviceId, " + timestamp + ", d.temperature, d.humidity, d.pressure, d.luminosity, d.uv, d.sound, d.water, d.windDirection, d.windSpeed," \
+                     " d.pm1, d.pm25, d.pm10, d.o2, d.o3, d.co, d.co2, d.no2, d.so2, d.voc, d.hcho, d.geiger" \
+                     " FROM sensorData_v2 d JOIN deviceIds i ON i.deviceAddr = d.deviceAddr" \
+                     " WHERE d.timestamp IS NOT NULL");
+    if (qmSen1.lastError().isValid())
+        qWarning() << "> qmSen1.exec() ERROR" << qmSen1.lastError().type() << ":" << qmSen1.lastError().text();
+
+    if (qmIds.lastError().isValid() || qmDat1.lastError().isValid() || qmSen1.lastError().isValid())
+    {
+        db.rollback();
+        return false;
+    }
+
+    QSqlQuery qmDrop1("DROP TABLE plantData_v2");
+    QSqlQuery qmDrop2("DROP TABLE sensorData_v2");
+
+    return db.commit();
+}
+
+/* ************************************************************************** */
+
+bool DatabaseManager::migrate_v3v4()
+{
+    qWarning() << "DatabaseManager::migrate_v3v4()";
+
+    // TABLE dataHourly, dataDaily
+    // Built from the existing data
+    createDatabase();
+
+    return rebuildRollups();
+}
+
+/* ************************************************************************** */
+
+bool DatabaseManager::migrate_v4v5()
+{
+    qWarning() << "DatabaseManager::migrate_v4v5()";
+
+    // TABLE dataPartitions
+    createDatabase();
+
+    DatabasePartitions *partitions = DatabasePartitions::getInstance();
+    QSqlDatabase db = QSqlDatabase::database();
+    if (db.transaction() == false)
+    {
+        qWarning() << "> db.transaction() ERROR" << db.lastError().type() << ":" << db.lastError().text();
+        return false;
+    }
+
+    bool status = true;
+
+    // TABLE plantData > plantData_yyyyMM
+    // TABLE sensorData > sensorData_yyyyMM
+    QList <QPair <QString, DeviceReading::ReadingTable>> tables;
+    tables << qMakePair(QString("plantData"), DeviceReading::TABLE_PLANTDATA);
+    tables << qMakePair(QString("sensorData"), DeviceReading::TABLE_SENSORDATA);
+
+    for (const auto &t: qAsConst(tables))
+    {
+        if (!tableExists(t.first)) continue;
+
+        QString cols = "deviceId, ts";
+        if (t.second == DeviceReading::TABLE_PLANTDATA) cols += ", ts_full";
+        const auto columns = DatabaseWriter::columns(t.second);
+        for (const auto &c: columns) cols += ", " + c.second;
+
+        // Temporary, so each month is a range scan, dropped along with the table
+        QSqlQuery qmIdx("CREATE INDEX " + t.first + "_v4_ts ON " + t.first + "(ts)");
+
+        QSqlQuery qmRange("SELECT min(ts), max(ts) FROM " + t.first);
+        if (qmRange.next() && !qmRange.value(0).isNull())
+        {
+            qint64 tsMax = qmRange.value(1).toLongLong();
+            for (qint64 month = DatabasePartitions::monthStart(qmRange.value(0).toLongLong());
+                 month <= tsMax; month = DatabasePartitions::monthEnd(month))
+            {
+                QString partition = partitions->ensure(db, t.first, month);
+                if (partition.isEmpty()) { status = false; break; }
+
+                QSqlQuery qmMove;
+                qmMove.prepare("INSERT INTO " + partition + " (" + cols + ")"                                " SELECT " + cols + " FROM " + t.first + " WHERE ts >= :tsFrom AND ts < :tsTo");
+                qmMove.bindValue(":tsFrom", month);
+                qmMove.bindValue(":tsTo", DatabasePartitions::monthEnd(month));
+                if (qmMove.exec() == false)
+                {
+                    qWarning() << "> qmMove.exec() ERROR" << qmMove.lastError().type() << ":" << qmMove.lastError().text();
+                    status = false;
+                    break;
+                }
+            }
+        }
+
+        if (status == false) break;
+
+        QSqlQuery qmDrop("DROP TABLE " + t.first);
+    }
+
+    if (status == false)
+    {
+        db.rollback();
+        partitions->load(db);
+        return false;
+    }
+
+    return db.commit();
+}
+
+/* ************************************************************************** */
+
+bool DatabaseManager::migrate_v5v6()
+{
+    qWarning() << "DatabaseManager::migrate_v5v6()";
+
+    // SQLite INTEGER columns are 64 bits already
+    if (!m_dbExternalOpen) return true;
+
+    // TABLE latestValues, sensorValues_yyyyMM
+    // FIELD metric INT > BIGINT, SENSOR_GEIGER (1 << 31) was clamped to INT_MAX
+    QStringList tables;
+    if (tableExists("latestValues")) tables += "latestValues";
+    QSqlQuery qmTables("SELECT tableName FROM dataPartitions WHERE baseTable = 'sensorValues'");
+    while (qmTables.next()) tables += qmTables.value(0).toString();
+
+    for (const auto &t: qAsConst(tables))
+    {
+        QSqlQuery qmAlter("ALTER TABLE " + t + " MODIFY metric BIGINT NOT NULL");
+        if (qmAlter.lastError().isValid())
+        {
+            qWarning() << "> qmAlter.exec() ERROR" << qmAlter.lastError().type() << ":" << qmAlter.lastError().text();
+            return false;
+        }
+
+        QSqlQuery qmGeiger("UPDATE " + t + " SET metric = 2147483648 WHERE metric = 2147483647");
+        if (qmGeiger.lastError().isValid())
+        {
+            qWarning() << "> qmGeiger.exec() ERROR" << qmGeiger.lastError().type() << ":" << qmGeiger.lastError().text();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* ************************************************************************** */
+
+/*!
+ * \brief Convert the environmental readings partitions to the sensor layout in use.
+ *
+ * The layout is chosen with the "database/sensorLayout" setting ("wide" or "narrow").
+ * Each partition is converted in its own transaction, so an interrupted
+ * conversion resumes where it stopped on the next startup.
+ */
+bool DatabaseManager::migrateSensorLayout()
+{
+    DatabasePartitions *partitions = DatabasePartitions::getInstance();
+    bool narrow = (partitions->getSensorLayout() == DatabasePartitions::LAYOUT_NARROW);
+    QString from = narrow ? "sensorData" : "sensorValues";
+    QString to = narrow ? "sensorValues" : "sensorData";
+
+    const QStringList tables = partitions->tables(from);
+    if (tables.isEmpty()) return true;
+
+    qWarning() << "DatabaseManager::migrateSensorLayout()" << from << ">" << to;
+
+    QSqlDatabase db = QSqlDatabase::database();
+    const auto columns = DatabaseWriter::columns(DeviceReading::TABLE_SENSORDATA);
+
+    for (const auto &table: tables)
+    {
+        QString partition = partitions->ensure(db, to, partitions->tsFrom(table));
+        if (partition.isEmpty()) return false;
+
+        if (db.transaction() == false)
+        {
+            qWarning() << "> db.transaction() ERROR" << db.lastError().type() << ":" << db.lastError().text();
+            return false;
+        }
+        bool status = true;
+
+        if (narrow)
+        {
+            // One INSERT per column, NULLs are not copied
+            for (const auto &c: columns)
+            {
+                QSqlQuery qmCol("INSERT INTO " + partition + " (deviceId, metric, ts, value)" \
+                                " SELECT deviceId, " + QString::number(c.first) + ", ts, " + c.second +
+                                " FROM " + table + " WHERE " + c.second + " IS NOT NULL");
+                if (qmCol.lastError().isValid())
+                {
+                    qWarning() << "> qmCol.exec() ERROR" << qmCol.lastError().type() << ":" << qmCol.lastError().text();
+                    status = false;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            // Pivot the metrics back into columns
+            QString cols = "deviceId, ts";
+            QString values = "deviceId, ts";
+            for (const auto &c: columns)
+            {
+                cols += ", " + c.second;
+                values += ", max(CASE WHEN metric = " + QString::number(c.first) + " THEN value END)";
+            }
+
+            QSqlQuery qmRows("INSERT INTO " + partition + " (" + cols + ")" \
+                             " SELECT " + values + " FROM " + table + " GROUP BY deviceId, ts");
+            if (qmRows.lastError().isValid())
+            {
+                qWarning() << "> qmRows.exec() ERROR" << qmRows.lastError().type() << ":" << qmRows.lastError().text();
+                status = false;
+            }
+        }
+
+        if (status) status = partitions->drop(db, table);
+        if (status) status = db.commit();
+
+        if (status == false)
+        {
+            db.rollback();
+            partitions->load(db);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* ************************************************************************** */
+
+bool DatabaseManager::rebuildRollups()
+{
+    QSqlDatabase db = QSqlDatabase::database();
+    if (db.transaction() == false)
+    {
+        qWarning() << "> db.transaction() ERROR" << db.lastError().type() << ":" << db.lastError().text();
+        return false;
+    }
+
+    QSqlQuery clearHourly("DELETE FROM dataHourly");
+    QSqlQuery clearDaily("DELETE FROM dataDaily");
+
+    bool status = !clearHourly.lastError().isValid() && !clearDaily.lastError().isValid();
+    QString hour = m_dbInternalOpen ? "(ts / 3600) * 3600" : "(ts DIV 3600) * 3600";
+    QString day = m_dbInternalOpen ? "date(ts, 'unixepoch', 'localtime')" : "DATE(FROM_UNIXTIME(ts))";
+
+    QList <QPair <QString, DeviceReading::ReadingTable>> tables;
+    tables << qMakePair(QString("plantData"), DeviceReading::TABLE_PLANTDATA);
+    tables << qMakePair(QString("sensorData"), DeviceReading::TABLE_SENSORDATA);
+
+    for (const auto &t: qAsConst(tables))
+    {
+        const auto cols = DatabaseWriter::columns(t.second);
+        for (const auto &c: cols)
+        {
+            QSqlQuery addHourly("REPLACE INTO dataHourly (deviceId, ts, metric, vMin, vMax, vSum, vCount)" \
+                                " SELECT deviceId, " + hour + ", '" + c.second + "', min(" + c.second + "), max(" + c.second + "), sum(" + c.second + "), count(" + c.second + ")" \
+                                " FROM " + t.first +
+                                " WHERE " + c.second + " IS NOT NULL" \
+                                " GROUP BY deviceId, " + hour);
+            if (addHourly.lastError().isValid())
+            {
+                qWarning() << "> addHourly.exec() ERROR" << addHourly.lastError().type() << ":" << addHourly.lastError().text();
+                status = false;
+            }
+        }
+    }
+
+    QSqlQuery addDaily("INSERT INTO dataDaily (deviceId, day, metric, vMin, vMax, vSum, vCount)" \
+                       " SELECT deviceId, " + day + ", metric, min(vMin), max(vMax), sum(vSum), sum(vCount)" \
+                       " FROM dataHourly" \
+                       " GROUP BY deviceId, metric, " + day);
+    if (addDaily.lastError().isValid())
+    {
+        qWarning() << "> addDaily.exec() ERROR" << addDaily.lastError().type() << ":" << addDaily.lastError().text();
+        status = false;
+    }
+
+    if (status == false)
+    {
+        db.rollback();
+        return false;
+    }
+
+    return db.commit();
+}
+
+/* ************************************************************************** */
+
+bool DatabaseManager::rebuildLatestValues()
+{
+    QSqlDatabase db = QSqlDatabase::database();
+    if (db.transaction() == false)
+    {
+        qWarning() << "> db.transaction() ERROR" << db.lastError().type() << ":" << db.lastError().text();
+        return false;
+    }
+
+    QSqlQuery clearLatest("DELETE FROM latestValues");
+    bool status = !clearLatest.lastError().isValid();
+
+    // Oldest partition first, so the newer values overwrite the older ones
+    DatabasePartitions *partitions = DatabasePartitions::getInstance();
+    QList <QPair <QString, DeviceReading::ReadingTable>> tables;
+    tables << qMakePair(QString("plantData"), DeviceReading::TABLE_PLANTDATA);
+    tables << qMakePair(partitions->baseTable(DeviceReading::TABLE_SENSORDATA), DeviceReading::TABLE_SENSORDATA);
+
+    for (const auto &t: qAsConst(tables))
+    {
+        QString ts = (t.second == DeviceReading::TABLE_PLANTDATA) ? "ts_full" : "ts";
+
+        const QStringList parts = partitions->tables(t.first);
+        for (const auto &part: parts)
+        {
+            QStringList selects;
+            if (DatabasePartitions::isNarrow(part))
+            {
+                selects += "SELECT d.deviceId, d.metric, d.ts, d.value FROM " + part + " d" \
+                           " WHERE d.value IS NOT NULL AND d.ts = (SELECT max(ts) FROM " + part + \
+                           " WHERE deviceId = d.deviceId AND metric = d.metric AND value IS NOT NULL)";
+            }
+            else
+            {
+                const auto cols = DatabaseWriter::columns(t.second);
+                for (const auto &c: cols)
+                {
+                    selects += "SELECT d.deviceId, " + QString::number(c.first) + ", d." + ts + ", d." + c.second + " FROM " + part + " d" \
+                               " WHERE d." + c.second + " IS NOT NULL AND d.ts = (SELECT max(ts) FROM " + part + \
+                               " WHERE deviceId = d.deviceId AND " + c.second + " IS NOT NULL)";
+                }
+            }
+
+            for (const auto &select: qAsConst(selects))
+            {
+                QSqlQuery addLatest("REPLACE INTO latestValues (deviceId, metric, ts, value) " + select);
+                if (addLatest.lastError().isValid())
+                {
+                    qWarning() << "> addLatest.exec() ERROR" << addLatest.lastError().type() << ":" << addLatest.lastError().text();
+                    status = false;
+                }
+            }
+        }
+    }
+
+    if (status == false)
+    {
+        db.rollback();
+        return false;
+    }
+
+    return db.commit();
 }
 
 /* ************************************************************************** */
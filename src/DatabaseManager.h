@@ -25,6 +25,69 @@
 
 #include <QObject>
 #include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <QMap>
+#include <QHash>
+#include <QVariant>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include "DatabaseWriter.h"
+#include "DatabaseQueries.h"
+#include "DatabaseReadPool.h"
+#include "DatabaseBackend.h"
+
+/* ************************************************************************** */
+
+// SQLite storage profile, defaults can be overridden using "database/..." settings
+#define SQLITE_JOURNAL_MODE             "WAL"
+#define SQLITE_SYNCHRONOUS              "NORMAL"
+#define SQLITE_MMAP_SIZE                (64*1024*1024)  // bytes
+#define SQLITE_CACHE_SIZE               8192            // KiB
+#define SQLITE_TEMP_STORE               "MEMORY"
+#define SQLITE_BUSY_TIMEOUT             5000            // ms
+#define SQLITE_WAL_AUTOCHECKPOINT       1000            // pages
+#define SQLITE_WAL_CHECKPOINT_INTERVAL  300             // s
+
+#define MYSQL_TIMEOUT                   10              // s, connect, read and write timeouts
+
+/*!
+ * \brief SQLite settings applied to every connection at open time.
+ */
+struct SqliteProfile
+{
+    QString journalMode = SQLITE_JOURNAL_MODE;
+    QString synchronous = SQLITE_SYNCHRONOUS;
+    qint64 mmapSize = SQLITE_MMAP_SIZE;
+    int cacheSize = SQLITE_CACHE_SIZE;
+    QString tempStore = SQLITE_TEMP_STORE;
+    int busyTimeout = SQLITE_BUSY_TIMEOUT;
+    int walAutoCheckpoint = SQLITE_WAL_AUTOCHECKPOINT;
+    int walCheckpointInterval = SQLITE_WAL_CHECKPOINT_INTERVAL;
+
+    //! SQLite defaults, what we used before having a profile
+    static SqliteProfile legacy();
+    //! The defaults, overridden by the "database/..." settings
+    static SqliteProfile fromSettings();
+
+    //! Per connection PRAGMAs (journal_mode is persistent and is not part of it)
+    QStringList pragmas() const;
+};
+
+/*!
+ * \brief Saved state of a device, bulk loaded at startup (see DatabaseManager::preloadDevices()).
+ */
+struct DevicePreload
+{
+    QString deviceName;
+    QString deviceAddr;
+    int deviceId = -1;                          //!< -1 if it never saved a reading
+
+    QVariantList infos;                         //!< DEVICE_SELECT_INFOS columns
+    QList <QPair <quint32, DataPoint>> latest;  //!< LATEST_VALUES_SELECT rows (metric > ts, value)
+};
 
 /* ************************************************************************** */
 
@@ -44,9 +107,38 @@ class DatabaseManager: public QObject
     bool m_dbInternalOpen = false;
     bool m_dbExternalAvailable = false;
     bool m_dbExternalOpen = false;
+    bool m_dbMemoryOpen = false;
+
+    bool m_migrating = false;               //!< createDatabase() called from a migration (see migrateDatabase())
+
+    DatabaseBackend *m_backend = nullptr;
+
+    SqliteProfile m_sqliteProfile;
+    DatabaseConnectionInfos m_dbInfos;
+    QThread *m_writerThread = nullptr;
+    DatabaseWriter *m_writer = nullptr;
+    DatabaseReadPool m_readPool;
+    QThread *m_backupThread = nullptr;
+    QTimer *m_backupTimer = nullptr;
+
+    QMap <int, QSqlQuery> m_statements;     //!< Prepared once, on the default connection
+    QHash <QString, DevicePreload> m_preloads;
+    bool execStatement(DatabaseQueries::QueryId id, const QList <QPair <QString, QVariant>> &values);
+
+    void startWriter();
+    void stopWriter();
+
+    void loadSqliteProfile();
+    RetentionPolicy loadRetentionPolicy() const;
+    static int loadSensorLayout();
+    int loadBackendType() const;
+    QString loadJournalFile(const QString &fileName) const;
+
+    static bool checkQueryPlans(const QString &databaseFile);
 
     bool openDatabase_sqlite();
     bool openDatabase_mysql();
+    bool openDatabase_memory();
     void closeDatabase();
 
     void createDatabase();
@@ -57,12 +149,67 @@ class DatabaseManager: public QObject
     void migrateDatabase();
     bool migrate_v1v2();
     bool migrate_v2v3();
+    bool migrate_v3v4();
+    bool migrate_v4v5();
+    bool migrate_v5v6();
+
+    bool migrateSensorLayout();
+    bool rebuildRollups();
+    bool rebuildLatestValues();
 
 public:
     static DatabaseManager *getInstance();
 
+    const SqliteProfile &getSqliteProfile() const { return m_sqliteProfile; }
+    static bool applySqliteProfile(QSqlDatabase &db, const SqliteProfile &profile);
+
     Q_INVOKABLE bool hasDatabaseInternal() const { return m_dbInternalOpen; }
     Q_INVOKABLE bool hasDatabaseExternal() const { return m_dbExternalOpen; }
+    Q_INVOKABLE bool hasDatabaseMemory() const { return m_dbMemoryOpen; }
+
+    //! The storage engine in use (nullptr if none)
+    DatabaseBackend *getBackend() const { return m_backend; }
+
+    void addReading(const DeviceReading &reading);
+    void endHistorySession(const QString &deviceAddr, const QDateTime &lastSync);
+    //! Bulk import, blocks the calling (worker) thread until the batch is committed
+    bool importReadings(const QList <DeviceReading> &batch);
+
+    //! Prepared statement, on the default connection (GUI thread only)
+    QSqlQuery &getStatement(DatabaseQueries::QueryId id);
+
+    bool addDevice(const QString &deviceAddr, const QString &deviceName);
+    bool removeDevice(const QString &deviceAddr);
+    bool clearDeviceData(const QString &deviceAddr);
+    //! One UPDATE for any number of 'devices' columns (column > value)
+    bool updateDevice(const QString &deviceAddr, const QVariantMap &values);
+
+    //! Load every saved device at once, returns their (name, address), in the table order
+    //! Only what the devices list needs, the rest is loaded by each device on first use
+    QList <QPair <QString, QString>> preloadDevices(int minutes);
+    //! Hands over (and forgets) the preloaded state of a device
+    bool takePreload(const QString &deviceAddr, DevicePreload &preload);
+    void clearPreloads() { m_preloads.clear(); }
+
+    //! Read connection for the calling thread, to run queries outside the GUI thread
+    QSqlDatabase getReadDatabase() { return m_readPool.database(); }
+
+    void setIdle(bool idle);
+
+    //! Read only check of the SQLite database, without opening it through the DatabaseManager
+    static bool checkQueryPlans();
+
+    //! Chart series cache counters (see DatabaseSeries)
+    Q_INVOKABLE QVariantMap getSeriesCacheStats() const;
+
+    //! Online snapshot of the SQLite database, in the background (see DatabaseBackup)
+    Q_INVOKABLE bool backupDatabase(bool compress = false);
+    bool isBackupRunning() const { return m_backupThread; }
+
+Q_SIGNALS:
+    void dataWritten(const QStringList &deviceAddrs);
+    void writerStopping();          //!< Last chance to write through the backend
+    void backupFinished(bool status, const QString &snapshotFile);
 };
 
 /* ************************************************************************** */
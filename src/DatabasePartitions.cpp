@@ -0,0 +1,265 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabasePartitions.h"
+#include "device_reading.h"
+
+#include <QMutexLocker>
+#include <QDateTime>
+#include <QDebug>
+
+#include <QSqlQuery>
+#include <QSqlError>
+
+/* ************************************************************************** */
+
+DatabasePartitions *DatabasePartitions::instance = nullptr;
+
+DatabasePartitions *DatabasePartitions::getInstance()
+{
+    if (instance == nullptr)
+    {
+        instance = new DatabasePartitions();
+    }
+
+    return instance;
+}
+
+/* ************************************************************************** */
+
+QString DatabasePartitions::baseTable(int readingTable) const
+{
+    if (readingTable == DeviceReading::TABLE_SENSORDATA)
+        return (m_sensorLayout == LAYOUT_NARROW) ? "sensorValues" : "sensorData";
+
+    return "plantData";
+}
+
+qint64 DatabasePartitions::monthStart(qint64 ts)
+{
+    QDate d = QDateTime::fromSecsSinceEpoch(ts, Qt::UTC).date();
+    return QDateTime(QDate(d.year(), d.month(), 1), QTime(0, 0), Qt::UTC).toSecsSinceEpoch();
+}
+
+qint64 DatabasePartitions::monthEnd(qint64 ts)
+{
+    QDate d = QDateTime::fromSecsSinceEpoch(ts, Qt::UTC).date();
+    return QDateTime(QDate(d.year(), d.month(), 1).addMonths(1), QTime(0, 0), Qt::UTC).toSecsSinceEpoch();
+}
+
+QString DatabasePartitions::partitionName(const QString &baseTable, qint64 ts)
+{
+    return baseTable + "_" + QDateTime::fromSecsSinceEpoch(ts, Qt::UTC).date().toString("yyyyMM");
+}
+
+QString DatabasePartitions::createStatement(const QString &baseTable, const QString &tableName, bool mysql)
+{
+    // Data tables are clustered on (deviceId, ts), timestamps are UTC epoch (seconds)
+    QString withoutRowid = mysql ? "" : " WITHOUT ROWID";
+
+    if (baseTable == "plantData")
+    {
+        return "CREATE TABLE IF NOT EXISTS " + tableName + " (" \
+               "deviceId INTEGER NOT NULL," \
+               "ts BIGINT NOT NULL," \
+               "ts_full BIGINT," \
+                 "soilMoisture INT," \
+                 "soilConductivity INT," \
+                 "soilTemperature FLOAT," \
+                 "soilPH FLOAT," \
+                 "temperature FLOAT," \
+                 "humidity FLOAT," \
+                 "luminosity INT," \
+                 "watertank FLOAT," \
+               " PRIMARY KEY(deviceId, ts), " \
+               " FOREIGN KEY(deviceId) REFERENCES deviceIds(deviceId) ON DELETE CASCADE ON UPDATE NO ACTION " \
+               ")" + withoutRowid + ";";
+    }
+    else if (baseTable == "sensorData")
+    {
+        return "CREATE TABLE IF NOT EXISTS " + tableName + " (" \
+               "deviceId INTEGER NOT NULL," \
+               "ts BIGINT NOT NULL," \
+                 "temperature FLOAT," \
+                 "humidity FLOAT," \
+                 "pressure FLOAT," \
+                 "luminosity INT," \
+                 "uv FLOAT," \
+                 "sound FLOAT," \
+                 "water FLOAT," \
+                 "windDirection FLOAT," \
+                 "windSpeed FLOAT," \
+                 "pm1 FLOAT," \
+                 "pm25 FLOAT," \
+                 "pm10 FLOAT," \
+                 "o2 FLOAT," \
+                 "o3 FLOAT," \
+                 "co FLOAT," \
+                 "co2 FLOAT," \
+                 "no2 FLOAT," \
+                 "so2 FLOAT," \
+                 "voc FLOAT," \
+                 "hcho FLOAT," \
+                 "geiger FLOAT," \
+               " PRIMARY KEY(deviceId, ts), " \
+               " FOREIGN KEY(deviceId) REFERENCES deviceIds(deviceId) ON DELETE CASCADE ON UPDATE NO ACTION " \
+               ")" + withoutRowid + ";";
+    }
+    else if (baseTable == "sensorValues")
+    {
+        // (deviceId, metric, ts) order, so a single metric is a range scan
+        // metric is BIGINT: SENSOR_GEIGER (1 << 31) doesn't fit in a MySQL (signed) INT
+        return "CREATE TABLE IF NOT EXISTS " + tableName + " (" \
+               "deviceId INTEGER NOT NULL," \
+               "metric BIGINT NOT NULL," \
+               "ts BIGINT NOT NULL," \
+                 "value FLOAT," \
+               " PRIMARY KEY(deviceId, metric, ts), " \
+               " FOREIGN KEY(deviceId) REFERENCES deviceIds(deviceId) ON DELETE CASCADE ON UPDATE NO ACTION " \
+               ")" + withoutRowid + ";";
+    }
+
+    return QString();
+}
+
+/* ************************************************************************** */
+
+bool DatabasePartitions::load(QSqlDatabase db)
+{
+    QMutexLocker lock(&m_mutex);
+    m_partitions.clear();
+
+    QSqlQuery readPartitions(db);
+    if (readPartitions.exec("SELECT tableName, baseTable, tsFrom FROM dataPartitions") == false)
+    {
+        qWarning() << "> readPartitions.exec() ERROR" << readPartitions.lastError().type() << ":" << readPartitions.lastError().text();
+        return false;
+    }
+
+    while (readPartitions.next())
+    {
+        m_partitions[readPartitions.value(1).toString()].insert(readPartitions.value(2).toLongLong(),
+                                                                readPartitions.value(0).toString());
+    }
+
+    return true;
+}
+
+QString DatabasePartitions::ensure(QSqlDatabase db, const QString &baseTable, qint64 ts)
+{
+    QMutexLocker lock(&m_mutex);
+
+    qint64 month = monthStart(ts);
+    QString tableName = m_partitions.value(baseTable).value(month);
+    if (!tableName.isEmpty()) return tableName;
+
+    tableName = partitionName(baseTable, month);
+    qDebug() << "+ Adding partition" << tableName << "to the database";
+
+    QSqlQuery createPartition(db);
+    if (createPartition.exec(createStatement(baseTable, tableName, db.driverName() == "QMYSQL")) == false)
+    {
+        qWarning() << "> createPartition.exec() ERROR" << createPartition.lastError().type() << ":" << createPartition.lastError().text();
+        return QString();
+    }
+
+    QSqlQuery addPartition(db);
+    addPartition.prepare("REPLACE INTO dataPartitions (tableName, baseTable, tsFrom, tsTo) VALUES (:tableName, :baseTable, :tsFrom, :tsTo)");
+    addPartition.bindValue(":tableName", tableName);
+    addPartition.bindValue(":baseTable", baseTable);
+    addPartition.bindValue(":tsFrom", month);
+    addPartition.bindValue(":tsTo", monthEnd(month));
+    if (addPartition.exec() == false)
+    {
+        qWarning() << "> addPartition.exec() ERROR" << addPartition.lastError().type() << ":" << addPartition.lastError().text();
+        return QString();
+    }
+
+    m_partitions[baseTable].insert(month, tableName);
+
+    return tableName;
+}
+
+bool DatabasePartitions::drop(QSqlDatabase db, const QString &tableName)
+{
+    QMutexLocker lock(&m_mutex);
+
+    // Forget it first, so the readers stop using it
+    for (auto &p: m_partitions)
+    {
+        for (auto it = p.begin(); it != p.end(); ++it)
+        {
+            if (it.value() == tableName) { p.erase(it); break; }
+        }
+    }
+
+    QSqlQuery dropPartition(db);
+    if (dropPartition.exec("DROP TABLE IF EXISTS " + tableName) == false)
+    {
+        qWarning() << "> dropPartition.exec() ERROR" << dropPartition.lastError().type() << ":" << dropPartition.lastError().text();
+        return false;
+    }
+
+    QSqlQuery removePartition(db);
+    removePartition.prepare("DELETE FROM dataPartitions WHERE tableName = :tableName");
+    removePartition.bindValue(":tableName", tableName);
+    if (removePartition.exec() == false)
+    {
+        qWarning() << "> removePartition.exec() ERROR" << removePartition.lastError().type() << ":" << removePartition.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+/* ************************************************************************** */
+
+QStringList DatabasePartitions::tables(const QString &baseTable, qint64 tsFrom, qint64 tsTo) const
+{
+    QMutexLocker lock(&m_mutex);
+    QStringList t;
+
+    const QMap <qint64, QString> partitions = m_partitions.value(baseTable);
+    for (auto it = partitions.constBegin(); it != partitions.constEnd(); ++it)
+    {
+        if (it.key() < tsTo && monthEnd(it.key()) > tsFrom)
+            t += it.value();
+    }
+
+    return t;
+}
+
+qint64 DatabasePartitions::tsFrom(const QString &tableName) const
+{
+    QMutexLocker lock(&m_mutex);
+
+    for (const auto &p: m_partitions)
+    {
+        for (auto it = p.constBegin(); it != p.constEnd(); ++it)
+        {
+            if (it.value() == tableName) return it.key();
+        }
+    }
+
+    return -1;
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,106 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DATABASE_PARTITIONS_H
+#define DATABASE_PARTITIONS_H
+/* ************************************************************************** */
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QMutex>
+#include <QSqlDatabase>
+
+#include <limits>
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabasePartitions class
+ *
+ * Raw readings are not stored in 'plantData' and 'sensorData' directly, but in
+ * one table per (UTC) month: 'plantData_202104', 'sensorData_202104'...
+ * Every partition is listed in the 'dataPartitions' table.
+ *
+ * Environmental readings can use one of two layouts:
+ * - wide: 'sensorData', one row per reading and one column per metric
+ * - narrow: 'sensorValues', one row per (deviceId, metric, ts), the metric
+ *   being its DeviceUtils::DeviceSensors bit. Most sensors only fill a few of
+ *   the 22 sensorData columns, so this layout doesn't store the NULLs.
+ *
+ * The writer creates the partitions as needed, the readers ask for the
+ * partitions covering their time window, and retention drops whole partitions.
+ *
+ * Thread safe, the writer thread and the GUI thread both use it.
+ */
+class DatabasePartitions
+{
+    // Singleton
+    static DatabasePartitions *instance;
+    DatabasePartitions() = default;
+
+    mutable QMutex m_mutex;
+    QMap <QString, QMap <qint64, QString>> m_partitions; //!< base table > month start > partition
+
+    int m_sensorLayout = LAYOUT_WIDE;
+
+public:
+    enum SensorLayout {
+        LAYOUT_WIDE         = 0,    //!< sensorData
+        LAYOUT_NARROW       = 1,    //!< sensorValues
+    };
+
+    static DatabasePartitions *getInstance();
+
+    //! Set once at startup, before any reading is written
+    void setSensorLayout(int layout) { m_sensorLayout = layout; }
+    int getSensorLayout() const { return m_sensorLayout; }
+
+    //! 'plantData', 'sensorData' or 'sensorValues', for a DeviceReading::ReadingTable
+    QString baseTable(int readingTable) const;
+
+    static bool isNarrow(const QString &tableName) { return tableName.startsWith("sensorValues"); }
+
+    static qint64 monthStart(qint64 ts);
+    static qint64 monthEnd(qint64 ts);
+    static QString partitionName(const QString &baseTable, qint64 ts);
+
+    //! CREATE TABLE statement for a data table, partition or not
+    static QString createStatement(const QString &baseTable, const QString &tableName, bool mysql);
+
+    //! Read the 'dataPartitions' table
+    bool load(QSqlDatabase db);
+
+    //! The partition that holds 'ts', created if needed (empty string on error)
+    QString ensure(QSqlDatabase db, const QString &baseTable, qint64 ts);
+
+    bool drop(QSqlDatabase db, const QString &tableName);
+
+    //! Partitions of a base table overlapping [tsFrom, tsTo[, oldest first
+    QStringList tables(const QString &baseTable,
+                       qint64 tsFrom = 0, qint64 tsTo = std::numeric_limits<qint64>::max()) const;
+
+    //! Month start of a partition, -1 if unknown
+    qint64 tsFrom(const QString &tableName) const;
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_PARTITIONS_H
@@ -0,0 +1,217 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseQueries.h"
+#include "DatabasePartitions.h"
+
+/* ************************************************************************** */
+
+struct QueryDefinition
+{
+    DatabaseQueries::QueryId id;
+    const char *name;
+    const char *sqlite;
+    const char *mysql;      //!< nullptr if the SQLite version works with MySQL too
+};
+
+// Timestamps are UTC epoch (seconds), rollup days are local dates
+static const QueryDefinition queries[] = {
+    { DatabaseQueries::DEVICE_SELECT_NAME, "DEVICE_SELECT_NAME",
+      "SELECT deviceName FROM devices WHERE deviceAddr = :deviceAddr",
+      nullptr },
+
+    { DatabaseQueries::DEVICE_SELECT_INFOS, "DEVICE_SELECT_INFOS",
+      "SELECT deviceModel, deviceFirmware, deviceBattery, associatedName, locationName, lastSync, isOutside, settings" \
+      " FROM devices WHERE deviceAddr = :deviceAddr",
+      nullptr },
+
+    // Startup bulk loading: same first columns as their single device version
+    { DatabaseQueries::DEVICE_SELECT_ALL, "DEVICE_SELECT_ALL",
+      "SELECT d.deviceModel, d.deviceFirmware, d.deviceBattery, d.associatedName, d.locationName, d.lastSync, d.isOutside, d.settings," \
+      " d.deviceName, d.deviceAddr, i.deviceId" \
+      " FROM devices d LEFT JOIN deviceIds i ON i.deviceAddr = d.deviceAddr",
+      nullptr },
+
+    { DatabaseQueries::DEVICE_INSERT, "DEVICE_INSERT",
+      "INSERT INTO devices (deviceAddr, deviceName) VALUES (:deviceAddr, :deviceName)",
+      nullptr },
+
+    { DatabaseQueries::DEVICE_DELETE, "DEVICE_DELETE",
+      "DELETE FROM devices WHERE deviceAddr = :deviceAddr",
+      nullptr },
+
+    { DatabaseQueries::DEVICE_UPDATE_LASTSYNC, "DEVICE_UPDATE_LASTSYNC",
+      "UPDATE devices SET lastSync = :sync WHERE deviceAddr = :deviceAddr",
+      nullptr },
+
+    // Coalesced metadata changes, the columns that didn't change are bound to NULL
+    { DatabaseQueries::DEVICE_UPDATE, "DEVICE_UPDATE",
+      "UPDATE devices SET deviceModel = COALESCE(:deviceModel, deviceModel)," \
+      " deviceName = COALESCE(:deviceName, deviceName)," \
+      " deviceFirmware = COALESCE(:deviceFirmware, deviceFirmware)," \
+      " deviceBattery = COALESCE(:deviceBattery, deviceBattery)," \
+      " associatedName = COALESCE(:associatedName, associatedName)," \
+      " locationName = COALESCE(:locationName, locationName)," \
+      " lastSync = COALESCE(:lastSync, lastSync)," \
+      " manualOrderIndex = COALESCE(:manualOrderIndex, manualOrderIndex)," \
+      " isOutside = COALESCE(:isOutside, isOutside)," \
+      " settings = COALESCE(:settings, settings)" \
+      " WHERE deviceAddr = :deviceAddr",
+      nullptr },
+
+    { DatabaseQueries::DEVICEID_SELECT, "DEVICEID_SELECT",
+      "SELECT deviceId FROM deviceIds WHERE deviceAddr = :deviceAddr",
+      nullptr },
+
+    { DatabaseQueries::PLANTLIMITS_SELECT, "PLANTLIMITS_SELECT",
+      "SELECT hygroMin, hygroMax, conduMin, conduMax, phMin, phMax, " \
+      " tempMin, tempMax, humiMin, humiMax, " \
+      " luxMin, luxMax, mmolMin, mmolMax " \
+      "FROM plantLimits WHERE deviceAddr = :deviceAddr",
+      nullptr },
+
+    { DatabaseQueries::PLANTLIMITS_REPLACE, "PLANTLIMITS_REPLACE",
+      "REPLACE INTO plantLimits (deviceAddr, hygroMin, hygroMax, conduMin, conduMax, phMin, phMax, tempMin, tempMax, humiMin, humiMax, luxMin, luxMax, mmolMin, mmolMax)" \
+      " VALUES (:deviceAddr, :hygroMin, :hygroMax, :conduMin, :conduMax, :phMin, :phMax, :tempMin, :tempMax, :humiMin, :humiMax, :luxMin, :luxMax, :mmolMin, :mmolMax)",
+      nullptr },
+
+    { DatabaseQueries::LATEST_VALUES_SELECT, "LATEST_VALUES_SELECT",
+      "SELECT metric, ts, value " \
+      "FROM latestValues " \
+      "WHERE deviceId = :deviceId AND ts >= :ts;",
+      nullptr },
+
+    { DatabaseQueries::LATEST_VALUES_SELECT_ALL, "LATEST_VALUES_SELECT_ALL",
+      "SELECT metric, ts, value, deviceId " \
+      "FROM latestValues " \
+      "WHERE ts >= :ts;",
+      nullptr },
+
+    // Only moves forward, late history readings don't replace a newer value
+    { DatabaseQueries::LATEST_VALUES_UPSERT, "LATEST_VALUES_UPSERT",
+      "INSERT INTO latestValues (deviceId, metric, ts, value) VALUES (:deviceId, :metric, :ts, :value) " \
+      "ON CONFLICT(deviceId, metric) DO UPDATE SET ts = excluded.ts, value = excluded.value " \
+      "WHERE excluded.ts >= latestValues.ts;",
+      "INSERT INTO latestValues (deviceId, metric, ts, value) VALUES (:deviceId, :metric, :ts, :value) " \
+      "ON DUPLICATE KEY UPDATE value = IF(VALUES(ts) >= ts, VALUES(value), value), ts = GREATEST(ts, VALUES(ts));" },
+
+    { DatabaseQueries::DATA_COUNT, "DATA_COUNT",
+      "SELECT COUNT(*) FROM %1 WHERE deviceId = :deviceId;",
+      nullptr },
+
+    { DatabaseQueries::DATA_RANGE, "DATA_RANGE",
+      "SELECT ts, %2 " \
+      "FROM %1 " \
+      "WHERE deviceId = :deviceId AND ts >= :tsFrom AND ts < :tsTo AND %2 IS NOT NULL " \
+      "ORDER BY ts;",
+      nullptr },
+
+    { DatabaseQueries::VALUES_RANGE, "VALUES_RANGE",
+      "SELECT ts, value " \
+      "FROM %1 " \
+      "WHERE deviceId = :deviceId AND metric = :metric AND ts >= :tsFrom AND ts < :tsTo " \
+      "ORDER BY ts;",
+      nullptr },
+
+    { DatabaseQueries::ROLLUP_HOURS_RANGE, "ROLLUP_HOURS_RANGE",
+      "SELECT ts, vMin, vMax, vSum, vCount " \
+      "FROM dataHourly " \
+      "WHERE deviceId = :deviceId AND metric = :metric AND ts >= :tsFrom AND ts < :tsTo " \
+      "ORDER BY ts;",
+      nullptr },
+
+    { DatabaseQueries::ROLLUP_DAYS_RANGE, "ROLLUP_DAYS_RANGE",
+      "SELECT day, vMin, vMax, vSum, vCount " \
+      "FROM dataDaily " \
+      "WHERE deviceId = :deviceId AND metric = :metric AND day >= :dayFrom AND day < :dayTo " \
+      "ORDER BY day;",
+      nullptr },
+};
+
+static_assert(sizeof(queries) / sizeof(queries[0]) == DatabaseQueries::QUERY_COUNT,
+              "DatabaseQueries: one definition per QueryId");
+
+/* ************************************************************************** */
+
+QString DatabaseQueries::get(QueryId id, bool mysql)
+{
+    if (id < 0 || id >= QUERY_COUNT) return QString();
+
+    const QueryDefinition &q = queries[id];
+    Q_ASSERT(q.id == id);
+
+    if (mysql && q.mysql) return QString::fromLatin1(q.mysql);
+    return QString::fromLatin1(q.sqlite);
+}
+
+QString DatabaseQueries::name(QueryId id)
+{
+    if (id < 0 || id >= QUERY_COUNT) return QString();
+
+    return QString::fromLatin1(queries[id].name);
+}
+
+QList <QStringList> DatabaseQueries::sampleArgs(QueryId id)
+{
+    QList <QStringList> args;
+
+    // The newest partitions (if any), only the statements matching the sensor layout in use are checked
+    DatabasePartitions *partitions = DatabasePartitions::getInstance();
+    bool narrow = (partitions->getSensorLayout() == DatabasePartitions::LAYOUT_NARROW);
+    const QStringList plantTables = partitions->tables("plantData");
+    const QStringList sensorTables = partitions->tables(narrow ? "sensorValues" : "sensorData");
+    QString plantData = plantTables.isEmpty() ? QString() : plantTables.last();
+    QString sensorData = sensorTables.isEmpty() ? QString() : sensorTables.last();
+
+    switch (id)
+    {
+    case VALUES_RANGE:
+        if (narrow && !sensorData.isEmpty()) args << QStringList{sensorData};
+        break;
+    case DATA_COUNT:
+        if (!plantData.isEmpty()) args << QStringList{plantData};
+        if (!sensorData.isEmpty()) args << QStringList{sensorData};
+        break;
+    case DATA_RANGE:
+        if (!plantData.isEmpty()) args << QStringList{plantData, "soilMoisture"};
+        if (!narrow && !sensorData.isEmpty()) args << QStringList{sensorData, "temperature"};
+        break;
+    default:
+        args << QStringList();
+        break;
+    }
+
+    return args;
+}
+
+bool DatabaseQueries::isBulkScan(QueryId id)
+{
+    switch (id)
+    {
+    case DEVICE_SELECT_ALL:         // startup, every saved device
+    case LATEST_VALUES_SELECT_ALL:  // startup, a few rows per device
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* ************************************************************************** */
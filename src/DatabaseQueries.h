@@ -0,0 +1,87 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DATABASE_QUERIES_H
+#define DATABASE_QUERIES_H
+/* ************************************************************************** */
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseQueries class
+ *
+ * Every statement issued by the Device classes, in one place, so they can
+ * all be checked with 'EXPLAIN QUERY PLAN' (see DatabaseManager::checkQueryPlans()).
+ * The ones without arguments are prepared once (see DatabaseManager::getStatement()).
+ *
+ * Some statements take table or column names, as %1 / %2 arguments.
+ * Data tables are monthly partitions (see DatabasePartitions), so the caller
+ * runs these for each partition of its time window.
+ */
+class DatabaseQueries
+{
+public:
+    enum QueryId {
+        DEVICE_SELECT_NAME = 0,
+        DEVICE_SELECT_INFOS,
+        DEVICE_SELECT_ALL,
+        DEVICE_INSERT,
+        DEVICE_DELETE,
+        DEVICE_UPDATE_LASTSYNC,
+        DEVICE_UPDATE,          //!< NULL values keep the column as is
+        DEVICEID_SELECT,
+
+        PLANTLIMITS_SELECT,
+        PLANTLIMITS_REPLACE,
+
+        LATEST_VALUES_SELECT,
+        LATEST_VALUES_SELECT_ALL,
+        LATEST_VALUES_UPSERT,
+
+        DATA_COUNT,             //!< %1: table
+
+        DATA_RANGE,             //!< %1: table, %2: column
+        VALUES_RANGE,           //!< %1: table (narrow layout)
+
+        ROLLUP_HOURS_RANGE,
+        ROLLUP_DAYS_RANGE,
+
+        QUERY_COUNT
+    };
+
+    //! SQL for a statement, in the SQLite or the MySQL dialect
+    static QString get(QueryId id, bool mysql = false);
+
+    static QString name(QueryId id);
+
+    //! The set(s) of %1 / %2 arguments to use when checking a statement
+    static QList <QStringList> sampleArgs(QueryId id);
+
+    //! Reads a whole (small) table on purpose, its full scan isn't an error
+    static bool isBulkScan(QueryId id);
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_QUERIES_H
@@ -0,0 +1,162 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseReadPool.h"
+
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QThread>
+#include <QDebug>
+
+#include <QSqlQuery>
+#include <QSqlError>
+
+/* ************************************************************************** */
+
+DatabaseReadPool::ReadConnection::~ReadConnection()
+{
+    // Runs in the thread that owned the connection, when it exits
+    {
+        QSqlDatabase db = QSqlDatabase::database(connectionName, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    if (pool)
+    {
+        QMutexLocker lock(&pool->m_mutex);
+        pool->m_connections--;
+    }
+}
+
+/* ************************************************************************** */
+
+void DatabaseReadPool::reset(const DatabaseConnectionInfos &infos)
+{
+    QMutexLocker lock(&m_mutex);
+
+    m_infos = infos;
+    m_generation++;
+}
+
+int DatabaseReadPool::connectionCount() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_connections;
+}
+
+QSqlDatabase DatabaseReadPool::database()
+{
+    // The GUI thread already has its connection
+    if (QThread::currentThread() == QCoreApplication::instance()->thread())
+        return QSqlDatabase::database();
+
+    int generation;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_infos.driver.isEmpty()) return QSqlDatabase();
+        generation = m_generation;
+    }
+
+    ReadConnection *rc = m_threadConnection.localData();
+    if (rc && rc->generation == generation)
+    {
+        return QSqlDatabase::database(rc->connectionName, false);
+    }
+
+    if (rc)
+    {
+        // The database has been reopened since, start over
+        m_threadConnection.setLocalData(nullptr); // deletes 'rc'
+    }
+
+    rc = new ReadConnection;
+    rc->pool = this;
+    rc->generation = generation;
+    rc->connectionName = "WatchFlower_read_" + QString::number(reinterpret_cast<quintptr>(QThread::currentThreadId()), 16) +
+                         "_" + QString::number(generation);
+    m_threadConnection.setLocalData(rc);
+
+    if (openConnection(rc->connectionName) == false)
+        return QSqlDatabase();
+
+    return QSqlDatabase::database(rc->connectionName, false);
+}
+
+bool DatabaseReadPool::openConnection(const QString &connectionName)
+{
+    DatabaseConnectionInfos infos;
+    {
+        QMutexLocker lock(&m_mutex);
+        infos = m_infos;
+
+        if (++m_connections > READ_POOL_MAX_CONNECTIONS)
+            qWarning() << "DatabaseReadPool:" << m_connections << "read connections opened";
+    }
+
+    QSqlDatabase db = QSqlDatabase::addDatabase(infos.driver, connectionName);
+    db.setDatabaseName(infos.databaseName);
+    if (!infos.hostName.isEmpty()) db.setHostName(infos.hostName);
+    if (infos.port > 0) db.setPort(infos.port);
+    if (!infos.userName.isEmpty()) db.setUserName(infos.userName);
+    if (!infos.password.isEmpty()) db.setPassword(infos.password);
+    if (infos.driver == "QMYSQL")
+    {
+        // Read only, no transaction to lose, so the client library can reconnect by itself
+        db.setConnectOptions(infos.connectOptions + (infos.connectOptions.isEmpty() ? "" : ";") + "MYSQL_OPT_RECONNECT=1");
+    }
+    else if (!infos.connectOptions.isEmpty())
+    {
+        db.setConnectOptions(infos.connectOptions);
+    }
+
+    if (db.open() == false)
+    {
+        qWarning() << "DatabaseReadPool cannot open database... Error:" << db.lastError();
+        return false;
+    }
+
+    for (const auto &pragma: qAsConst(infos.pragmas))
+    {
+        QSqlQuery p(db);
+        if (p.exec(pragma) == false)
+            qWarning() << "> pragma.exec() ERROR" << p.lastError().type() << ":" << p.lastError().text();
+    }
+
+    if (infos.driver == "QSQLITE")
+    {
+        // Not QSQLITE_OPEN_READONLY, a read only handle can't always open the WAL index
+        QSqlQuery queryOnly(db);
+        if (queryOnly.exec("PRAGMA query_only = ON") == false)
+            qWarning() << "> queryOnly.exec() ERROR" << queryOnly.lastError().type() << ":" << queryOnly.lastError().text();
+    }
+    else if (infos.driver == "QMYSQL")
+    {
+        // Read committed, so a long export doesn't pin an old snapshot
+        QSqlQuery isolation(db);
+        if (isolation.exec("SET SESSION TRANSACTION ISOLATION LEVEL READ COMMITTED, READ ONLY") == false)
+            qWarning() << "> isolation.exec() ERROR" << isolation.lastError().type() << ":" << isolation.lastError().text();
+    }
+
+    return true;
+}
+
+/* ************************************************************************** */
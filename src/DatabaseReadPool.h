@@ -0,0 +1,81 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+
+#ifndef DATABASE_READ_POOL_H
+#define DATABASE_READ_POOL_H
+/* ************************************************************************** */
+
+#include "DatabaseWriter.h"
+
+#include <QString>
+#include <QMutex>
+#include <QThreadStorage>
+#include <QSqlDatabase>
+
+#define READ_POOL_MAX_CONNECTIONS   8   // warn past that, connections are per thread
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseReadPool class
+ *
+ * One read only connection per thread, opened on first use and closed when its
+ * thread exits. With SQLite in WAL mode these readers don't wait on the
+ * DatabaseWriter, nor on each other, so charts and exports can be computed on
+ * worker threads. The GUI thread keeps using the default connection.
+ *
+ * Thread safe.
+ */
+class DatabaseReadPool
+{
+    struct ReadConnection
+    {
+        DatabaseReadPool *pool = nullptr;
+        QString connectionName;
+        int generation = 0;
+        ~ReadConnection();
+    };
+
+    mutable QMutex m_mutex;
+    DatabaseConnectionInfos m_infos;
+    int m_generation = 0;       //!< Bumped on every reset, older connections get reopened
+    int m_connections = 0;      //!< Opened and not destroyed yet, whatever their generation
+
+    QThreadStorage <ReadConnection *> m_threadConnection;
+
+    bool openConnection(const QString &connectionName);
+
+public:
+    DatabaseReadPool() = default;
+    ~DatabaseReadPool() = default;
+
+    //! Connection infos of the database in use, or nothing to disable the pool
+    void reset(const DatabaseConnectionInfos &infos = DatabaseConnectionInfos());
+
+    //! The calling thread's read connection (invalid if no database is open)
+    QSqlDatabase database();
+
+    int connectionCount() const;
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_READ_POOL_H
@@ -0,0 +1,337 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseSeries.h"
+#include "DatabaseManager.h"
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QMutexLocker>
+#include <QDateTime>
+
+#include <algorithm>
+#include <limits>
+
+/* ************************************************************************** */
+
+QString SeriesQuery::key() const
+{
+    QStringList m;
+    for (quint32 metric: metrics) m += QString::number(metric);
+
+    return deviceAddrs.join(',') + "|" + QString::number(table) + "|" + m.join(',') + "|" +
+           QString::number(tsFrom) + "|" + QString::number(tsTo) + "|" +
+           QString::number(bucket) + "|" + QString::number(aggregators);
+}
+
+QString SeriesResult::seriesKey(const QString &deviceAddr, quint32 metric, int aggregator)
+{
+    return deviceAddr + "/" + QString::number(metric) + "/" + QString::number(aggregator);
+}
+
+QVector <float> SeriesResult::values(const QString &deviceAddr, quint32 metric, int aggregator) const
+{
+    return series.value(seriesKey(deviceAddr, metric, aggregator));
+}
+
+/* ************************************************************************** */
+
+DatabaseSeries *DatabaseSeries::instance = nullptr;
+
+DatabaseSeries *DatabaseSeries::getInstance()
+{
+    if (instance == nullptr)
+    {
+        instance = new DatabaseSeries();
+    }
+
+    return instance;
+}
+
+DatabaseSeries::DatabaseSeries()
+{
+    int cacheSize = SERIES_CACHE_SIZE;
+
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+    if (settings.status() == QSettings::NoError && settings.contains("database/seriesCacheSize"))
+        cacheSize = settings.value("database/seriesCacheSize").toInt();
+
+    m_cache.setMaxCost(std::max(cacheSize, 0) * 1024);
+}
+
+int DatabaseSeries::cost(const SeriesResult &r)
+{
+    int bytes = sizeof(SeriesResult) + r.buckets.size() * sizeof(qint64);
+    for (auto it = r.series.constBegin(); it != r.series.constEnd(); ++it)
+    {
+        bytes += it.key().size() * sizeof(QChar) + it.value().size() * sizeof(float);
+    }
+
+    return bytes;
+}
+
+/* ************************************************************************** */
+
+int DatabaseSeries::resolution(const SeriesQuery &q)
+{
+    if (q.bucket == SeriesQuery::BUCKET_HOUR) return DatabaseBackend::RESOLUTION_HOUR;
+    if (q.bucket == SeriesQuery::BUCKET_DAY) return DatabaseBackend::RESOLUTION_DAY;
+
+    // BUCKET_ALL: hourly rollups for the short ranges, they're more precise at both ends
+    return (q.tsTo - q.tsFrom > SERIES_HOURLY_RANGE) ? DatabaseBackend::RESOLUTION_DAY
+                                                     : DatabaseBackend::RESOLUTION_HOUR;
+}
+
+void DatabaseSeries::align(SeriesQuery &q)
+{
+    // On the rollups buckets, which also makes the cache keys stable
+    if (q.bucket == SeriesQuery::BUCKET_RAW) return;
+
+    if (resolution(q) == DatabaseBackend::RESOLUTION_DAY)
+    {
+        q.tsFrom = QDateTime(QDateTime::fromSecsSinceEpoch(q.tsFrom).date(), QTime(0, 0)).toSecsSinceEpoch();
+        q.tsTo = QDateTime(QDateTime::fromSecsSinceEpoch(q.tsTo - 1).date().addDays(1), QTime(0, 0)).toSecsSinceEpoch();
+    }
+    else
+    {
+        q.tsFrom -= q.tsFrom % 3600;
+        if (q.tsTo % 3600) q.tsTo += 3600 - q.tsTo % 3600;
+    }
+}
+
+QVector <qint64> DatabaseSeries::buckets(const SeriesQuery &q)
+{
+    QVector <qint64> b;
+
+    if (q.bucket == SeriesQuery::BUCKET_ALL)
+    {
+        b += q.tsFrom;
+    }
+    else if (q.bucket == SeriesQuery::BUCKET_DAY)
+    {
+        // Local days aren't always 24h long
+        for (QDate d = QDateTime::fromSecsSinceEpoch(q.tsFrom).date(); ; d = d.addDays(1))
+        {
+            qint64 ts = QDateTime(d, QTime(0, 0)).toSecsSinceEpoch();
+            if (ts >= q.tsTo) break;
+            b += ts;
+        }
+    }
+    else if (q.bucket == SeriesQuery::BUCKET_HOUR)
+    {
+        for (qint64 ts = q.tsFrom; ts < q.tsTo; ts += 3600) b += ts;
+    }
+
+    return b;
+}
+
+/* ************************************************************************** */
+
+SeriesResult DatabaseSeries::query(SeriesQuery q)
+{
+    DatabaseBackend *backend = DatabaseManager::getInstance()->getBackend();
+    if (!backend || q.deviceAddrs.isEmpty() || q.metrics.isEmpty() || q.tsTo <= q.tsFrom) return SeriesResult();
+
+    align(q);
+
+    // Raw results depend on the exact time range, not worth caching
+    if (q.bucket == SeriesQuery::BUCKET_RAW) return runRaw(backend, q);
+
+    const QString key = q.key();
+    quint64 gen = 0;
+    {
+        QMutexLocker lock(&m_cacheMutex);
+        SeriesResult *cached = m_cache.object(key);
+        if (cached)
+        {
+            m_hits++;
+            return *cached;
+        }
+        m_misses++;
+        gen = generation(q.deviceAddrs);
+    }
+
+    SeriesResult r = runBuckets(backend, q);
+
+    {
+        QMutexLocker lock(&m_cacheMutex);
+        if (gen == generation(q.deviceAddrs) && m_cache.maxCost() > 0)
+        {
+            // Evicts the least recently used results if needed
+            m_cache.insert(key, new SeriesResult(r), cost(r));
+        }
+    }
+
+    return r;
+}
+
+quint64 DatabaseSeries::generation(const QStringList &deviceAddrs) const
+{
+    // They only ever go up, so the sum changes as soon as one of them does
+    quint64 gen = m_generation;
+    for (const auto &addr: deviceAddrs) gen += m_generations.value(addr);
+
+    return gen;
+}
+
+void DatabaseSeries::invalidate()
+{
+    QMutexLocker lock(&m_cacheMutex);
+
+    m_cache.clear();
+    m_generation++;
+}
+
+void DatabaseSeries::invalidate(const QStringList &deviceAddrs)
+{
+    QMutexLocker lock(&m_cacheMutex);
+
+    // The devices are the first part of the keys, see SeriesQuery::key()
+    const QStringList keys = m_cache.keys();
+    for (const auto &key: keys)
+    {
+        const QStringList addrs = key.section('|', 0, 0).split(',');
+        for (const auto &addr: deviceAddrs)
+        {
+            if (addrs.contains(addr))
+            {
+                m_cache.remove(key);
+                break;
+            }
+        }
+    }
+
+    for (const auto &addr: deviceAddrs) m_generations[addr]++;
+}
+
+QVariantMap DatabaseSeries::cacheStats()
+{
+    QMutexLocker lock(&m_cacheMutex);
+
+    return QVariantMap{{"hits", m_hits}, {"misses", m_misses}, {"entries", m_cache.count()},
+                       {"size", m_cache.totalCost()}, {"maxSize", m_cache.maxCost()}};
+}
+
+/* ************************************************************************** */
+
+SeriesResult DatabaseSeries::runRaw(DatabaseBackend *backend, const SeriesQuery &q)
+{
+    SeriesResult r;
+
+    // Buckets are the union of the readings timestamps
+    QList <QPair <QString, QList <DataPoint>>> series;
+    for (const auto &addr: q.deviceAddrs)
+    {
+        for (quint32 metric: q.metrics)
+        {
+            const QList <DataPoint> points = backend->range(addr, q.table, metric, q.tsFrom, q.tsTo);
+            for (const auto &p: points) r.buckets += p.ts;
+
+            series += qMakePair(SeriesResult::seriesKey(addr, metric, SeriesQuery::AGG_AVG), points);
+        }
+    }
+
+    std::sort(r.buckets.begin(), r.buckets.end());
+    r.buckets.erase(std::unique(r.buckets.begin(), r.buckets.end()), r.buckets.end());
+
+    for (const auto &s: qAsConst(series))
+    {
+        QVector <float> values(r.buckets.size(), std::numeric_limits<float>::quiet_NaN());
+
+        // Both are sorted
+        int i = 0;
+        for (const auto &p: s.second)
+        {
+            while (r.buckets.at(i) < p.ts) i++;
+            values[i] = p.value;
+        }
+
+        r.series.insert(s.first, values);
+    }
+
+    return r;
+}
+
+SeriesResult DatabaseSeries::runBuckets(DatabaseBackend *backend, const SeriesQuery &q)
+{
+    SeriesResult r;
+    r.buckets = buckets(q);
+
+    const int aggregators[] = { SeriesQuery::AGG_MIN, SeriesQuery::AGG_MAX, SeriesQuery::AGG_AVG,
+                                SeriesQuery::AGG_SUM, SeriesQuery::AGG_COUNT };
+    int res = resolution(q);
+
+    for (const auto &addr: q.deviceAddrs)
+    {
+        for (quint32 metric: q.metrics)
+        {
+            const QList <DataAggregate> rollups = backend->aggregate(addr, q.table, metric, q.tsFrom, q.tsTo, res);
+
+            // Rollups > buckets (several of them for BUCKET_ALL)
+            QVector <DataAggregate> acc(r.buckets.size());
+            for (const auto &a: rollups)
+            {
+                if (a.count <= 0 || a.ts < q.tsFrom || a.ts >= q.tsTo) continue;
+
+                int i = static_cast<int>(std::upper_bound(r.buckets.begin(), r.buckets.end(), a.ts) - r.buckets.begin()) - 1;
+                if (i < 0) continue;
+
+                DataAggregate &b = acc[i];
+                if (b.count == 0)
+                {
+                    b = a;
+                    b.ts = r.buckets.at(i);
+                }
+                else
+                {
+                    b.min = std::min(b.min, a.min);
+                    b.max = std::max(b.max, a.max);
+                    b.sum += a.sum;
+                    b.count += a.count;
+                }
+            }
+
+            for (int agg: aggregators)
+            {
+                if (!(q.aggregators & agg)) continue;
+
+                QVector <float> values(acc.size(), std::numeric_limits<float>::quiet_NaN());
+                for (int i = 0; i < acc.size(); i++)
+                {
+                    const DataAggregate &b = acc.at(i);
+                    if (b.count == 0) continue;
+
+                    if (agg == SeriesQuery::AGG_MIN) values[i] = b.min;
+                    else if (agg == SeriesQuery::AGG_MAX) values[i] = b.max;
+                    else if (agg == SeriesQuery::AGG_AVG) values[i] = b.avg();
+                    else if (agg == SeriesQuery::AGG_SUM) values[i] = static_cast<float>(b.sum);
+                    else if (agg == SeriesQuery::AGG_COUNT) values[i] = b.count;
+                }
+
+                r.series.insert(SeriesResult::seriesKey(addr, metric, agg), values);
+            }
+        }
+    }
+
+    return r;
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,145 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DATABASE_SERIES_H
+#define DATABASE_SERIES_H
+/* ************************************************************************** */
+
+#include "DatabaseBackend.h"
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QCache>
+#include <QMutex>
+#include <QVariantMap>
+
+#include <cmath>
+
+#define SERIES_HOURLY_RANGE     (35*24*3600)    // s, longer BUCKET_ALL ranges use the daily rollups
+#define SERIES_CACHE_SIZE       4096            // KiB of cached results, unless "database/seriesCacheSize" says otherwise
+
+/* ************************************************************************** */
+
+/*!
+ * \brief A time series query: devices, metrics, time range, bucket size, aggregators.
+ */
+struct SeriesQuery
+{
+    enum Bucket {
+        BUCKET_RAW          = 0,    //!< No bucketing, one bucket per reading timestamp
+        BUCKET_HOUR         = 1,    //!< UTC hours, like the hourly rollups
+        BUCKET_DAY          = 2,    //!< Local days, like the daily rollups
+        BUCKET_ALL          = 3,    //!< The whole range, as a single bucket
+    };
+
+    enum Aggregator {
+        AGG_MIN             = (1 << 0),
+        AGG_MAX             = (1 << 1),
+        AGG_AVG             = (1 << 2),
+        AGG_SUM             = (1 << 3),
+        AGG_COUNT           = (1 << 4),
+    };
+
+    QStringList deviceAddrs;
+    int table = DeviceReading::TABLE_PLANTDATA;
+    QList <quint32> metrics;        //!< DeviceUtils::DeviceSensors bits
+    qint64 tsFrom = 0;              //!< UTC epoch (seconds), [tsFrom, tsTo[
+    qint64 tsTo = 0;
+    int bucket = BUCKET_DAY;
+    int aggregators = AGG_AVG;      //!< Aggregator bitfield (BUCKET_RAW only has the values)
+
+    QString key() const;
+};
+
+/*!
+ * \brief Dense result of a SeriesQuery: one value per bucket, for each (device, metric, aggregator).
+ */
+struct SeriesResult
+{
+    QVector <qint64> buckets;       //!< Start of each bucket (UTC epoch), oldest first
+    QHash <QString, QVector <float>> series;
+
+    static QString seriesKey(const QString &deviceAddr, quint32 metric, int aggregator);
+
+    //! One value per bucket, NaN where there is no data (empty if it wasn't queried)
+    QVector <float> values(const QString &deviceAddr, quint32 metric,
+                           int aggregator = SeriesQuery::AGG_AVG) const;
+
+    static bool isEmpty(float value) { return std::isnan(value); }
+};
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseSeries class
+ *
+ * The query engine behind the charts. Queries go through the DatabaseBackend
+ * (rollups for the buckets, raw readings otherwise), so they work the same
+ * with every storage engine. Gaps are filled here: every bucket of the
+ * (aligned) range is in the result, with NaN where there is no data.
+ *
+ * Bucketed results are kept in a LRU cache, bounded in memory ("database/seriesCacheSize",
+ * in KiB, 0 to disable it). New readings only drop the results of their own devices.
+ * Thread safe.
+ */
+class DatabaseSeries
+{
+    // Singleton
+    static DatabaseSeries *instance;
+    DatabaseSeries();
+
+    QMutex m_cacheMutex;
+    QCache <QString, SeriesResult> m_cache;     //!< query key > result, cost in bytes
+    // Bumped on invalidate(), so a result computed while its devices got new data isn't cached
+    quint64 m_generation = 0;
+    QHash <QString, quint64> m_generations;     //!< deviceAddr > generation
+    quint64 generation(const QStringList &deviceAddrs) const;
+    quint64 m_hits = 0;
+    quint64 m_misses = 0;
+
+    static int cost(const SeriesResult &r);
+
+    static int resolution(const SeriesQuery &q);
+    static void align(SeriesQuery &q);
+    static QVector <qint64> buckets(const SeriesQuery &q);
+
+    static SeriesResult runRaw(DatabaseBackend *backend, const SeriesQuery &q);
+    static SeriesResult runBuckets(DatabaseBackend *backend, const SeriesQuery &q);
+
+public:
+    static DatabaseSeries *getInstance();
+
+    SeriesResult query(SeriesQuery q);
+
+    //! Drop the cached results (database closed...)
+    void invalidate();
+    //! Drop the cached results involving these devices (new readings, retention, device removed...)
+    void invalidate(const QStringList &deviceAddrs);
+
+    //! hits, misses, entries, size and maxSize (bytes)
+    QVariantMap cacheStats();
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_SERIES_H
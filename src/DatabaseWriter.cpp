@@ -0,0 +1,1314 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#include "DatabaseWriter.h"
+#include "DatabasePartitions.h"
+#include "DatabaseQueries.h"
+
+#include <QMutexLocker>
+#include <QDateTime>
+#include <QVariant>
+#include <QDebug>
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+/* ************************************************************************** */
+
+struct ReadingColumn
+{
+    quint32 metric;
+    const char *column;
+};
+
+static const ReadingColumn plantDataColumns[] = {
+    { DeviceUtils::SENSOR_SOIL_MOISTURE,        "soilMoisture" },
+    { DeviceUtils::SENSOR_SOIL_CONDUCTIVITY,    "soilConductivity" },
+    { DeviceUtils::SENSOR_SOIL_TEMPERATURE,     "soilTemperature" },
+    { DeviceUtils::SENSOR_SOIL_PH,              "soilPH" },
+    { DeviceUtils::SENSOR_TEMPERATURE,          "temperature" },
+    { DeviceUtils::SENSOR_HUMIDITY,             "humidity" },
+    { DeviceUtils::SENSOR_LUMINOSITY,           "luminosity" },
+    { DeviceUtils::SENSOR_WATER_LEVEL,          "watertank" },
+};
+
+static const ReadingColumn sensorDataColumns[] = {
+    { DeviceUtils::SENSOR_TEMPERATURE,          "temperature" },
+    { DeviceUtils::SENSOR_HUMIDITY,             "humidity" },
+    { DeviceUtils::SENSOR_PRESSURE,             "pressure" },
+    { DeviceUtils::SENSOR_LUMINOSITY,           "luminosity" },
+    { DeviceUtils::SENSOR_UV,                   "uv" },
+    { DeviceUtils::SENSOR_SOUND,                "sound" },
+    { DeviceUtils::SENSOR_WATER_LEVEL,          "water" },
+    { DeviceUtils::SENSOR_WIND_DIRECTION,       "windDirection" },
+    { DeviceUtils::SENSOR_WIND_SPEED,           "windSpeed" },
+    { DeviceUtils::SENSOR_PM1,                  "pm1" },
+    { DeviceUtils::SENSOR_PM25,                 "pm25" },
+    { DeviceUtils::SENSOR_PM10,                 "pm10" },
+    { DeviceUtils::SENSOR_O2,                   "o2" },
+    { DeviceUtils::SENSOR_O3,                   "o3" },
+    { DeviceUtils::SENSOR_CO,                   "co" },
+    { DeviceUtils::SENSOR_CO2,                  "co2" },
+    { DeviceUtils::SENSOR_NO2,                  "no2" },
+    { DeviceUtils::SENSOR_SO2,                  "so2" },
+    { DeviceUtils::SENSOR_VOC,                  "voc" },
+    { DeviceUtils::SENSOR_HCHO,                 "hcho" },
+    { DeviceUtils::SENSOR_GEIGER,               "geiger" },
+};
+
+QList <QPair <quint32, QString>> DatabaseWriter::columns(DeviceReading::ReadingTable table)
+{
+    QList <QPair <quint32, QString>> cols;
+
+    if (table == DeviceReading::TABLE_PLANTDATA)
+    {
+        for (const auto &c: plantDataColumns) cols << qMakePair(c.metric, QString(c.column));
+    }
+    else if (table == DeviceReading::TABLE_SENSORDATA)
+    {
+        for (const auto &c: sensorDataColumns) cols << qMakePair(c.metric, QString(c.column));
+    }
+
+    return cols;
+}
+
+quint32 DatabaseWriter::columnMetric(DeviceReading::ReadingTable table, const QString &column)
+{
+    const auto cols = columns(table);
+    for (const auto &c: cols)
+    {
+        if (c.second == column) return c.first;
+    }
+
+    return 0;
+}
+
+/* ************************************************************************** */
+
+DatabaseWriter::DatabaseWriter(const DatabaseConnectionInfos &infos, QObject *parent) : QObject(parent)
+{
+    m_infos = infos;
+    m_connectionName = "WatchFlower_writer";
+
+    if (!m_infos.journalFile.isEmpty())
+    {
+        // Readings that didn't make it into the database last time go first
+        m_journal = new DatabaseJournal(m_infos.journalFile);
+        m_queue = m_journal->open();
+
+        if (!m_queue.isEmpty())
+            qInfo() << "DatabaseWriter: replaying" << m_queue.size() << "readings from the journal";
+    }
+}
+
+DatabaseWriter::~DatabaseWriter()
+{
+    delete m_journal;
+}
+
+/* ************************************************************************** */
+
+void DatabaseWriter::start()
+{
+    // This runs in the writer thread, so the connection belongs to the writer thread
+    QSqlDatabase db = QSqlDatabase::addDatabase(m_infos.driver, m_connectionName);
+    db.setDatabaseName(m_infos.databaseName);
+    if (!m_infos.hostName.isEmpty()) db.setHostName(m_infos.hostName);
+    if (m_infos.port > 0) db.setPort(m_infos.port);
+    if (!m_infos.userName.isEmpty()) db.setUserName(m_infos.userName);
+    if (!m_infos.password.isEmpty()) db.setPassword(m_infos.password);
+    if (!m_infos.connectOptions.isEmpty()) db.setConnectOptions(m_infos.connectOptions);
+
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, &QTimer::timeout, this, &DatabaseWriter::reconnect);
+
+    if (openConnection())
+    {
+        if (m_infos.driver == "QSQLITE")
+        {
+            m_maintenance = new DatabaseMaintenance(m_connectionName, m_infos.databaseName, this);
+        }
+    }
+    else
+    {
+        connectionLost(QList <DeviceReading>(), QList <QPair <QString, QDateTime>>());
+    }
+
+    m_flushTimer = new QTimer(this);
+    connect(m_flushTimer, &QTimer::timeout, this, &DatabaseWriter::flush);
+    m_flushTimer->start(WRITER_FLUSH_INTERVAL);
+
+    if (m_infos.walCheckpointInterval > 0)
+    {
+        m_checkpointTimer = new QTimer(this);
+        connect(m_checkpointTimer, &QTimer::timeout, this, &DatabaseWriter::checkpoint);
+        m_checkpointTimer->start(m_infos.walCheckpointInterval * 1000);
+    }
+
+    if (m_journal)
+    {
+        m_journalTimer = new QTimer(this);
+        connect(m_journalTimer, &QTimer::timeout, this, &DatabaseWriter::syncJournal);
+        m_journalTimer->start(JOURNAL_SYNC_INTERVAL);
+
+        // Replayed readings
+        flush();
+    }
+
+    // First retention run shortly after startup, so it never delays it
+    m_retentionTimer = new QTimer(this);
+    m_retentionTimer->setSingleShot(true);
+    connect(m_retentionTimer, &QTimer::timeout, this, &DatabaseWriter::retention);
+    m_retentionTimer->start(RETENTION_STARTUP_DELAY * 1000);
+}
+
+bool DatabaseWriter::openConnection()
+{
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+
+    if (db.open())
+    {
+        for (const auto &pragma: qAsConst(m_infos.pragmas))
+        {
+            QSqlQuery p(db);
+            if (p.exec(pragma) == false)
+                qWarning() << "> pragma.exec() ERROR" << p.lastError().type() << ":" << p.lastError().text();
+        }
+
+        // Data and hourly rollups statements are prepared on first use, for each partition
+        // (see addDataQuery() and addHourlyQuery())
+        m_deleteHourly = QSqlQuery(db);
+        m_deleteHourly.prepare("DELETE FROM dataHourly WHERE deviceId = :deviceId AND metric = :metric AND ts = :ts");
+
+        m_deleteDaily = QSqlQuery(db);
+        m_deleteDaily.prepare("DELETE FROM dataDaily WHERE deviceId = :deviceId AND metric = :metric AND day = :day");
+
+        m_updateLastSync = QSqlQuery(db);
+        m_updateLastSync.prepare(DatabaseQueries::get(DatabaseQueries::DEVICE_UPDATE_LASTSYNC, m_infos.driver == "QMYSQL"));
+
+        m_updateLatest = QSqlQuery(db);
+        if (m_updateLatest.prepare(DatabaseQueries::get(DatabaseQueries::LATEST_VALUES_UPSERT, m_infos.driver == "QMYSQL")) == false)
+            qWarning() << "> updateLatest.prepare() ERROR" << m_updateLatest.lastError().type() << ":" << m_updateLatest.lastError().text();
+
+        m_addDaily = QSqlQuery(db);
+        if (m_addDaily.prepare("INSERT INTO dataDaily (deviceId, day, metric, vMin, vMax, vSum, vCount)" \
+                               " SELECT deviceId, :day, metric, min(vMin), max(vMax), sum(vSum), sum(vCount)" \
+                               " FROM dataHourly" \
+                               " WHERE deviceId = :deviceId AND metric = :metric AND ts >= :tsFrom AND ts < :tsTo" \
+                               " GROUP BY deviceId, metric") == false)
+            qWarning() << "> addDaily.prepare() ERROR" << m_addDaily.lastError().type() << ":" << m_addDaily.lastError().text();
+
+        // One hourly rollup merged into an existing daily one
+        QString mergeDaily = "INSERT INTO dataDaily (deviceId, day, metric, vMin, vMax, vSum, vCount)" \
+                             " SELECT deviceId, :day, metric, vMin, vMax, vSum, vCount" \
+                             " FROM dataHourly" \
+                             " WHERE deviceId = :deviceId AND metric = :metric AND ts = :ts";
+        if (m_infos.driver == "QMYSQL")
+            mergeDaily += " ON DUPLICATE KEY UPDATE vMin = LEAST(dataDaily.vMin, VALUES(vMin)), vMax = GREATEST(dataDaily.vMax, VALUES(vMax))," \
+                          " vSum = dataDaily.vSum + VALUES(vSum), vCount = dataDaily.vCount + VALUES(vCount)";
+        else
+            mergeDaily += " ON CONFLICT(deviceId, metric, day) DO UPDATE SET vMin = min(dataDaily.vMin, excluded.vMin), vMax = max(dataDaily.vMax, excluded.vMax)," \
+                          " vSum = dataDaily.vSum + excluded.vSum, vCount = dataDaily.vCount + excluded.vCount";
+
+        m_mergeDaily = QSqlQuery(db);
+        if (m_mergeDaily.prepare(mergeDaily) == false)
+            qWarning() << "> mergeDaily.prepare() ERROR" << m_mergeDaily.lastError().type() << ":" << m_mergeDaily.lastError().text();
+
+        return true;
+    }
+
+    qWarning() << "DatabaseWriter cannot open database... Error:" << db.lastError();
+    return false;
+}
+
+void DatabaseWriter::connectionLost(const QList <DeviceReading> &batch, const QList <QPair <QString, QDateTime>> &historySyncs)
+{
+    // Back in the queue, in front of what came in since, the journal still has them
+    {
+        QMutexLocker lock(&m_queueMutex);
+        m_queue = batch + m_queue;
+        m_historySyncs = historySyncs + m_historySyncs;
+    }
+    m_deviceIds.clear(); // may contain rolled back ids
+
+    if (m_offline) return;
+    m_offline = true;
+
+    qWarning() << "DatabaseWriter: database connection lost, buffering the readings until it's back";
+    m_reconnectDelay = WRITER_RECONNECT_MIN;
+    m_reconnectTimer->start(m_reconnectDelay * 1000);
+}
+
+void DatabaseWriter::reconnect()
+{
+    // Statements are tied to the connection
+    m_addData.clear();
+    m_addHourly.clear();
+    m_deleteHourly = QSqlQuery();
+    m_addDaily = QSqlQuery();
+    m_deleteDaily = QSqlQuery();
+    m_mergeDaily = QSqlQuery();
+    m_updateLastSync = QSqlQuery();
+    m_updateLatest = QSqlQuery();
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+        db.close();
+    }
+
+    if (openConnection())
+    {
+        m_offline = false;
+        {
+            QMutexLocker lock(&m_queueMutex);
+            qInfo() << "DatabaseWriter: database connection is back," << m_queue.size() << "readings buffered";
+        }
+        flush();
+    }
+    else
+    {
+        m_reconnectDelay = qMin(m_reconnectDelay * 2, WRITER_RECONNECT_MAX);
+        m_reconnectTimer->start(m_reconnectDelay * 1000);
+    }
+}
+
+void DatabaseWriter::stop()
+{
+    if (m_flushTimer) m_flushTimer->stop();
+    if (m_checkpointTimer) m_checkpointTimer->stop();
+    if (m_journalTimer) m_journalTimer->stop();
+    if (m_retentionTimer) m_retentionTimer->stop();
+    if (m_reconnectTimer) m_reconnectTimer->stop();
+    m_retentionTasks.clear();
+    if (m_maintenance) m_maintenance->setIdle(false);
+
+    // Write everything that's still in the queue
+    flush();
+    compactJournal();
+
+    // Leave an empty WAL file behind us
+    if (m_infos.walCheckpointInterval > 0)
+    {
+        QSqlQuery ckpt(QSqlDatabase::database(m_connectionName, false));
+        ckpt.exec("PRAGMA wal_checkpoint(TRUNCATE)");
+    }
+
+    m_addData.clear();
+    m_addHourly.clear();
+    m_deleteHourly = QSqlQuery();
+    m_addDaily = QSqlQuery();
+    m_deleteDaily = QSqlQuery();
+    m_mergeDaily = QSqlQuery();
+    m_updateLastSync = QSqlQuery();
+    m_updateLatest = QSqlQuery();
+    m_deviceIds.clear();
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+/* ************************************************************************** */
+
+void DatabaseWriter::enqueue(const DeviceReading &reading)
+{
+    QMutexLocker lock(&m_queueMutex);
+
+    if (m_journal) m_journal->append(reading);
+    m_queue.push_back(reading);
+
+    if (m_queue.size() >= WRITER_BATCH_SIZE && !m_flushRequested)
+    {
+        m_flushRequested = true;
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+    }
+}
+
+void DatabaseWriter::endHistorySession(const QString &deviceAddr, const QDateTime &lastSync)
+{
+    QMutexLocker lock(&m_queueMutex);
+
+    // The session readings are already queued, so they end up in the same
+    // transaction as the lastSync update, or in an earlier one
+    m_historySyncs.push_back(qMakePair(deviceAddr, lastSync));
+
+    if (!m_flushRequested)
+    {
+        m_flushRequested = true;
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+    }
+}
+
+void DatabaseWriter::flush()
+{
+    QList <DeviceReading> batch;
+    QList <QPair <QString, QDateTime>> historySyncs;
+    {
+        QMutexLocker lock(&m_queueMutex);
+        m_flushRequested = false;
+        if (m_offline) return; // see reconnect()
+
+        batch.swap(m_queue);
+        historySyncs.swap(m_historySyncs);
+    }
+
+    if (batch.isEmpty() && historySyncs.isEmpty()) return;
+
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isOpen())
+    {
+        connectionLost(batch, historySyncs);
+        return;
+    }
+
+    if (writeBatch(batch, historySyncs, retentionRawCutoff()))
+    {
+        m_batchRetries = 0;
+
+        bool compact = false;
+        {
+            // enqueue() appends to the journal from the GUI thread
+            QMutexLocker lock(&m_queueMutex);
+            compact = (m_journal && m_journal->size() >= JOURNAL_COMPACT_SIZE);
+        }
+        if (compact) compactJournal();
+    }
+    else
+    {
+        // Not our data, the server is gone: keep the batch for later
+        if (connectionAlive() == false)
+            connectionLost(batch, historySyncs);
+        else
+            batchFailed(batch, historySyncs);
+    }
+}
+
+bool DatabaseWriter::connectionAlive()
+{
+    QSqlQuery ping(QSqlDatabase::database(m_connectionName));
+    return ping.exec("SELECT 1");
+}
+
+void DatabaseWriter::batchFailed(const QList <DeviceReading> &batch, const QList <QPair <QString, QDateTime>> &historySyncs)
+{
+    if (m_batchRetries < WRITER_BATCH_RETRIES)
+    {
+        // Back in the queue (like connectionLost() does), for the next flush
+        m_batchRetries++;
+        qWarning() << "DatabaseWriter: batch of" << batch.size() << "readings failed, retry" << m_batchRetries << "/" << WRITER_BATCH_RETRIES;
+
+        QMutexLocker lock(&m_queueMutex);
+        m_queue = batch + m_queue;
+        m_historySyncs = historySyncs + m_historySyncs;
+        return;
+    }
+
+    // Don't let a single bad reading hold everything that comes after it
+    m_batchRetries = 0;
+    qint64 rawCutoff = retentionRawCutoff();
+    int dropped = 0;
+
+    // Writing a reading twice is harmless (REPLACE, and the rollups are rebuilt),
+    // so if the server goes away in the middle, the whole batch is kept for later
+    if (writeIsolated(batch, rawCutoff, dropped) == false)
+    {
+        connectionLost(batch, historySyncs);
+        return;
+    }
+    qWarning() << "DatabaseWriter: batch of" << batch.size() << "readings written in parts," << dropped << "readings dropped";
+
+    // The history sessions are done, whatever happened to some of their readings
+    if (!historySyncs.isEmpty() && !writeBatch(QList <DeviceReading>(), historySyncs, rawCutoff))
+    {
+        if (connectionAlive() == false)
+        {
+            connectionLost(QList <DeviceReading>(), historySyncs);
+        }
+        else
+        {
+            QMutexLocker lock(&m_queueMutex);
+            m_historySyncs = historySyncs + m_historySyncs;
+        }
+    }
+}
+
+/*!
+ * \brief Write the readings in halves, down to single readings, dropping the ones that still fail.
+ * \return false if the connection was lost.
+ */
+bool DatabaseWriter::writeIsolated(const QList <DeviceReading> &readings, qint64 rawCutoff, int &dropped)
+{
+    if (readings.isEmpty() || writeBatch(readings, QList <QPair <QString, QDateTime>>(), rawCutoff)) return true;
+    if (connectionAlive() == false) return false;
+
+    if (readings.size() == 1)
+    {
+        const DeviceReading &r = readings.first();
+        qWarning() << "DatabaseWriter: dropping reading" << r.deviceAddr << r.timestamp << "metrics" << r.metrics;
+        dropped++;
+        return true;
+    }
+
+    int half = readings.size() / 2;
+    return writeIsolated(readings.mid(0, half), rawCutoff, dropped) &&
+           writeIsolated(readings.mid(half), rawCutoff, dropped);
+}
+
+bool DatabaseWriter::importReadings(const QList <DeviceReading> &batch)
+{
+    if (m_offline) return false;
+
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isOpen()) return false;
+
+    // No raw cutoff: readings older than the raw retention still make their
+    // rollups, and the next retention run drops them
+    return writeBatch(batch, QList <QPair <QString, QDateTime>>(), 0);
+}
+
+bool DatabaseWriter::writeBatch(const QList <DeviceReading> &batch,
+                                const QList <QPair <QString, QDateTime>> &historySyncs, qint64 rawCutoff)
+{
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+
+    QStringList deviceAddrs;
+    QMap <RollupHour, quint32> hours;
+    QHash <LatestKey, QPair <qint64, float>> latest;
+
+    QList <const DeviceReading *> readings;
+    for (const auto &r: qAsConst(batch))
+    {
+        // Older than what we keep (late history sync), it would only spoil the rollups
+        if (r.timestamp.toSecsSinceEpoch() < rawCutoff) continue;
+
+        readings += &r;
+    }
+
+    // Partitions are created outside of the batch transaction, a rollback can't undo them
+    // Only for the readings we keep, an old partition would be dropped by the next retention run
+    DatabasePartitions *partitions = DatabasePartitions::getInstance();
+    for (const DeviceReading *r: qAsConst(readings))
+    {
+        partitions->ensure(db, partitions->baseTable(r->table), r->roundedTimestamp().toSecsSinceEpoch());
+    }
+
+    db.transaction();
+
+    // All or nothing, a failed reading fails (and rolls back) the whole batch
+    bool status = true;
+    if (m_infos.driver == "QMYSQL")
+    {
+        // A round trip per statement, so as few statements as possible
+        status = writeReadings(readings);
+    }
+    else
+    {
+        for (const DeviceReading *r: qAsConst(readings))
+        {
+            if (!writeReading(*r)) { status = false; break; }
+        }
+    }
+
+    for (const DeviceReading *r: qAsConst(readings))
+    {
+        if (!deviceAddrs.contains(r->deviceAddr))
+            deviceAddrs += r->deviceAddr;
+
+        int deviceId = getDeviceId(r->deviceAddr);
+        qint64 ts = r->roundedTimestamp().toSecsSinceEpoch();
+        hours[std::make_tuple(int(r->table), deviceId, ts - ts % 3600)] |= r->metrics;
+
+        // Actual time of the reading, not the rounded one
+        qint64 tsFull = r->timestamp.toSecsSinceEpoch();
+        for (quint32 m = r->metrics; m; m &= (m - 1))
+        {
+            quint32 metric = m & (~m + 1); // lowest bit
+            auto l = latest.find(qMakePair(deviceId, metric));
+            if (l == latest.end()) latest.insert(qMakePair(deviceId, metric), qMakePair(tsFull, r->value(metric)));
+            else if (tsFull >= l->first) *l = qMakePair(tsFull, r->value(metric));
+        }
+    }
+
+    // Raw rows committed without their rollups would leave the charts wrong for good
+    if (status)
+    {
+        status = updateRollups(hours);
+        if (!status) qWarning() << "> DatabaseWriter rollups ERROR, batch rolled back";
+    }
+    else
+    {
+        qWarning() << "> DatabaseWriter readings ERROR, batch rolled back";
+    }
+
+    if (status)
+    {
+        updateLatestValues(latest);
+
+        for (const auto &h: qAsConst(historySyncs))
+        {
+            writeHistorySync(h.first, h.second);
+        }
+
+        if (db.commit())
+        {
+            Q_EMIT dataWritten(deviceAddrs);
+            return true;
+        }
+
+        qWarning() << "> DatabaseWriter commit() ERROR" << db.lastError().type() << ":" << db.lastError().text();
+    }
+
+    db.rollback();
+    m_deviceIds.clear(); // may contain rolled back ids
+
+    return false;
+}
+
+void DatabaseWriter::setIdle(bool idle)
+{
+    if (m_maintenance) m_maintenance->setIdle(idle);
+}
+
+/* ************************************************************************** */
+
+void DatabaseWriter::checkpoint()
+{
+    // PASSIVE: copy as much of the WAL as possible without waiting on readers
+    QSqlQuery ckpt(QSqlDatabase::database(m_connectionName));
+    if (ckpt.exec("PRAGMA wal_checkpoint(PASSIVE)") == false)
+        qWarning() << "> checkpoint.exec() ERROR" << ckpt.lastError().type() << ":" << ckpt.lastError().text();
+
+    compactJournal();
+}
+
+/* ************************************************************************** */
+
+void DatabaseWriter::syncJournal()
+{
+    // Push the records to the OS with the lock held, but don't make enqueue() wait on the disk
+    int handle = -1;
+    {
+        QMutexLocker lock(&m_queueMutex);
+        if (m_journal) handle = m_journal->flush();
+    }
+
+    DatabaseJournal::sync(handle);
+}
+
+void DatabaseWriter::compactJournal()
+{
+    if (!m_journal) return;
+
+    // Queue empty: every record in the journal has been committed (flush() runs in this thread)
+    qint64 committed = 0;
+    {
+        QMutexLocker lock(&m_queueMutex);
+        if (!m_queue.isEmpty() || m_journal->size() == 0) return;
+        committed = m_journal->size();
+    }
+
+    // With SQLite, a commit is only durable once the WAL has been synced, which a complete
+    // checkpoint guarantees (with a rollback journal, or MySQL, the commit is enough)
+    if (m_infos.driver == "QSQLITE")
+    {
+        QSqlQuery ckpt(QSqlDatabase::database(m_connectionName));
+        if (ckpt.exec("PRAGMA wal_checkpoint(PASSIVE)") == false || !ckpt.next()) return;
+
+        // busy, WAL frames, frames checkpointed (-1, -1 when not in WAL mode)
+        if (ckpt.value(0).toInt() != 0 || ckpt.value(1).toInt() != ckpt.value(2).toInt()) return;
+    }
+
+    QMutexLocker lock(&m_queueMutex);
+    if (m_journal->size() == committed) m_journal->clear(); // or retry next time
+}
+
+/* ************************************************************************** */
+
+int DatabaseWriter::getDeviceId(const QString &deviceAddr)
+{
+    auto it = m_deviceIds.constFind(deviceAddr);
+    if (it != m_deviceIds.constEnd()) return it.value();
+
+    int deviceId = -1;
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+
+    QSqlQuery getId(db);
+    getId.prepare("SELECT deviceId FROM deviceIds WHERE deviceAddr = :deviceAddr");
+    getId.bindValue(":deviceAddr", deviceAddr);
+    if (getId.exec() && getId.next())
+    {
+        deviceId = getId.value(0).toInt();
+    }
+    else
+    {
+        // First reading from that device
+        QSqlQuery addId(db);
+        addId.prepare("INSERT INTO deviceIds (deviceAddr) VALUES (:deviceAddr)");
+        addId.bindValue(":deviceAddr", deviceAddr);
+        if (addId.exec())
+            deviceId = addId.lastInsertId().toInt();
+        else
+            qWarning() << "> addId.exec() ERROR" << addId.lastError().type() << ":" << addId.lastError().text();
+    }
+
+    if (deviceId >= 0) m_deviceIds.insert(deviceAddr, deviceId);
+
+    return deviceId;
+}
+
+bool DatabaseWriter::writeReading(const DeviceReading &r)
+{
+    // Timestamps are UTC epoch (seconds)
+    QSqlQuery *q = nullptr;
+
+    int deviceId = getDeviceId(r.deviceAddr);
+    if (deviceId < 0) return false;
+
+    qint64 ts = r.roundedTimestamp().toSecsSinceEpoch();
+    QString partition = DatabasePartitions::partitionName(DatabasePartitions::getInstance()->baseTable(r.table), ts);
+
+    if (DatabasePartitions::isNarrow(partition))
+    {
+        // One row per metric, and only for the metrics we have
+        bool status = true;
+        q = &addDataQuery(r.table, partition);
+
+        for (const auto &c: sensorDataColumns)
+        {
+            if (!r.has(c.metric)) continue;
+
+            q->bindValue(":deviceId", deviceId);
+            q->bindValue(":metric", c.metric);
+            q->bindValue(":ts", ts);
+            q->bindValue(":value", r.value(c.metric));
+            if (q->exec() == false)
+            {
+                qWarning() << "> addData.exec() ERROR" << q->lastError().type() << ":" << q->lastError().text();
+                status = false;
+            }
+        }
+
+        return status;
+    }
+    else if (r.table == DeviceReading::TABLE_PLANTDATA)
+    {
+        q = &addDataQuery(r.table, partition);
+        q->bindValue(":deviceId", deviceId);
+        q->bindValue(":ts", ts);
+        q->bindValue(":ts_full", r.timestamp.toSecsSinceEpoch());
+
+        for (const auto &c: plantDataColumns)
+        {
+            q->bindValue(QString(":") + c.column,
+                         r.has(c.metric) ? QVariant(r.value(c.metric)) : QVariant(QVariant::Double));
+        }
+    }
+    else if (r.table == DeviceReading::TABLE_SENSORDATA)
+    {
+        q = &addDataQuery(r.table, partition);
+        q->bindValue(":deviceId", deviceId);
+        q->bindValue(":ts", ts);
+
+        for (const auto &c: sensorDataColumns)
+        {
+            q->bindValue(QString(":") + c.column,
+                         r.has(c.metric) ? QVariant(r.value(c.metric)) : QVariant(QVariant::Double));
+        }
+    }
+
+    if (!q) return false;
+
+    bool status = q->exec();
+    if (status == false)
+        qWarning() << "> addData.exec() ERROR" << q->lastError().type() << ":" << q->lastError().text();
+
+    return status;
+}
+
+bool DatabaseWriter::writeReadings(const QList <const DeviceReading *> &readings)
+{
+    // Partition > its readings
+    QMap <QString, QList <const DeviceReading *>> partitions;
+    for (const DeviceReading *r: readings)
+    {
+        if (getDeviceId(r->deviceAddr) < 0) return false;
+
+        qint64 ts = r->roundedTimestamp().toSecsSinceEpoch();
+        partitions[DatabasePartitions::partitionName(DatabasePartitions::getInstance()->baseTable(r->table), ts)] += r;
+    }
+
+    for (auto p = partitions.constBegin(); p != partitions.constEnd(); ++p)
+    {
+        for (int i = 0; i < p.value().size(); i += WRITER_MULTIROW_SIZE)
+        {
+            // Stop at the first failed chunk, the caller rolls the whole batch back
+            if (!writeRows(p.key(), p.value().mid(i, WRITER_MULTIROW_SIZE))) return false;
+        }
+    }
+
+    return true;
+}
+
+bool DatabaseWriter::writeRows(const QString &partition, const QList <const DeviceReading *> &readings)
+{
+    // Same rows as writeReading(), but all of them in a single statement
+    DeviceReading::ReadingTable table = readings.first()->table;
+    const auto tableColumns = columns(table);
+    bool narrow = DatabasePartitions::isNarrow(partition);
+
+    QStringList cols;
+    if (narrow)
+    {
+        cols << "deviceId" << "metric" << "ts" << "value";
+    }
+    else
+    {
+        cols << "deviceId" << "ts";
+        if (table == DeviceReading::TABLE_PLANTDATA) cols << "ts_full";
+        for (const auto &c: tableColumns) cols << c.second;
+    }
+
+    QVariantList values;
+    int rows = 0;
+    for (const DeviceReading *r: readings)
+    {
+        int deviceId = getDeviceId(r->deviceAddr);
+        qint64 ts = r->roundedTimestamp().toSecsSinceEpoch();
+
+        if (narrow)
+        {
+            for (const auto &c: tableColumns)
+            {
+                if (!r->has(c.first)) continue;
+
+                values << deviceId << c.first << ts << r->value(c.first);
+                rows++;
+            }
+        }
+        else
+        {
+            values << deviceId << ts;
+            if (table == DeviceReading::TABLE_PLANTDATA) values << r->timestamp.toSecsSinceEpoch();
+            for (const auto &c: tableColumns)
+            {
+                values << (r->has(c.first) ? QVariant(r->value(c.first)) : QVariant(QVariant::Double));
+            }
+            rows++;
+        }
+    }
+    if (rows == 0) return true;
+
+    QSqlQuery &q = addRowsQuery(partition, cols, rows);
+    for (const auto &v: qAsConst(values)) q.addBindValue(v);
+
+    bool status = q.exec();
+    if (status == false)
+        qWarning() << "> addRows.exec() ERROR" << q.lastError().type() << ":" << q.lastError().text();
+
+    return status;
+}
+
+bool DatabaseWriter::writeHistorySync(const QString &deviceAddr, const QDateTime &lastSync)
+{
+    m_updateLastSync.bindValue(":sync", lastSync.toString("yyyy-MM-dd hh:mm:ss"));
+    m_updateLastSync.bindValue(":deviceAddr", deviceAddr);
+
+    bool status = m_updateLastSync.exec();
+    if (status == false)
+        qWarning() << "> updateDeviceLastSync.exec() ERROR" << m_updateLastSync.lastError().type() << ":" << m_updateLastSync.lastError().text();
+
+    return status;
+}
+
+/* ************************************************************************** */
+
+QSqlQuery &DatabaseWriter::addDataQuery(int table, const QString &partition)
+{
+    auto it = m_addData.find(partition);
+    if (it == m_addData.end() && DatabasePartitions::isNarrow(partition))
+    {
+        it = m_addData.insert(partition, QSqlQuery(QSqlDatabase::database(m_connectionName)));
+        if (it->prepare("REPLACE INTO " + partition + " (deviceId, metric, ts, value) VALUES (:deviceId, :metric, :ts, :value)") == false)
+            qWarning() << "> addData.prepare() ERROR" << it->lastError().type() << ":" << it->lastError().text();
+    }
+    else if (it == m_addData.end())
+    {
+        QString cols = "deviceId, ts";
+        QString vals = ":deviceId, :ts";
+        if (table == DeviceReading::TABLE_PLANTDATA)
+        {
+            cols += ", ts_full";
+            vals += ", :ts_full";
+        }
+
+        const auto tableColumns = columns(static_cast<DeviceReading::ReadingTable>(table));
+        for (const auto &c: tableColumns)
+        {
+            cols += ", " + c.second;
+            vals += ", :" + c.second;
+        }
+
+        it = m_addData.insert(partition, QSqlQuery(QSqlDatabase::database(m_connectionName)));
+        if (it->prepare("REPLACE INTO " + partition + " (" + cols + ") VALUES (" + vals + ")") == false)
+            qWarning() << "> addData.prepare() ERROR" << it->lastError().type() << ":" << it->lastError().text();
+    }
+
+    return it.value();
+}
+
+QSqlQuery &DatabaseWriter::addRowsQuery(const QString &partition, const QStringList &columns, int rows)
+{
+    QString key = partition + "*" + QString::number(rows);
+
+    auto it = m_addData.find(key);
+    if (it == m_addData.end())
+    {
+        // The primary key columns stay, the others are overwritten (like REPLACE does)
+        QStringList updates;
+        for (const auto &c: columns)
+        {
+            if (c != "deviceId" && c != "ts" && c != "metric")
+                updates += c + " = VALUES(" + c + ")";
+        }
+
+        QString row = "(" + QString("?, ").repeated(columns.size() - 1) + "?)";
+        QString values = QString(row + ", ").repeated(rows);
+        values.chop(2);
+
+        it = m_addData.insert(key, QSqlQuery(QSqlDatabase::database(m_connectionName)));
+        if (it->prepare("INSERT INTO " + partition + " (" + columns.join(", ") + ") VALUES " + values +
+                        " ON DUPLICATE KEY UPDATE " + updates.join(", ")) == false)
+            qWarning() << "> addRows.prepare() ERROR" << it->lastError().type() << ":" << it->lastError().text();
+    }
+
+    return it.value();
+}
+
+void DatabaseWriter::clearQueries(const QString &partition)
+{
+    for (auto it = m_addData.begin(); it != m_addData.end();)
+    {
+        if (it.key() == partition || it.key().startsWith(partition + "*")) it = m_addData.erase(it);
+        else ++it;
+    }
+
+    for (auto it = m_addHourly.begin(); it != m_addHourly.end();)
+    {
+        if (it.key().startsWith(partition + ".")) it = m_addHourly.erase(it);
+        else ++it;
+    }
+}
+
+QSqlQuery &DatabaseWriter::addHourlyQuery(const QString &partition, quint32 metric, const QString &column)
+{
+    QString key = partition + "." + column;
+
+    auto it = m_addHourly.find(key);
+    if (it == m_addHourly.end() && DatabasePartitions::isNarrow(partition))
+    {
+        it = m_addHourly.insert(key, QSqlQuery(QSqlDatabase::database(m_connectionName)));
+        if (it->prepare("INSERT INTO dataHourly (deviceId, ts, metric, vMin, vMax, vSum, vCount)" \
+                        " SELECT deviceId, :hour, '" + column + "', min(value), max(value), sum(value), count(value)" \
+                        " FROM " + partition +
+                        " WHERE deviceId = :deviceId AND metric = " + QString::number(metric) + " AND ts >= :tsFrom AND ts < :tsTo AND value IS NOT NULL" \
+                        " GROUP BY deviceId") == false)
+            qWarning() << "> addHourly.prepare() ERROR" << it->lastError().type() << ":" << it->lastError().text();
+    }
+    else if (it == m_addHourly.end())
+    {
+        it = m_addHourly.insert(key, QSqlQuery(QSqlDatabase::database(m_connectionName)));
+        if (it->prepare("INSERT INTO dataHourly (deviceId, ts, metric, vMin, vMax, vSum, vCount)" \
+                        " SELECT deviceId, :hour, '" + column + "', min(" + column + "), max(" + column + "), sum(" + column + "), count(" + column + ")" \
+                        " FROM " + partition +
+                        " WHERE deviceId = :deviceId AND ts >= :tsFrom AND ts < :tsTo AND " + column + " IS NOT NULL" \
+                        " GROUP BY deviceId") == false)
+            qWarning() << "> addHourly.prepare() ERROR" << it->lastError().type() << ":" << it->lastError().text();
+    }
+
+    return it.value();
+}
+
+/*!
+ * \brief Recompute the rollups of every hour (and day) touched by a batch.
+ *
+ * Buckets are rebuilt from the rows they cover, instead of being patched
+ * with the new values, so late history arrivals and rows replaced by a
+ * new reading are accounted for exactly once.
+ * Days are in local time, and made of the hours starting in that day.
+ * Days older than the hourly retention are the exception: their hourly rows
+ * are gone, so the new hours are merged into the daily rollup we kept.
+ */
+bool DatabaseWriter::updateRollups(const QMap <RollupHour, quint32> &hours)
+{
+    bool status = true;
+    QMap <std::tuple <int, QString, QDate>, QList <qint64>> days;   //!< Day > its hours in this batch
+
+    for (auto h = hours.constBegin(); h != hours.constEnd(); ++h)
+    {
+        int table = std::get<0>(h.key());
+        int deviceId = std::get<1>(h.key());
+        qint64 hour = std::get<2>(h.key());
+
+        // Partitions are months, an hour is always in a single one
+        QString partition = DatabasePartitions::partitionName(DatabasePartitions::getInstance()->baseTable(table), hour);
+
+        const auto cols = columns(static_cast<DeviceReading::ReadingTable>(table));
+        for (const auto &c: cols)
+        {
+            if (!(h.value() & c.first)) continue;
+
+            m_deleteHourly.bindValue(":deviceId", deviceId);
+            m_deleteHourly.bindValue(":metric", c.second);
+            m_deleteHourly.bindValue(":ts", hour);
+            if (m_deleteHourly.exec() == false)
+            {
+                qWarning() << "> deleteHourly.exec() ERROR" << m_deleteHourly.lastError().type() << ":" << m_deleteHourly.lastError().text();
+                status = false;
+            }
+
+            QSqlQuery &addHourly = addHourlyQuery(partition, c.first, c.second);
+            addHourly.bindValue(":hour", hour);
+            addHourly.bindValue(":deviceId", deviceId);
+            addHourly.bindValue(":tsFrom", hour);
+            addHourly.bindValue(":tsTo", hour + 3600);
+            if (addHourly.exec() == false)
+            {
+                qWarning() << "> addHourly.exec() ERROR" << addHourly.lastError().type() << ":" << addHourly.lastError().text();
+                status = false;
+            }
+
+            days[std::make_tuple(deviceId, c.second, QDateTime::fromSecsSinceEpoch(hour).date())] += hour;
+        }
+    }
+
+    // Past the hourly retention, the daily rollup was built from hours we don't have anymore
+    qint64 hourlyCutoff = retentionHourlyCutoff();
+
+    for (auto d = days.constBegin(); d != days.constEnd(); ++d)
+    {
+        int deviceId = std::get<0>(d.key());
+        const QString &metric = std::get<1>(d.key());
+        const QDate &day = std::get<2>(d.key());
+
+        if (hourlyCutoff > 0 && QDateTime(day, QTime(0, 0)).toSecsSinceEpoch() < hourlyCutoff)
+        {
+            // Merged instead of rebuilt (an hour written twice in there is counted twice)
+            for (qint64 hour: d.value())
+            {
+                m_mergeDaily.bindValue(":day", day.toString("yyyy-MM-dd"));
+                m_mergeDaily.bindValue(":deviceId", deviceId);
+                m_mergeDaily.bindValue(":metric", metric);
+                m_mergeDaily.bindValue(":ts", hour);
+                if (m_mergeDaily.exec() == false)
+                {
+                    qWarning() << "> mergeDaily.exec() ERROR" << m_mergeDaily.lastError().type() << ":" << m_mergeDaily.lastError().text();
+                    status = false;
+                }
+            }
+            continue;
+        }
+
+        m_deleteDaily.bindValue(":deviceId", deviceId);
+        m_deleteDaily.bindValue(":metric", metric);
+        m_deleteDaily.bindValue(":day", day.toString("yyyy-MM-dd"));
+        if (m_deleteDaily.exec() == false)
+        {
+            qWarning() << "> deleteDaily.exec() ERROR" << m_deleteDaily.lastError().type() << ":" << m_deleteDaily.lastError().text();
+            status = false;
+        }
+
+        m_addDaily.bindValue(":day", day.toString("yyyy-MM-dd"));
+        m_addDaily.bindValue(":deviceId", deviceId);
+        m_addDaily.bindValue(":metric", metric);
+        m_addDaily.bindValue(":tsFrom", QDateTime(day, QTime(0, 0)).toSecsSinceEpoch());
+        m_addDaily.bindValue(":tsTo", QDateTime(day.addDays(1), QTime(0, 0)).toSecsSinceEpoch());
+        if (m_addDaily.exec() == false)
+        {
+            qWarning() << "> addDaily.exec() ERROR" << m_addDaily.lastError().type() << ":" << m_addDaily.lastError().text();
+            status = false;
+        }
+    }
+
+    return status;
+}
+
+/*!
+ * \brief Keep the 'latestValues' table up to date, with the newest value of each metric of the batch.
+ *
+ * Devices load their current values from there, with a single keyed lookup,
+ * instead of reading all of their recent rows.
+ */
+bool DatabaseWriter::updateLatestValues(const QHash <LatestKey, QPair <qint64, float>> &latest)
+{
+    bool status = true;
+
+    for (auto l = latest.constBegin(); l != latest.constEnd(); ++l)
+    {
+        m_updateLatest.bindValue(":deviceId", l.key().first);
+        m_updateLatest.bindValue(":metric", l.key().second);
+        m_updateLatest.bindValue(":ts", l.value().first);
+        m_updateLatest.bindValue(":value", l.value().second);
+        if (m_updateLatest.exec() == false)
+        {
+            qWarning() << "> updateLatest.exec() ERROR" << m_updateLatest.lastError().type() << ":" << m_updateLatest.lastError().text();
+            status = false;
+        }
+    }
+
+    return status;
+}
+
+/* ************************************************************************** */
+
+qint64 DatabaseWriter::retentionRawCutoff() const
+{
+    if (m_retention.rawDays <= 0) return 0;
+
+    return QDateTime::currentDateTime().addDays(-m_retention.rawDays).toSecsSinceEpoch();
+}
+
+qint64 DatabaseWriter::retentionHourlyCutoff() const
+{
+    if (m_retention.hourlyMonths <= 0) return 0;
+
+    return QDateTime::currentDateTime().addMonths(-m_retention.hourlyMonths).toSecsSinceEpoch();
+}
+
+void DatabaseWriter::retention()
+{
+    // Device clock not set, every timestamp would look like it's in the future
+    // (or no database to clean up right now)
+    if (QDate::currentDate().year() < 2021 || m_offline)
+    {
+        m_retentionTimer->start(RETENTION_INTERVAL * 1000);
+        return;
+    }
+
+    if (m_retentionTasks.isEmpty())
+    {
+        m_retentionDeleted = 0;
+        m_retentionDropped = 0;
+        m_retentionStarted = QDateTime::currentMSecsSinceEpoch();
+
+        if (!retentionPlan() || m_retentionTasks.isEmpty())
+        {
+            m_retentionTimer->start(RETENTION_INTERVAL * 1000);
+            return;
+        }
+    }
+
+    // One chunk at a time, so the readings batches are never held back for long
+    if (retentionChunk(m_retentionTasks.first()))
+    {
+        m_retentionTasks.removeFirst();
+    }
+
+    if (m_retentionTasks.isEmpty())
+    {
+        qDebug() << "DatabaseWriter retention:" << m_retentionDeleted << "rows deleted and"
+                 << m_retentionDropped << "partitions dropped in"
+                 << (QDateTime::currentMSecsSinceEpoch() - m_retentionStarted) << "ms";
+
+        m_retentionTimer->start(RETENTION_INTERVAL * 1000);
+    }
+    else
+    {
+        m_retentionTimer->start(RETENTION_STEP_INTERVAL);
+    }
+}
+
+bool DatabaseWriter::retentionPlan()
+{
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isOpen()) return false;
+
+    QList <QPair <int, QString>> deviceIds;
+    QSqlQuery getIds(db);
+    if (getIds.exec("SELECT deviceId, deviceAddr FROM deviceIds") == false)
+    {
+        qWarning() << "> getIds.exec() ERROR" << getIds.lastError().type() << ":" << getIds.lastError().text();
+        return false;
+    }
+    while (getIds.next())
+    {
+        deviceIds += qMakePair(getIds.value(0).toInt(), getIds.value(1).toString());
+    }
+
+    // Rollup metrics, as named by the data table columns
+    QStringList metrics;
+    const auto plantCols = columns(DeviceReading::TABLE_PLANTDATA);
+    const auto sensorCols = columns(DeviceReading::TABLE_SENSORDATA);
+    for (const auto &c: plantCols) if (!metrics.contains(c.second)) metrics += c.second;
+    for (const auto &c: sensorCols) if (!metrics.contains(c.second)) metrics += c.second;
+
+    qint64 rawCutoff = retentionRawCutoff();
+    qint64 hourlyCutoff = retentionHourlyCutoff();
+
+    qint64 future = QDateTime::currentDateTime().addDays(1).toSecsSinceEpoch();
+
+    // Raw readings partitions: the ones entirely out of the window are dropped,
+    // rows are only deleted from the ones straddling the cutoffs
+    DatabasePartitions *partitions = DatabasePartitions::getInstance();
+    QStringList rawFuture;
+    QStringList rawCurrent;
+
+    const QStringList baseTables = {partitions->baseTable(DeviceReading::TABLE_PLANTDATA),
+                                    partitions->baseTable(DeviceReading::TABLE_SENSORDATA)};
+    for (const auto &base: baseTables)
+    {
+        const QStringList tables = partitions->tables(base);
+        for (const auto &table: tables)
+        {
+            qint64 from = partitions->tsFrom(table);
+            qint64 to = DatabasePartitions::monthEnd(from);
+
+            if (from > future || (rawCutoff > 0 && to <= rawCutoff))
+            {
+                m_retentionTasks += RetentionTask{ table, -1, QString(), QString(), 0 };
+            }
+            else
+            {
+                if (to > future) rawFuture += table;
+                if (rawCutoff > from) rawCurrent += table;
+            }
+        }
+    }
+
+    // Raw readings aren't cached, but the chart series built from the rollups are
+    QStringList rollupsChanged;
+
+    for (const auto &d: qAsConst(deviceIds))
+    {
+        int deviceId = d.first;
+
+        // Everything that's in the future (bad device clock), always a handful of rows
+        const QStringList tables = rawFuture + QStringList{"dataHourly"};
+        for (const auto &table: tables)
+        {
+            QSqlQuery deleteFuture(db);
+            deleteFuture.prepare("DELETE FROM " + table + " WHERE deviceId = :deviceId AND ts > :ts");
+            deleteFuture.bindValue(":deviceId", deviceId);
+            deleteFuture.bindValue(":ts", future);
+            if (deleteFuture.exec() == false)
+                qWarning() << "> deleteFuture.exec() ERROR" << deleteFuture.lastError().type() << ":" << deleteFuture.lastError().text();
+            else if (deleteFuture.numRowsAffected() > 0)
+            {
+                m_retentionDeleted += deleteFuture.numRowsAffected();
+                if (table == "dataHourly" && !rollupsChanged.contains(d.second)) rollupsChanged += d.second;
+            }
+        }
+        QSqlQuery deleteFutureDaily(db);
+        deleteFutureDaily.prepare("DELETE FROM dataDaily WHERE deviceId = :deviceId AND day > :day");
+        deleteFutureDaily.bindValue(":deviceId", deviceId);
+        deleteFutureDaily.bindValue(":day", QDate::currentDate().addDays(1).toString("yyyy-MM-dd"));
+        if (deleteFutureDaily.exec() == false)
+            qWarning() << "> deleteFutureDaily.exec() ERROR" << deleteFutureDaily.lastError().type() << ":" << deleteFutureDaily.lastError().text();
+        else if (deleteFutureDaily.numRowsAffected() > 0)
+        {
+            m_retentionDeleted += deleteFutureDaily.numRowsAffected();
+            if (!rollupsChanged.contains(d.second)) rollupsChanged += d.second;
+        }
+
+        // Then everything that's too old, raw readings first, chunk by chunk
+        if (rawCutoff > 0)
+        {
+            for (const auto &table: qAsConst(rawCurrent))
+                m_retentionTasks += RetentionTask{ table, deviceId, d.second, QString(), rawCutoff };
+        }
+        if (hourlyCutoff > 0)
+        {
+            for (const auto &metric: qAsConst(metrics))
+                m_retentionTasks += RetentionTask{ "dataHourly", deviceId, d.second, metric, hourlyCutoff };
+        }
+    }
+
+    if (!rollupsChanged.isEmpty()) Q_EMIT dataWritten(rollupsChanged);
+
+    return true;
+}
+
+/*!
+ * \brief Delete up to RETENTION_CHUNK_SIZE rows for a retention task.
+ * \return true if the task is done.
+ */
+bool DatabaseWriter::retentionChunk(const RetentionTask &task)
+{
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isOpen()) return true;
+
+    if (task.deviceId < 0)
+    {
+        // A whole partition, no matter how many rows it holds
+        clearQueries(task.table);
+        if (DatabasePartitions::getInstance()->drop(db, task.table))
+            m_retentionDropped++;
+
+        return true;
+    }
+
+    // Rows are clustered on (deviceId[, metric], ts), so both queries are range scans
+    QString where = " WHERE deviceId = :deviceId";
+    if (!task.metric.isEmpty()) where += " AND metric = :metric";
+
+    qint64 limit = task.cutoff;
+    bool done = true;
+
+    QSqlQuery boundary(db);
+    boundary.prepare("SELECT ts FROM " + task.table + where + " AND ts < :ts" \
+                     " ORDER BY ts LIMIT 1 OFFSET " + QString::number(RETENTION_CHUNK_SIZE - 1));
+    boundary.bindValue(":deviceId", task.deviceId);
+    if (!task.metric.isEmpty()) boundary.bindValue(":metric", task.metric);
+    boundary.bindValue(":ts", task.cutoff);
+    if (boundary.exec() && boundary.next())
+    {
+        // There is more than a chunk to delete
+        limit = boundary.value(0).toLongLong() + 1;
+        done = (limit >= task.cutoff);
+    }
+
+    QSqlQuery deleteChunk(db);
+    deleteChunk.prepare("DELETE FROM " + task.table + where + " AND ts < :ts");
+    deleteChunk.bindValue(":deviceId", task.deviceId);
+    if (!task.metric.isEmpty()) deleteChunk.bindValue(":metric", task.metric);
+    deleteChunk.bindValue(":ts", limit);
+
+    db.transaction();
+    if (deleteChunk.exec() && db.commit())
+    {
+        m_retentionDeleted += qMax(deleteChunk.numRowsAffected(), 0);
+
+        // Same path as new readings, so the cached chart series of that device are dropped
+        if (!task.metric.isEmpty() && deleteChunk.numRowsAffected() > 0)
+            Q_EMIT dataWritten({task.deviceAddr});
+    }
+    else
+    {
+        qWarning() << "> deleteChunk.exec() ERROR" << deleteChunk.lastError().type() << ":" << deleteChunk.lastError().text();
+        db.rollback();
+        done = true; // we'll try again on the next run
+    }
+
+    return done;
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,228 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DATABASE_WRITER_H
+#define DATABASE_WRITER_H
+/* ************************************************************************** */
+
+#include "device_reading.h"
+#include "DatabaseMaintenance.h"
+#include "DatabaseJournal.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QDateTime>
+#include <QTimer>
+#include <QSqlQuery>
+
+#include <tuple>
+
+#define WRITER_BATCH_SIZE       256 // readings
+#define WRITER_FLUSH_INTERVAL  2000 // ms
+#define WRITER_MULTIROW_SIZE     64 // readings per INSERT statement (MySQL)
+#define WRITER_BATCH_RETRIES      3 // a batch failing that many times (server still up) is split to find the bad readings
+#define WRITER_RECONNECT_MIN      5 // s before the first reconnection attempt
+#define WRITER_RECONNECT_MAX    300 // s, the delay doubles after each failed attempt
+
+// Retention defaults, can be overridden using "database/..." settings (0 means forever)
+#define RETENTION_RAW_DAYS              90
+#define RETENTION_HOURLY_MONTHS         24
+
+#define RETENTION_STARTUP_DELAY         60      // s
+#define RETENTION_INTERVAL              (6*3600)// s
+#define RETENTION_CHUNK_SIZE            2000    // rows deleted per transaction
+#define RETENTION_STEP_INTERVAL         50      // ms between two chunks
+
+/* ************************************************************************** */
+
+/*!
+ * \brief Everything needed to open another connection on the current database.
+ */
+struct DatabaseConnectionInfos
+{
+    QString driver;
+    QString databaseName;
+    QString hostName;
+    int port = -1;
+    QString userName;
+    QString password;
+    QString connectOptions;             //!< QSqlDatabase::setConnectOptions()
+
+    QStringList pragmas;                //!< Executed right after opening (SQLite only)
+    int walCheckpointInterval = 0;      //!< Periodic WAL checkpoint, in seconds (0 to disable)
+
+    QString journalFile;                //!< Ingest journal (empty to disable)
+};
+
+/*!
+ * \brief How long we keep each level of data.
+ *
+ * Raw readings for rawDays, hourly rollups for hourlyMonths, daily rollups forever.
+ */
+struct RetentionPolicy
+{
+    int rawDays = RETENTION_RAW_DAYS;
+    int hourlyMonths = RETENTION_HOURLY_MONTHS;
+};
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DatabaseWriter class
+ *
+ * Lives in its own thread, with its own database connection. Device drivers
+ * queue their readings (through DatabaseManager::addReading()), and the writer
+ * commits them in batched transactions, on a size or time trigger. Queued
+ * readings are also appended to a journal, so a crash doesn't lose them.
+ * With MySQL, readings are sent using multi-row INSERTs, and if the server
+ * goes away they are kept (in the queue and the journal) while the writer
+ * reconnects in the background.
+ *
+ * The writer also enforces the retention policy, in small chunks, in between
+ * two batches, and runs the SQLite maintenance while the devices are idle.
+ */
+class DatabaseWriter: public QObject
+{
+    Q_OBJECT
+
+    DatabaseConnectionInfos m_infos;
+    QString m_connectionName;
+
+    QMutex m_queueMutex;
+    QList <DeviceReading> m_queue;
+    QList <QPair <QString, QDateTime>> m_historySyncs;  //!< Device > last history entry, for the finished sessions
+    bool m_flushRequested = false;
+
+    QTimer *m_flushTimer = nullptr;
+    QTimer *m_checkpointTimer = nullptr;
+
+    // Connection lost: readings stay in the queue (and journal) until we're back
+    bool m_offline = false;
+    int m_reconnectDelay = WRITER_RECONNECT_MIN;
+    QTimer *m_reconnectTimer = nullptr;
+    bool openConnection();
+    void connectionLost(const QList <DeviceReading> &batch, const QList <QPair <QString, QDateTime>> &historySyncs);
+
+    DatabaseJournal *m_journal = nullptr;   //!< Guarded by m_queueMutex
+    QTimer *m_journalTimer = nullptr;
+    void compactJournal();
+
+    // Batch failing with the server up: retried a few times as is, then split in
+    // halves until the readings that really fail are found, and only these are dropped
+    int m_batchRetries = 0;
+    bool connectionAlive();
+    void batchFailed(const QList <DeviceReading> &batch, const QList <QPair <QString, QDateTime>> &historySyncs);
+    bool writeIsolated(const QList <DeviceReading> &readings, qint64 rawCutoff, int &dropped);
+
+    QHash <QString, QSqlQuery> m_addData;      //!< One per data table partition (and row count, for multi-row)
+    QSqlQuery &addDataQuery(int table, const QString &partition);
+    QSqlQuery &addRowsQuery(const QString &partition, const QStringList &columns, int rows);
+    void clearQueries(const QString &partition);
+
+    // Rollups: table, deviceId, hour (epoch) > metrics written in that hour
+    typedef std::tuple <int, int, qint64> RollupHour;
+
+    QHash <QString, QSqlQuery> m_addHourly;     //!< One per data table partition and column
+    QSqlQuery m_deleteHourly;
+    QSqlQuery m_addDaily;
+    QSqlQuery m_deleteDaily;
+    QSqlQuery m_mergeDaily;                     //!< For the days whose hourly rollups are gone
+    QSqlQuery m_updateLastSync;
+    QSqlQuery &addHourlyQuery(const QString &partition, quint32 metric, const QString &column);
+    bool updateRollups(const QMap <RollupHour, quint32> &hours);
+
+    // Latest values: deviceId, metric > ts, value
+    typedef QPair <int, quint32> LatestKey;
+
+    QSqlQuery m_updateLatest;
+    bool updateLatestValues(const QHash <LatestKey, QPair <qint64, float>> &latest);
+
+    RetentionPolicy m_retention;
+    QTimer *m_retentionTimer = nullptr;
+
+    struct RetentionTask
+    {
+        QString table;
+        int deviceId;           //!< -1 to drop the whole (partition) table
+        QString deviceAddr;     //!< Its cached chart series are dropped (rollups only)
+        QString metric;         //!< Rollups only
+        qint64 cutoff;          //!< Rows older than that are deleted (UTC epoch)
+    };
+    QList <RetentionTask> m_retentionTasks;
+    qint64 m_retentionDeleted = 0;
+    int m_retentionDropped = 0;
+    qint64 m_retentionStarted = 0;
+
+    bool retentionPlan();
+    bool retentionChunk(const RetentionTask &task);
+    qint64 retentionRawCutoff() const;
+    qint64 retentionHourlyCutoff() const;
+
+    DatabaseMaintenance *m_maintenance = nullptr;
+
+    QHash <QString, int> m_deviceIds;
+    int getDeviceId(const QString &deviceAddr);
+
+    bool writeReading(const DeviceReading &r);
+    bool writeReadings(const QList <const DeviceReading *> &readings);
+    bool writeRows(const QString &partition, const QList <const DeviceReading *> &readings);
+    bool writeHistorySync(const QString &deviceAddr, const QDateTime &lastSync);
+    bool writeBatch(const QList <DeviceReading> &batch,
+                    const QList <QPair <QString, QDateTime>> &historySyncs, qint64 rawCutoff);
+
+public:
+    DatabaseWriter(const DatabaseConnectionInfos &infos, QObject *parent = nullptr);
+    ~DatabaseWriter();
+
+    void enqueue(const DeviceReading &reading);     //!< Thread safe, never waits on disk
+    void endHistorySession(const QString &deviceAddr, const QDateTime &lastSync); //!< Thread safe
+
+    void setRetentionPolicy(const RetentionPolicy &policy) { m_retention = policy; } //!< Before start()
+
+    //! Bulk import, in a single transaction and without the journal (writer thread only)
+    bool importReadings(const QList <DeviceReading> &batch);
+
+    //! Data table columns, with the DeviceUtils::SensorType they store
+    static QList <QPair <quint32, QString>> columns(DeviceReading::ReadingTable table);
+    static quint32 columnMetric(DeviceReading::ReadingTable table, const QString &column);
+
+public slots:
+    void start();
+    void stop();
+    void flush();
+    void reconnect();
+    void checkpoint();
+    void syncJournal();
+    void retention();
+    void setIdle(bool idle);
+
+Q_SIGNALS:
+    void dataWritten(const QStringList &deviceAddrs);
+};
+
+/* ************************************************************************** */
+#endif // DATABASE_WRITER_H
@@ -53,8 +53,8 @@
 #include <QStandardPaths>
 #include <QDir>
 #include <QFile>
-#include <QTextStream>
 #include <QDateTime>
+#include <QUrl>
 
 #include <QSqlDatabase>
 #include <QSqlDriver>
@@ -90,6 +90,22 @@ DeviceManager::DeviceManager()
     {
         m_dbInternal = db->hasDatabaseInternal();
         m_dbExternal = db->hasDatabaseExternal();
+        m_dbMemory = db->hasDatabaseMemory();
+
+        // Database maintenance waits for the Bluetooth activity to stop
+        auto updateIdle = [this, db]() { db->setIdle(!m_scanning && !isRefreshing()); };
+        connect(this, &DeviceManager::scanningChanged, this, updateIdle);
+        connect(this, &DeviceManager::refreshingChanged, this, updateIdle);
+        updateIdle();
+
+        // Imports write through the writer, so they stop first
+        connect(db, &DatabaseManager::writerStopping, this, [this]() {
+            if (m_importThread)
+            {
+                m_import->cancel();
+                m_importThread->wait();
+            }
+        });
     }
 
     // Load saved devices
@@ -97,12 +113,12 @@ DeviceManager::DeviceManager()
     {
         qDebug() << "Scanning (database) for devices...";
 
-        QSqlQuery queryDevices;
-        queryDevices.exec("SELECT deviceName, deviceAddr FROM devices");
-        while (queryDevices.next())
+        // Devices, limits and latest values in a few queries, handed to each device constructor
+        const QList <QPair <QString, QString>> devices = DatabaseManager::getInstance()->preloadDevices(12*60);
+        for (const auto &dd: devices)
         {
-            QString deviceName = queryDevices.value(0).toString();
-            QString deviceAddr = queryDevices.value(1).toString();
+            QString deviceName = dd.first;
+            QString deviceAddr = dd.second;
 
             Device *d = nullptr;
 
@@ -143,6 +159,7 @@ DeviceManager::DeviceManager()
                 //qDebug() << "* Device added (from database): " << deviceName << "/" << deviceAddr;
             }
         }
+        DatabaseManager::getInstance()->clearPreloads();
 
         Q_EMIT devicesListUpdated();
     }
@@ -886,24 +903,11 @@ void DeviceManager::addBleDevice(const QBluetoothDeviceInfo &info)
             }
 
             // Add it to the database?
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
-                // if
-                QSqlQuery queryDevice;
-                queryDevice.prepare("SELECT deviceName FROM devices WHERE deviceAddr = :deviceAddr");
-                queryDevice.bindValue(":deviceAddr", d->getAddress());
-                queryDevice.exec();
-
-                // then
-                if (queryDevice.last() == false)
+                if (DatabaseManager::getInstance()->addDevice(d->getAddress(), d->getName()))
                 {
                     qDebug() << "+ Adding device: " << d->getName() << "/" << d->getAddress() << "to local database";
-
-                    QSqlQuery addDevice;
-                    addDevice.prepare("INSERT INTO devices (deviceAddr, deviceName) VALUES (:deviceAddr, :deviceName)");
-                    addDevice.bindValue(":deviceAddr", d->getAddress());
-                    addDevice.bindValue(":deviceName", d->getName());
-                    addDevice.exec();
                 }
             }
 
@@ -936,13 +940,9 @@ void DeviceManager::removeDevice(const QString &address)
             refreshDevices_finished(dd);
 
             // Remove from database // Don't remove the actual data, nor the limits
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
-                QSqlQuery removeDevice;
-                removeDevice.prepare("DELETE FROM devices WHERE deviceAddr = :deviceAddr");
-                removeDevice.bindValue(":deviceAddr", dd->getAddress());
-                if (removeDevice.exec() == false)
-                    qWarning() << "> removeDevice.exec() ERROR" << removeDevice.lastError().type() << ":" << removeDevice.lastError().text();
+                DatabaseManager::getInstance()->removeDevice(dd->getAddress());
             }
 
             // Remove device
@@ -978,7 +978,17 @@ void DeviceManager::removeDeviceData(const QString &address)
 /* ************************************************************************** */
 /* ************************************************************************** */
 
-bool DeviceManager::exportDataSave()
+static ExportOptions exportOptions(const QString &format, bool gzip)
+{
+    ExportOptions options;
+    options.format = (format == "jsonl") ? ExportOptions::FORMAT_JSONL : ExportOptions::FORMAT_CSV;
+    options.gzip = gzip;
+    options.fahrenheit = (SettingsManager::getInstance()->getTempUnit() != "C");
+
+    return options;
+}
+
+bool DeviceManager::exportDataSave(const QString &format, bool gzip)
 {
     bool status = false;
 
@@ -1009,13 +1019,15 @@ bool DeviceManager::exportDataSave()
         // retry
         if (edir.exists())
         {
+            ExportOptions options = exportOptions(format, gzip);
+
             // Get file name
             QString exportFile = exportDirectory;
             exportFile += "/watchflower_";
             exportFile += QDateTime::currentDateTime().toString("yyyy-MM-dd");
-            exportFile += ".csv";
+            exportFile += "." + options.fileExtension();
 
-            if (exportData(exportFile))
+            if (exportData(exportFile, options))
             {
                 status = true;
             }
@@ -1041,7 +1053,7 @@ bool DeviceManager::exportDataSave()
 
 /* ************************************************************************** */
 
-QString DeviceManager::exportDataOpen()
+QString DeviceManager::exportDataOpen(const QString &format, bool gzip)
 {
     QString exportFilePath;
 
@@ -1053,10 +1065,12 @@ QString DeviceManager::exportDataOpen()
     QDir ddd(exportDirectory + "/export");
     if (!ddd.exists()) ddd.mkpath(exportDirectory + "/export");
 
+    ExportOptions options = exportOptions(format, gzip);
+
     // Get temp file path
-    exportFilePath = exportDirectory + "/export/watchflower_" + QDateTime::currentDateTime().toString("yyyy-MM-dd") + ".csv";
+    exportFilePath = exportDirectory + "/export/watchflower_" + QDateTime::currentDateTime().toString("yyyy-MM-dd") + "." + options.fileExtension();
 
-    if (!exportData(exportFilePath))
+    if (!exportData(exportFilePath, options))
     {
         exportFilePath = "";
     }
@@ -1081,85 +1095,162 @@ QString DeviceManager::exportDataFolder()
 
 /* ************************************************************************** */
 
-bool DeviceManager::exportData(const QString &path)
+bool DeviceManager::exportDataIncremental(const QString &directory, const QString &format, bool gzip)
 {
-    bool status = false;
+    if (!m_devices_model->hasDevices()) return false;
 
-    if (!m_devices_model->hasDevices()) return status;
-    if (!m_dbInternal && !m_dbExternal) return status;
-
-    SettingsManager *sm = SettingsManager::getInstance();
-    bool isCelcius = (sm->getTempUnit() == "C");
+    QString exportDirectory = directory;
+    if (exportDirectory.isEmpty())
+    {
+#if defined(Q_OS_ANDROID) || defined(Q_OS_IOS)
+        UtilsApp *apputils = UtilsApp::getInstance();
+        apputils->getMobileStoragePermissions();
+        exportDirectory = apputils->getMobileStorageInternal() + "/WatchFlower/incremental";
+#else
+        exportDirectory = QStandardPaths::writableLocation(QStandardPaths::HomeLocation) + "/WatchFlower/incremental";
+#endif
+    }
 
-    QFile efile;
-    efile.setFileName(path);
-    if (efile.open(QIODevice::WriteOnly))
+    QDir edir(exportDirectory);
+    if (!edir.exists()) edir.mkpath(exportDirectory);
+    if (!edir.exists())
     {
-        status = true;
-        QTextStream eout(&efile);
+        qWarning() << "DeviceManager::exportDataIncremental() cannot create export directory";
+        return false;
+    }
 
-        QString legend = "Soil humidity (%), Soil conductivity (μs/cm), Temperature (";
-        legend += (isCelcius ? "℃" : "℉");
-        legend += "), Luminosity (lux)";
-        eout << legend << endl;
+    ExportOptions options = exportOptions(format, gzip);
+    options.manifest = exportDirectory + "/watchflower_manifest.json";
 
-        for (auto d: qAsConst(m_devices_model->m_devices))
-        {
-            Device *dd = qobject_cast<Device*>(d);
-            if (dd)
-            {
-                QString l = "> " + dd->getName() + " (" + dd->getAddress() + ")";
-                eout << l << endl;
+    // One delta file per run, the manifest lists them all
+    QString exportFile = exportDirectory + "/watchflower_" +
+                         QDateTime::currentDateTime().toString("yyyy-MM-dd_hhmmss") + "." + options.fileExtension();
 
-                QSqlQuery data;
-                if (m_dbInternal) // sqlite
-                {
-                    data.prepare("SELECT ts_full, soilMoisture, soilConductivity, soilTemperature, temperature, humidity, luminosity " \
-                                 "FROM plantData " \
-                                 "WHERE deviceAddr = :deviceAddr AND ts_full >= datetime('now', 'localtime', '-" + QString::number(90) + " days');");
-                }
-                else if (m_dbExternal) // mysql
-                {
-                    data.prepare("SELECT ts_full, soilMoisture, soilConductivity, soilTemperature, temperature, humidity, luminosity " \
-                                 "FROM plantData " \
-                                 "WHERE deviceAddr = :deviceAddr AND ts_full >= DATE_SUB(NOW(), INTERVAL " + QString::number(90) + " DAY);");
-                }
-                data.bindValue(":deviceAddr", dd->getAddress());
+    return exportData(exportFile, options);
+}
 
-                if (data.exec() == true)
-                {
-                    while (data.next())
-                    {
-                        eout << data.value(0).toString() << ","
-                             << data.value(1).toString() << ",";
+/* ************************************************************************** */
 
-                        if (dd->hasSoilConductivitySensor()) eout << data.value(2).toString();
-                        eout << ",";
+bool DeviceManager::exportData(const QString &path, const ExportOptions &options)
+{
+    if (!m_devices_model->hasDevices()) return false;
+    if (!m_dbInternal && !m_dbExternal) return false;
+    if (m_exportThread) return false; // one at a time
 
-                        if (isCelcius) eout << QString::number(data.value(4).toReal(), 'f', 1);
-                        else eout << QString::number(data.value(4).toReal()* 1.8 + 32.0, 'f', 1);
-                        eout << ",";
+    // Device ids are resolved here, on the GUI thread
+    QList <ExportDevice> devices;
+    for (auto d: qAsConst(m_devices_model->m_devices))
+    {
+        Device *dd = qobject_cast<Device*>(d);
+        if (dd)
+        {
+            ExportDevice e;
+            e.deviceAddr = dd->getAddress();
+            e.deviceName = dd->getName();
+            e.deviceId = dd->getDeviceId();
+            devices += e;
+        }
+    }
 
-                        if (dd->hasHumiditySensor()) eout << data.value(5).toString();
-                        eout << ",";
+    m_exportThread = new QThread();
+    m_export = new DatabaseExport(devices, options, path);
+    m_export->moveToThread(m_exportThread);
+    m_exportProgress = 0.f;
+
+    connect(m_exportThread, &QThread::started, m_export, &DatabaseExport::run);
+    connect(m_export, &DatabaseExport::progress, this, [this](float progress) {
+        m_exportProgress = progress;
+        Q_EMIT exportUpdated();
+    });
+    connect(m_export, &DatabaseExport::finished, this, [this](bool status, const QString &path) {
+        Q_EMIT exportFinished(status, path);
+    });
+    connect(m_export, &DatabaseExport::finished, m_exportThread, &QThread::quit, Qt::DirectConnection);
+    connect(m_exportThread, &QThread::finished, m_export, &DatabaseExport::deleteLater);
+    connect(m_exportThread, &QThread::finished, this, [this]() {
+        m_exportThread->deleteLater();
+        m_exportThread = nullptr;
+        m_export = nullptr;
+        Q_EMIT exportUpdated();
+    });
+
+    m_exportThread->start(QThread::LowPriority);
+    Q_EMIT exportUpdated();
 
-                        if (dd->hasLuminositySensor()) eout << data.value(6).toString();
+    return true;
+}
 
-                        eout << endl;
-                    }
-                }
-            }
-        }
+void DeviceManager::exportDataCancel()
+{
+    if (m_export) m_export->cancel();
+}
+
+/* ************************************************************************** */
+
+bool DeviceManager::importData(const QString &path)
+{
+    if (!m_devices_model->hasDevices()) return false;
+    if (!m_dbInternal && !m_dbExternal) return false;
+    if (m_importThread) return false; // one at a time
 
-        efile.close();
+    // From a QML file dialog, or the command line
+    QString importFile = QUrl(path).isLocalFile() ? QUrl(path).toLocalFile() : path;
+    if (!QFile::exists(importFile))
+    {
+        qWarning() << "DeviceManager::importData() file not found:" << importFile;
+        return false;
     }
-    else
+
+    // Readings are only imported for the devices we know
+    QList <ImportDevice> devices;
+    for (auto d: qAsConst(m_devices_model->m_devices))
     {
-        qWarning() << "DeviceManager::exportData() cannot open export file: " << path;
-        status = false;
+        Device *dd = qobject_cast<Device*>(d);
+        if (dd)
+        {
+            ImportDevice i;
+            i.deviceAddr = dd->getAddress();
+            i.table = dd->isEnvironmentalSensor() ? DeviceReading::TABLE_SENSORDATA : DeviceReading::TABLE_PLANTDATA;
+            i.interval = dd->getReadingInterval(); // same rounding as the live readings
+            devices += i;
+        }
     }
 
-    return status;
+    ImportOptions options;
+    options.format = ImportOptions::formatFromPath(importFile);
+    options.fahrenheit = (SettingsManager::getInstance()->getTempUnit() != "C");
+
+    m_importThread = new QThread();
+    m_import = new DatabaseImport(devices, options, importFile);
+    m_import->moveToThread(m_importThread);
+    m_importProgress = 0.f;
+
+    connect(m_importThread, &QThread::started, m_import, &DatabaseImport::run);
+    connect(m_import, &DatabaseImport::progress, this, [this](float progress) {
+        m_importProgress = progress;
+        Q_EMIT importUpdated();
+    });
+    connect(m_import, &DatabaseImport::finished, this, [this](bool status, qint64 imported, qint64 rejected) {
+        Q_EMIT importFinished(status, imported, rejected);
+    });
+    connect(m_import, &DatabaseImport::finished, m_importThread, &QThread::quit, Qt::DirectConnection);
+    connect(m_importThread, &QThread::finished, m_import, &DatabaseImport::deleteLater);
+    connect(m_importThread, &QThread::finished, this, [this]() {
+        m_importThread->deleteLater();
+        m_importThread = nullptr;
+        m_import = nullptr;
+        Q_EMIT importUpdated();
+    });
+
+    m_importThread->start(QThread::LowPriority);
+    Q_EMIT importUpdated();
+
+    return true;
+}
+
+void DeviceManager::importDataCancel()
+{
+    if (m_import) m_import->cancel();
 }
 
 /* ************************************************************************** */
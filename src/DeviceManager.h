@@ -26,11 +26,14 @@
 #include "SettingsManager.h"
 #include "device_filter.h"
 #include "device_utils.h"
+#include "DatabaseExport.h"
+#include "DatabaseImport.h"
 
 #include <QObject>
 #include <QVariant>
 #include <QList>
 #include <QTimer>
+#include <QThread>
 
 #include <QBluetoothLocalDevice>
 #include <QBluetoothDeviceDiscoveryAgent>
@@ -55,12 +58,18 @@ class DeviceManager: public QObject
     Q_PROPERTY(bool refreshing READ isRefreshing NOTIFY refreshingChanged)
     Q_PROPERTY(bool updating READ isRefreshing NOTIFY refreshingChanged)
 
+    Q_PROPERTY(bool exporting READ isExporting NOTIFY exportUpdated)
+    Q_PROPERTY(float exportProgress READ getExportProgress NOTIFY exportUpdated)
+    Q_PROPERTY(bool importing READ isImporting NOTIFY importUpdated)
+    Q_PROPERTY(float importProgress READ getImportProgress NOTIFY importUpdated)
+
     Q_PROPERTY(bool bluetooth READ hasBluetooth NOTIFY bluetoothChanged)
     Q_PROPERTY(bool bluetoothAdapter READ hasBluetoothAdapter NOTIFY bluetoothChanged)
     Q_PROPERTY(bool bluetoothEnabled READ hasBluetoothEnabled NOTIFY bluetoothChanged)
 
     bool m_dbInternal = false;
     bool m_dbExternal = false;
+    bool m_dbMemory = false;
     bool m_btA = false;
     bool m_btE = false;
 
@@ -80,6 +89,18 @@ class DeviceManager: public QObject
     bool m_scanning = false;
     bool isScanning() const;
 
+    QThread *m_exportThread = nullptr;
+    DatabaseExport *m_export = nullptr;
+    float m_exportProgress = 0.f;
+    bool isExporting() const { return m_exportThread; }
+    float getExportProgress() const { return m_exportProgress; }
+
+    QThread *m_importThread = nullptr;
+    DatabaseImport *m_import = nullptr;
+    float m_importProgress = 0.f;
+    bool isImporting() const { return m_importThread; }
+    float getImportProgress() const { return m_importProgress; }
+
     bool hasBluetooth() const;
     bool hasBluetoothAdapter() const;
     bool hasBluetoothEnabled() const;
@@ -94,10 +115,19 @@ public:
     Q_INVOKABLE bool checkBluetooth();
     Q_INVOKABLE void enableBluetooth(bool enforceUserPermissionCheck = false);
 
-    Q_INVOKABLE bool exportDataSave();
-    Q_INVOKABLE QString exportDataOpen();
+    //! Exports run in the background, see exportFinished()
+    Q_INVOKABLE bool exportDataSave(const QString &format = "csv", bool gzip = false);
+    Q_INVOKABLE QString exportDataOpen(const QString &format = "csv", bool gzip = false);
     Q_INVOKABLE QString exportDataFolder();
-    bool exportData(const QString &path);
+    //! Only what's new since the previous incremental export of that directory
+    Q_INVOKABLE bool exportDataIncremental(const QString &directory = QString(),
+                                           const QString &format = "csv", bool gzip = false);
+    Q_INVOKABLE void exportDataCancel();
+    bool exportData(const QString &path, const ExportOptions &options);
+
+    //! Imports run in the background, see importFinished()
+    Q_INVOKABLE bool importData(const QString &path);
+    Q_INVOKABLE void importDataCancel();
 
     DeviceFilter *getDevicesFiltered() const { return m_devices_filter; }
 
@@ -152,6 +182,12 @@ Q_SIGNALS:
     void bluetoothChanged();
     void scanningChanged();
     void refreshingChanged();
+
+    void exportUpdated();
+    void exportFinished(bool status, const QString &path);
+
+    void importUpdated();
+    void importFinished(bool status, qint64 imported, qint64 rejected);
 };
 
 /* ************************************************************************** */
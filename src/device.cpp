@@ -23,6 +23,8 @@
 #include "SettingsManager.h"
 #include "DeviceManager.h"
 #include "NotificationManager.h"
+#include "DatabaseManager.h"
+#include "device_reading.h"
 #include "utils/utils_versionchecker.h"
 
 #include <cstdlib>
@@ -79,6 +81,12 @@ Device::Device(QString &deviceAddr, QString &deviceName, QObject *parent) : QObj
     m_rssiTimer.setSingleShot(true);
     m_rssiTimer.setInterval(10*1000); // 10s
     connect(&m_rssiTimer, &QTimer::timeout, this, &Device::cleanRssi);
+
+    // Configure metadata timer
+    m_metadataTimer.setSingleShot(true);
+    m_metadataTimer.setInterval(DEVICE_METADATA_DELAY*1000);
+    connect(&m_metadataTimer, &QTimer::timeout, this, &Device::flushMetadata);
+    connect(DatabaseManager::getInstance(), &DatabaseManager::writerStopping, this, &Device::flushMetadata);
 }
 
 Device::Device(const QBluetoothDeviceInfo &d, QObject *parent) : QObject(parent)
@@ -99,10 +107,18 @@ Device::Device(const QBluetoothDeviceInfo &d, QObject *parent) : QObject(parent)
 
     if (m_bleDevice.isValid() == false)
         qWarning() << "Device() '" << m_deviceAddress << "' is an invalid QBluetoothDeviceInfo...";
+
+    // Configure metadata timer
+    m_metadataTimer.setSingleShot(true);
+    m_metadataTimer.setInterval(DEVICE_METADATA_DELAY*1000);
+    connect(&m_metadataTimer, &QTimer::timeout, this, &Device::flushMetadata);
+    connect(DatabaseManager::getInstance(), &DatabaseManager::writerStopping, this, &Device::flushMetadata);
 }
 
 Device::~Device()
 {
+    flushMetadata();
+
     delete m_bleController;
 }
 
@@ -174,21 +190,13 @@ void Device::actionClearData()
 
     if (!isBusy())
     {
-        QSqlQuery deleteData;
-        if (isEnvironmentalSensor()) deleteData.prepare("DELETE FROM sensorData WHERE deviceAddr = :deviceAddr");
-        else deleteData.prepare("DELETE FROM plantData WHERE deviceAddr = :deviceAddr");
-        deleteData.bindValue(":deviceAddr", getAddress());
-        if (deleteData.exec())
+        if (DatabaseManager::getInstance()->clearDeviceData(getAddress()))
         {
             Q_EMIT dataUpdated();
 
             m_lastHistorySync = QDateTime();
             Q_EMIT historyUpdated();
         }
-        else
-        {
-            qWarning() << "> deleteData.exec() ERROR" << deleteData.lastError().type() << ":" << deleteData.lastError().text();
-        }
     }
 }
 
@@ -457,45 +465,68 @@ bool Device::getSqlDeviceInfos()
 
     if (m_dbInternal || m_dbExternal)
     {
-        QSqlQuery getInfos;
-        getInfos.prepare("SELECT deviceModel, deviceFirmware, deviceBattery, associatedName, locationName, lastSync, isOutside, settings" \
-                         " FROM devices WHERE deviceAddr = :deviceAddr");
+        QSqlQuery &getInfos = DatabaseManager::getInstance()->getStatement(DatabaseQueries::DEVICE_SELECT_INFOS);
         getInfos.bindValue(":deviceAddr", getAddress());
         if (getInfos.exec())
         {
             while (getInfos.next())
             {
-                m_deviceModel = getInfos.value(0).toString();
-                m_deviceFirmware = getInfos.value(1).toString();
-                m_deviceBattery = getInfos.value(2).toInt();
-                m_associatedName = getInfos.value(3).toString();
-                m_locationName = getInfos.value(4).toString();
-                m_lastHistorySync = getInfos.value(5).toDateTime();
-                //m_manualOrderIndex = 0; // TODO
-                m_isOutside = getInfos.value(6).toBool();
-
-                QString settings = getInfos.value(7).toString();
-                QJsonDocument doc = QJsonDocument::fromJson(settings.toUtf8());
-                if (!doc.isNull() && doc.isObject())
-                {
-                    m_additionalSettings = doc.object();
-                }
+                QVariantList infos;
+                for (int i = 0; i < 8; i++) infos += getInfos.value(i);
 
+                loadDeviceInfos(infos);
                 status = true;
-                Q_EMIT batteryUpdated();
-                Q_EMIT sensorUpdated();
-                Q_EMIT settingsUpdated();
             }
         }
         else
         {
             qWarning() << "> getInfos.exec() ERROR" << getInfos.lastError().type() << ":" << getInfos.lastError().text();
         }
+        getInfos.finish();
     }
 
     return status;
 }
 
+void Device::loadDeviceInfos(const QVariantList &infos)
+{
+    // DEVICE_SELECT_INFOS columns
+    if (infos.size() < 8) return;
+
+    m_deviceModel = infos.at(0).toString();
+    m_deviceFirmware = infos.at(1).toString();
+    m_deviceBattery = infos.at(2).toInt();
+    m_associatedName = infos.at(3).toString();
+    m_locationName = infos.at(4).toString();
+    m_lastHistorySync = infos.at(5).toDateTime();
+    //m_manualOrderIndex = 0; // TODO
+    m_isOutside = infos.at(6).toBool();
+
+    m_additionalSettingsJson = infos.at(7).toString();
+
+    Q_EMIT batteryUpdated();
+    Q_EMIT sensorUpdated();
+    Q_EMIT settingsUpdated();
+}
+
+int Device::getDeviceId() const
+{
+    // The id is only created by the DatabaseWriter, with the first reading it saves
+    if (m_dbDeviceId < 0 && (m_dbInternal || m_dbExternal))
+    {
+        QSqlQuery &getId = DatabaseManager::getInstance()->getStatement(DatabaseQueries::DEVICEID_SELECT);
+        getId.bindValue(":deviceAddr", getAddress());
+        if (getId.exec() == false)
+            qWarning() << "> getId.exec() ERROR" << getId.lastError().type() << ":" << getId.lastError().text();
+
+        if (getId.next())
+            m_dbDeviceId = getId.value(0).toInt();
+        getId.finish();
+    }
+
+    return m_dbDeviceId;
+}
+
 /* ************************************************************************** */
 /* ************************************************************************** */
 
@@ -681,14 +712,7 @@ void Device::setLocationName(const QString &name)
         m_locationName = name;
         //qDebug() << "setLocationName(" << m_locationName << ")";
 
-        if (m_dbInternal || m_dbExternal)
-        {
-            QSqlQuery updateLocation;
-            updateLocation.prepare("UPDATE devices SET locationName = :name WHERE deviceAddr = :deviceAddr");
-            updateLocation.bindValue(":name", name);
-            updateLocation.bindValue(":deviceAddr", getAddress());
-            updateLocation.exec();
-        }
+        setMetadata("locationName", name);
 
         Q_EMIT dataUpdated();
 
@@ -706,14 +730,7 @@ void Device::setAssociatedName(const QString &name)
         m_associatedName = name;
         //qDebug() << "setAssociatedName(" << m_associatedName << ")";
 
-        if (m_dbInternal || m_dbExternal)
-        {
-            QSqlQuery updatePlant;
-            updatePlant.prepare("UPDATE devices SET associatedName = :name WHERE deviceAddr = :deviceAddr");
-            updatePlant.bindValue(":name", name);
-            updatePlant.bindValue(":deviceAddr", getAddress());
-            updatePlant.exec();
-        }
+        setMetadata("associatedName", name);
 
         Q_EMIT dataUpdated();
 
@@ -730,14 +747,7 @@ void Device::setOutside(const bool outside)
     {
         m_isOutside = outside;
 
-        if (m_dbInternal || m_dbExternal)
-        {
-            QSqlQuery updateOutside;
-            updateOutside.prepare("UPDATE devices SET isOutside = :outside WHERE deviceAddr = :deviceAddr");
-            updateOutside.bindValue(":outside", outside);
-            updateOutside.bindValue(":deviceAddr", getAddress());
-            updateOutside.exec();
-        }
+        setMetadata("isOutside", outside);
 
         Q_EMIT sensorUpdated();
     }
@@ -745,18 +755,33 @@ void Device::setOutside(const bool outside)
 
 /* ************************************************************************** */
 
+const QJsonObject &Device::additionalSettings() const
+{
+    if (!m_additionalSettingsJson.isEmpty())
+    {
+        QJsonDocument doc = QJsonDocument::fromJson(m_additionalSettingsJson.toUtf8());
+        if (!doc.isNull() && doc.isObject())
+        {
+            m_additionalSettings = doc.object();
+        }
+        m_additionalSettingsJson.clear();
+    }
+
+    return m_additionalSettings;
+}
+
 bool Device::hasSetting(const QString &key) const
 {
     //qDebug() << "Device::hasSetting(" << key << ")";
 
-    return !m_additionalSettings.value(key).isUndefined();
+    return !additionalSettings().value(key).isUndefined();
 }
 
 QVariant Device::getSetting(const QString &key) const
 {
     //qDebug() << "Device::getSetting(" << key << ")";
 
-    return m_additionalSettings.value(key);
+    return additionalSettings().value(key);
 }
 
 bool Device::setSetting(const QString &key, QVariant value)
@@ -764,19 +789,14 @@ bool Device::setSetting(const QString &key, QVariant value)
     //qDebug() << "Device::setSetting(" << key << value << ")";
     bool status = false;
 
+    additionalSettings();
     m_additionalSettings.insert(key, value.toString());
 
-    if (m_dbInternal || m_dbExternal)
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
     {
-        QJsonDocument json(m_additionalSettings);
-        QString json_str = QString(json.toJson());
-
-        QSqlQuery updateSettings;
-        updateSettings.prepare("UPDATE devices SET settings = :settings WHERE deviceAddr = :deviceAddr");
-        updateSettings.bindValue(":settings", json_str);
-        updateSettings.bindValue(":deviceAddr", getAddress());
-        if (updateSettings.exec() == false)
-            qWarning() << "> updateSettings.exec() ERROR" << updateSettings.lastError().type() << ":" << updateSettings.lastError().text();
+        m_settingsChanged = true;
+        if (!m_metadataTimer.isActive()) m_metadataTimer.start();
+        status = true;
     }
 
     Q_EMIT sensorUpdated();
@@ -792,15 +812,7 @@ void Device::setFirmware(const QString &firmware)
     {
         m_deviceFirmware = firmware;
 
-        if (m_dbInternal || m_dbExternal)
-        {
-            QSqlQuery setFirmware;
-            setFirmware.prepare("UPDATE devices SET deviceFirmware = :firmware WHERE deviceAddr = :deviceAddr");
-            setFirmware.bindValue(":firmware", m_deviceFirmware);
-            setFirmware.bindValue(":deviceAddr", getAddress());
-            if (setFirmware.exec() == false)
-                qWarning() << "> setFirmware.exec() ERROR" << setFirmware.lastError().type() << ":" << setFirmware.lastError().text();
-        }
+        setMetadata("deviceFirmware", m_deviceFirmware);
 
         Q_EMIT sensorUpdated();
     }
@@ -820,15 +832,7 @@ void Device::setBattery(const int battery)
         {
             m_deviceBattery = battery;
 
-            if (m_dbInternal || m_dbExternal)
-            {
-                QSqlQuery setBattery;
-                setBattery.prepare("UPDATE devices SET deviceBattery = :battery WHERE deviceAddr = :deviceAddr");
-                setBattery.bindValue(":battery", m_deviceBattery);
-                setBattery.bindValue(":deviceAddr", getAddress());
-                if (setBattery.exec() == false)
-                    qWarning() << "> setBattery.exec() ERROR" << setBattery.lastError().type() << ":" << setBattery.lastError().text();
-            }
+            setMetadata("deviceBattery", m_deviceBattery);
 
             Q_EMIT batteryUpdated();
         }
@@ -837,31 +841,53 @@ void Device::setBattery(const int battery)
 
 void Device::setBatteryFirmware(const int battery, const QString &firmware)
 {
-    bool changes = false;
-
     if (battery > 0 && battery <= 100 && m_deviceBattery != battery)
     {
         m_deviceBattery = battery;
+        setMetadata("deviceBattery", m_deviceBattery);
         Q_EMIT batteryUpdated();
-        changes = true;
     }
     if (!firmware.isEmpty() && m_deviceFirmware != firmware)
     {
         m_deviceFirmware = firmware;
+        setMetadata("deviceFirmware", m_deviceFirmware);
         Q_EMIT sensorUpdated();
-        changes = true;
     }
+}
+
+/* ************************************************************************** */
+
+/*!
+ * \brief Device::setMetadata
+ * \param column: a 'devices' table column
+ *
+ * Metadata changes are not written right away: a refresh usually changes the
+ * battery, the firmware and a setting or two one after another, so they are
+ * all written together, with a single UPDATE, a few seconds later.
+ */
+void Device::setMetadata(const QString &column, const QVariant &value)
+{
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
+    {
+        m_metadataChanges.insert(column, value);
+        if (!m_metadataTimer.isActive()) m_metadataTimer.start();
+    }
+}
 
-    if ((m_dbInternal || m_dbExternal) && changes)
+void Device::flushMetadata()
+{
+    m_metadataTimer.stop();
+
+    if (m_settingsChanged)
     {
-        QSqlQuery setBatteryFirmware;
-        setBatteryFirmware.prepare("UPDATE devices SET deviceBattery = :battery, deviceFirmware = :firmware WHERE deviceAddr = :deviceAddr");
-        setBatteryFirmware.bindValue(":battery", m_deviceBattery);
-        setBatteryFirmware.bindValue(":firmware", m_deviceFirmware);
-        setBatteryFirmware.bindValue(":deviceAddr", getAddress());
-        if (setBatteryFirmware.exec() == false)
-            qWarning() << "> setBatteryFirmware.exec() ERROR" << setBatteryFirmware.lastError().type() << ":" << setBatteryFirmware.lastError().text();
+        QJsonDocument json(m_additionalSettings);
+        m_metadataChanges.insert("settings", QString(json.toJson()));
+        m_settingsChanged = false;
     }
+    if (m_metadataChanges.isEmpty()) return;
+
+    DatabaseManager::getInstance()->updateDevice(getAddress(), m_metadataChanges);
+    m_metadataChanges.clear();
 }
 
 /* ************************************************************************** */
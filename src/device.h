@@ -38,6 +38,8 @@
 
 #include "device_utils.h"
 
+#define DEVICE_METADATA_DELAY   5   // s, the 'devices' table is updated at most once per delay
+
 /* ************************************************************************** */
 
 /*!
@@ -153,7 +155,13 @@ protected:
     QString m_locationName;
     int m_manualOrderIndex = -1;
     bool m_isOutside = false;
-    QJsonObject m_additionalSettings;
+    mutable QJsonObject m_additionalSettings;
+    mutable QString m_additionalSettingsJson;   //!< Parsed on first use, see additionalSettings()
+
+    // Metadata changes, written to the 'devices' table by flushMetadata()
+    QVariantMap m_metadataChanges;  //!< column > value
+    bool m_settingsChanged = false; //!< m_additionalSettings is serialized on flush, not on each change
+    QTimer m_metadataTimer;
 
     // Status
     int m_ble_status = 0;           //!< See DeviceStatus enum
@@ -202,9 +210,14 @@ protected:
     virtual void refreshHistoryFinished(bool status);
 
     virtual bool getSqlDeviceInfos();
+    virtual void loadDeviceInfos(const QVariantList &infos);
+    const QJsonObject &additionalSettings() const;
+    void setMetadata(const QString &column, const QVariant &value);
 
     bool m_dbInternal = false;
     bool m_dbExternal = false;
+    bool m_dbMemory = false;
+    mutable int m_dbDeviceId = -1;  //!< Our id in the data tables, see getDeviceId()
 
 public:
     Device(QString &deviceAddr, QString &deviceName, QObject *parent = nullptr);
@@ -229,6 +242,8 @@ public slots:
     void refreshRetry();
     void refreshStop();
 
+    void flushMetadata();           //!< Write the pending metadata changes now
+
     // Status
     int getStatus() const { return m_ble_status; }
     bool isDataFresh() const;           //!< Has at least >Xh (user set) old data
@@ -256,6 +271,7 @@ public slots:
     QString getModel() const { return m_deviceModel; }
     QString getName() const { return m_deviceName; }
     QString getAddress() const { return m_deviceAddress; }
+    int getDeviceId() const;
     QString getFirmware() const { return m_deviceFirmware; }
     int getBatteryLevel() const { return m_deviceBattery; }
 
@@ -296,6 +312,7 @@ public:
 
     bool hasRealTime() const { return (m_deviceCapabilities & DeviceUtils::DEVICE_REALTIME); }
     virtual bool hasHistory() const { return (m_deviceCapabilities & DeviceUtils::DEVICE_HISTORY); }
+    virtual int getReadingInterval() const { return 3600; } //!< Readings are stored once per interval (in seconds)
     bool hasBatteryLevel() const { return (m_deviceCapabilities & DeviceUtils::DEVICE_BATTERY); }
     bool hasClock() const { return (m_deviceCapabilities & DeviceUtils::DEVICE_CLOCK); }
     bool hasLED() const { return (m_deviceCapabilities & DeviceUtils::DEVICE_LED_STATUS); }
@@ -0,0 +1,83 @@
+/*!
+ * This file is part of WatchFlower.
+ * COPYRIGHT (C) 2020 Emeric Grange - All Rights Reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \date      2021
+ * \author    Emeric Grange <emeric.grange@gmail.com>
+ */
+
+#ifndef DEVICE_READING_H
+#define DEVICE_READING_H
+/* ************************************************************************** */
+
+#include "device_utils.h"
+
+#include <QString>
+#include <QDateTime>
+#include <QtAlgorithms>
+
+/* ************************************************************************** */
+
+/*!
+ * \brief The DeviceReading class
+ *
+ * A single sensor reading, as produced by a device driver, waiting to be saved
+ * into the database. Values are indexed by their DeviceUtils::DeviceSensors bit.
+ */
+class DeviceReading
+{
+public:
+    enum ReadingTable {
+        TABLE_PLANTDATA             = 0, //!< plantData (plant sensors and thermometers)
+        TABLE_SENSORDATA            = 1, //!< sensorData (environmental sensors)
+    };
+
+    DeviceReading() = default;
+    DeviceReading(ReadingTable t, const QString &addr, const QDateTime &time, int intervalSec = 3600)
+        : table(t), deviceAddr(addr), timestamp(time), interval(intervalSec) {}
+
+    int table = TABLE_PLANTDATA;
+    QString deviceAddr;
+    QDateTime timestamp;            //!< Time of the actual reading
+    int interval = 3600;            //!< We only save one value per interval (in seconds)
+
+    quint32 metrics = 0;            //!< DeviceUtils::DeviceSensors bitfield
+    float values[32] = {};
+
+    static int metricIndex(const quint32 metric) { return qCountTrailingZeroBits(metric); }
+
+    void set(const quint32 metric, const float value)
+    {
+        metrics |= metric;
+        values[metricIndex(metric)] = value;
+    }
+    bool has(const quint32 metric) const { return (metrics & metric); }
+    float value(const quint32 metric) const { return values[metricIndex(metric)]; }
+
+    //! Timestamp rounded down to the storage interval (this is part of the primary key)
+    QDateTime roundedTimestamp() const
+    {
+        if (interval <= 1)
+            return QDateTime(timestamp.date(), QTime(timestamp.time().hour(), timestamp.time().minute(), timestamp.time().second()));
+
+        int secs = QTime(0, 0).secsTo(timestamp.time());
+        secs -= (secs % interval);
+        return QDateTime(timestamp.date(), QTime(0, 0).addSecs(secs));
+    }
+};
+
+/* ************************************************************************** */
+#endif // DEVICE_READING_H
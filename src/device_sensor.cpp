@@ -22,6 +22,9 @@
 #include "device_sensor.h"
 #include "SettingsManager.h"
 #include "DatabaseManager.h"
+#include "DatabaseQueries.h"
+#include "DatabasePartitions.h"
+#include "DatabaseSeries.h"
 #include "DeviceManager.h"
 #include "NotificationManager.h"
 #include "utils/utils_versionchecker.h"
@@ -31,8 +34,11 @@
 
 #include <QDateTime>
 #include <QTimer>
+#include <QSignalBlocker>
 #include <QDebug>
 
+#include <limits>
+
 /* ************************************************************************** */
 
 DeviceSensor::DeviceSensor(QString &deviceAddr, QString &deviceName, QObject *parent) :
@@ -44,17 +50,24 @@ DeviceSensor::DeviceSensor(QString &deviceAddr, QString &deviceName, QObject *pa
     {
         m_dbInternal = db->hasDatabaseInternal();
         m_dbExternal = db->hasDatabaseExternal();
+        m_dbMemory = db->hasDatabaseMemory();
+
+        // Our readings are written asynchronously, refresh the graphs once they're in
+        connect(db, &DatabaseManager::dataWritten, this, &DeviceSensor::databaseWritten);
     }
 
     // Load device infos and limits
-    if (m_dbInternal || m_dbExternal)
+    DevicePreload preload;
+    if ((m_dbInternal || m_dbExternal) && db->takePreload(getAddress(), preload))
+    {
+        // Bulk loaded by the DeviceManager
+        loadPreload(preload);
+    }
+    else if (m_dbInternal || m_dbExternal)
     {
         getSqlDeviceInfos();
-        getSqlPlantLimits();
         // Load initial data into the GUI (if they are no more than 12h old)
-        bool data = false;
-        if (!data) data = getSqlPlantData(12*60);
-        if (!data) data = getSqlSensorData(12*60);
+        getSqlLatestValues(12*60);
     }
 
     // Configure timeout timer
@@ -74,17 +87,24 @@ DeviceSensor::DeviceSensor(const QBluetoothDeviceInfo &d, QObject *parent) :
     {
         m_dbInternal = db->hasDatabaseInternal();
         m_dbExternal = db->hasDatabaseExternal();
+        m_dbMemory = db->hasDatabaseMemory();
+
+        // Our readings are written asynchronously, refresh the graphs once they're in
+        connect(db, &DatabaseManager::dataWritten, this, &DeviceSensor::databaseWritten);
     }
 
     // Load device infos and limits
-    if (m_dbInternal || m_dbExternal)
+    DevicePreload preload;
+    if ((m_dbInternal || m_dbExternal) && db->takePreload(getAddress(), preload))
+    {
+        // Bulk loaded by the DeviceManager
+        loadPreload(preload);
+    }
+    else if (m_dbInternal || m_dbExternal)
     {
         getSqlDeviceInfos();
-        getSqlPlantLimits();
         // Load initial data into the GUI (if they are no more than 12h old)
-        bool data = false;
-        if (!data) data = getSqlPlantData(12*60);
-        if (!data) data = getSqlSensorData(12*60);
+        getSqlLatestValues(12*60);
     }
 
     // Configure timeout timer
@@ -100,6 +120,16 @@ DeviceSensor::~DeviceSensor()
     //
 }
 
+/* ************************************************************************** */
+
+void DeviceSensor::databaseWritten(const QStringList &deviceAddrs)
+{
+    if (deviceAddrs.contains(getAddress()))
+    {
+        Q_EMIT dataUpdated();
+    }
+}
+
 /* ************************************************************************** */
 /* ************************************************************************** */
 
@@ -126,7 +156,7 @@ void DeviceSensor::refreshDataFinished(bool status, bool cached)
             if (sm->getNotifs())
             {
                 // Only if the sensor has a plant
-                if (m_soil_moisture > 0 && m_soil_moisture < m_limitHygroMin)
+                if (m_soil_moisture > 0 && m_soil_moisture < getLimitHygroMin())
                 {
                     NotificationManager *nm = NotificationManager::getInstance();
                     if (nm)
@@ -160,22 +190,17 @@ void DeviceSensor::refreshHistoryFinished(bool status)
 
     if (m_lastHistorySync.isValid())
     {
-        // Write last sync
-        QSqlQuery updateDeviceLastSync;
-        updateDeviceLastSync.prepare("UPDATE devices SET lastSync = :sync WHERE deviceAddr = :deviceAddr");
-        updateDeviceLastSync.bindValue(":sync", m_lastHistorySync.toString("yyyy-MM-dd hh:mm:ss"));
-        updateDeviceLastSync.bindValue(":deviceAddr", getAddress());
-        if (updateDeviceLastSync.exec() == false)
-            qWarning() << "> updateDeviceLastSync.exec() ERROR" << updateDeviceLastSync.lastError().type() << ":" << updateDeviceLastSync.lastError().text();
+        // Write last sync, along with the history entries still in the writer queue,
+        // so the next session never starts past what has actually been saved
+        DatabaseManager::getInstance()->endHistorySession(getAddress(), m_lastHistorySync);
     }
 }
 
 /* ************************************************************************** */
 
-bool DeviceSensor::getSqlDeviceInfos()
+void DeviceSensor::loadDeviceInfos(const QVariantList &infos)
 {
-    //qDebug() << "DeviceSensor::getSqlDeviceInfos(" << m_deviceAddress << ")";
-    bool status = Device::getSqlDeviceInfos();
+    Device::loadDeviceInfos(infos);
 
     if ((m_deviceName == "Flower care" || m_deviceName == "Flower mate") && (m_deviceFirmware.size() == 5))
     {
@@ -265,8 +290,6 @@ bool DeviceSensor::getSqlDeviceInfos()
             Q_EMIT sensorUpdated();
         }
     }
-
-    return status;
 }
 
 bool DeviceSensor::getSqlPlantLimits()
@@ -274,97 +297,58 @@ bool DeviceSensor::getSqlPlantLimits()
     //qDebug() << "DeviceSensor::getSqlPlantLimits(" << m_deviceAddress << ")";
     bool status = false;
 
-    QSqlQuery getLimits;
-    getLimits.prepare("SELECT hygroMin, hygroMax, conduMin, conduMax, phMin, phMax, " \
-                      " tempMin, tempMax, humiMin, humiMax, " \
-                      " luxMin, luxMax, mmolMin, mmolMax " \
-                      "FROM plantLimits WHERE deviceAddr = :deviceAddr");
+    QSqlQuery &getLimits = DatabaseManager::getInstance()->getStatement(DatabaseQueries::PLANTLIMITS_SELECT);
     getLimits.bindValue(":deviceAddr", getAddress());
     getLimits.exec();
     while (getLimits.next())
     {
-        m_limitHygroMin = getLimits.value(0).toInt();
-        m_limitHygroMax = getLimits.value(1).toInt();
-        m_limitConduMin = getLimits.value(2).toInt();
-        m_limitConduMax = getLimits.value(3).toInt();
-        m_limitPhMin = getLimits.value(4).toInt();
-        m_limitPhMax = getLimits.value(5).toInt();
-        m_limitTempMin = getLimits.value(6).toInt();
-        m_limitTempMax = getLimits.value(7).toInt();
-        m_limitHumiMin = getLimits.value(8).toInt();
-        m_limitHumiMax = getLimits.value(9).toInt();
-        m_limitLuxMin = getLimits.value(10).toInt();
-        m_limitLuxMax = getLimits.value(11).toInt();
-        m_limitMmolMin = getLimits.value(12).toInt();
-        m_limitMmolMax = getLimits.value(13).toInt();
+        QVariantList limits;
+        for (int i = 0; i < 14; i++) limits += getLimits.value(i);
 
+        loadPlantLimits(limits);
         status = true;
-        Q_EMIT limitsUpdated();
     }
+    getLimits.finish();
 
     return status;
 }
 
-bool DeviceSensor::getSqlPlantData(int minutes)
+void DeviceSensor::hydrateLimits() const
 {
-    //qDebug() << "DeviceSensor::getSqlPlantData(" << m_deviceAddress << ")";
-    bool status = false;
+    // Loaded on first use, most devices are never opened
+    if (m_limitsLoaded) return;
+    m_limitsLoaded = true;
 
-    QSqlQuery cachedData;
-    if (m_dbInternal) // sqlite
-    {
-        cachedData.prepare("SELECT ts_full, soilMoisture, soilConductivity, soilTemperature, soilPH, temperature, humidity, luminosity, watertank " \
-                           "FROM plantData " \
-                           "WHERE deviceAddr = :deviceAddr AND ts_full >= datetime('now', 'localtime', '-" + QString::number(minutes) + " minutes');");
-    }
-    else if (m_dbExternal) // mysql
-    {
-        cachedData.prepare("SELECT DATE_FORMAT(ts_full, '%Y-%m-%e %H:%i:%s'), soilMoisture, soilConductivity, soilTemperature, soilPH, temperature, humidity, luminosity, watertank " \
-                           "FROM plantData " \
-                           "WHERE deviceAddr = :deviceAddr AND ts_full >= TIMESTAMPADD(MINUTE,-" + QString::number(minutes) + ",NOW());");
-    }
-    cachedData.bindValue(":deviceAddr", getAddress());
-
-    if (cachedData.exec() == false)
-    {
-        qWarning() << "> cachedData.exec() ERROR" << cachedData.lastError().type() << ":" << cachedData.lastError().text();
-    }
-    else
+    if (m_dbInternal || m_dbExternal)
     {
-#ifndef QT_NO_DEBUG
-        qDebug() << "* Device loaded:" << getAddress();
-#endif
-    }
-
-    while (cachedData.next())
-    {
-        m_soil_moisture =  cachedData.value(1).toInt();
-        m_soil_conductivity = cachedData.value(2).toInt();
-        m_soil_temperature = cachedData.value(3).toFloat();
-        m_soil_ph = cachedData.value(4).toFloat();
-        m_temperature = cachedData.value(5).toFloat();
-        m_humidity =  cachedData.value(6).toFloat();
-        m_luminosity = cachedData.value(7).toInt();
-        m_watertank_level = cachedData.value(8).toFloat();
-
-        QString datetime = cachedData.value(0).toString();
-        m_lastUpdateDatabase = m_lastUpdate = QDateTime::fromString(datetime, "yyyy-MM-dd hh:mm:ss");
-/*
-        qDebug() << ">> timestamp" << m_lastUpdate;
-        qDebug() << "- m_soil_moisture:" << m_soil_moisture;
-        qDebug() << "- m_soil_conductivity:" << m_soil_conductivity;
-        qDebug() << "- m_soil_temperature:" << m_soil_temperature;
-        qDebug() << "- m_soil_ph:" << m_soil_ph;
-        qDebug() << "- m_temperature:" << m_temperature;
-        qDebug() << "- m_humidity:" << m_humidity;
-        qDebug() << "- m_luminosity:" << m_luminosity;
-        qDebug() << "- m_watertank_level:" << m_watertank_level;
-*/
-        status = true;
+        // Usually called from a QML property read, don't notify in the middle of it
+        DeviceSensor *self = const_cast <DeviceSensor *>(this);
+        const QSignalBlocker blocker(self);
+        self->getSqlPlantLimits();
     }
+}
 
-    refreshDataFinished(status, true);
-    return status;
+void DeviceSensor::loadPlantLimits(const QVariantList &limits)
+{
+    // PLANTLIMITS_SELECT columns
+    if (limits.size() < 14) return;
+
+    m_limitHygroMin = limits.at(0).toInt();
+    m_limitHygroMax = limits.at(1).toInt();
+    m_limitConduMin = limits.at(2).toInt();
+    m_limitConduMax = limits.at(3).toInt();
+    m_limitPhMin = limits.at(4).toInt();
+    m_limitPhMax = limits.at(5).toInt();
+    m_limitTempMin = limits.at(6).toInt();
+    m_limitTempMax = limits.at(7).toInt();
+    m_limitHumiMin = limits.at(8).toInt();
+    m_limitHumiMax = limits.at(9).toInt();
+    m_limitLuxMin = limits.at(10).toInt();
+    m_limitLuxMax = limits.at(11).toInt();
+    m_limitMmolMin = limits.at(12).toInt();
+    m_limitMmolMax = limits.at(13).toInt();
+
+    Q_EMIT limitsUpdated();
 }
 
 /* ************************************************************************** */
@@ -379,97 +363,93 @@ bool DeviceSensor::getSqlSensorLimits()
     return status;
 }
 
-bool DeviceSensor::getSqlSensorData(int minutes)
+void DeviceSensor::setLatestValue(quint32 metric, float value)
 {
-    //qDebug() << "DeviceSensor::getSqlSensorData(" << m_deviceAddress << ")";
-    bool status = false;
-
-    QSqlQuery cachedData;
-    if (m_dbInternal) // sqlite
-    {
-        cachedData.prepare("SELECT timestamp, temperature, humidity, pressure, luminosity, uv, sound, water, windDirection, windSpeed, " \
-                             "pm1, pm25, pm10, o2, o3, co, co2, no2, so2, voc, hcho, geiger " \
-                           "FROM sensorData " \
-                           "WHERE deviceAddr = :deviceAddr AND timestamp >= datetime('now', 'localtime', '-" + QString::number(minutes) + " minutes');");
-    }
-    else if (m_dbExternal) // mysql
+    switch (metric)
     {
-        cachedData.prepare("SELECT DATE_FORMAT(timestamp, '%Y-%m-%e %H:%i:%s'), temperature, humidity, pressure, luminosity, uv, sound, water, windDirection, windSpeed, " \
-                             "pm1, pm25, pm10, o2, o3, co, co2, no2, so2, voc, hcho, geiger " \
-                           "FROM sensorData " \
-                           "WHERE deviceAddr = :deviceAddr AND timestamp >= TIMESTAMPADD(MINUTE,-" + QString::number(minutes) + ",NOW());");
+    // plant data
+    case DeviceUtils::SENSOR_SOIL_MOISTURE: m_soil_moisture = static_cast<int>(value); break;
+    case DeviceUtils::SENSOR_SOIL_CONDUCTIVITY: m_soil_conductivity = static_cast<int>(value); break;
+    case DeviceUtils::SENSOR_SOIL_TEMPERATURE: m_soil_temperature = value; break;
+    case DeviceUtils::SENSOR_SOIL_PH: m_soil_ph = value; break;
+    // hygrometer data
+    case DeviceUtils::SENSOR_TEMPERATURE: m_temperature = value; break;
+    case DeviceUtils::SENSOR_HUMIDITY: m_humidity = value; break;
+    // environmental data
+    case DeviceUtils::SENSOR_PRESSURE: m_pressure = value; break;
+    case DeviceUtils::SENSOR_LUMINOSITY: m_luminosity = static_cast<int>(value); break;
+    case DeviceUtils::SENSOR_UV: m_uv = value; break;
+    case DeviceUtils::SENSOR_SOUND: m_sound_level = value; break;
+    case DeviceUtils::SENSOR_WATER_LEVEL: (isEnvironmentalSensor() ? m_water_level : m_watertank_level) = value; break;
+    case DeviceUtils::SENSOR_WIND_DIRECTION: m_wind_direction = value; break;
+    case DeviceUtils::SENSOR_WIND_SPEED: m_wind_speed = value; break;
+    case DeviceUtils::SENSOR_PM1: m_pm_1 = value; break;
+    case DeviceUtils::SENSOR_PM25: m_pm_25 = value; break;
+    case DeviceUtils::SENSOR_PM10: m_pm_10 = value; break;
+    case DeviceUtils::SENSOR_O2: m_o2 = value; break;
+    case DeviceUtils::SENSOR_O3: m_o3 = value; break;
+    case DeviceUtils::SENSOR_CO: m_co = value; break;
+    case DeviceUtils::SENSOR_CO2: m_co2 = value; break;
+    case DeviceUtils::SENSOR_NO2: m_no2 = value; break;
+    case DeviceUtils::SENSOR_SO2: m_so2 = value; break;
+    case DeviceUtils::SENSOR_VOC: m_voc = value; break;
+    case DeviceUtils::SENSOR_HCHO: m_hcho = value; break;
+    case DeviceUtils::SENSOR_GEIGER: m_rh = m_rm = m_rs = value; break;
     }
-    cachedData.bindValue(":deviceAddr", getAddress());
+}
+
+bool DeviceSensor::getSqlLatestValues(int minutes)
+{
+    //qDebug() << "DeviceSensor::getSqlLatestValues(" << m_deviceAddress << ")";
+    bool status = false;
+    qint64 lastTs = 0;
+
+    qint64 ts = QDateTime::currentDateTime().addSecs(-60 * minutes).toSecsSinceEpoch();
 
-    if (cachedData.exec() == false)
+    // One row per metric, kept up to date by the DatabaseWriter
+    QSqlQuery &latestValues = DatabaseManager::getInstance()->getStatement(DatabaseQueries::LATEST_VALUES_SELECT);
+    latestValues.bindValue(":deviceId", getDeviceId());
+    latestValues.bindValue(":ts", ts);
+
+    if (latestValues.exec() == false)
+        qWarning() << "> latestValues.exec() ERROR" << latestValues.lastError().type() << ":" << latestValues.lastError().text();
+
+    while (latestValues.next())
     {
-        qWarning() << "> cachedData.exec() ERROR" << cachedData.lastError().type() << ":" << cachedData.lastError().text();
+        setLatestValue(latestValues.value(0).toUInt(), latestValues.value(2).toFloat());
+
+        lastTs = std::max(lastTs, latestValues.value(1).toLongLong());
+        status = true;
     }
-    else
-    {
+    latestValues.finish();
+
+    if (status) m_lastUpdateDatabase = m_lastUpdate = QDateTime::fromSecsSinceEpoch(lastTs);
+
 #ifndef QT_NO_DEBUG
-        qDebug() << "* Device loaded:" << getAddress();
+    if (status) qDebug() << "* Device loaded:" << getAddress();
 #endif
-    }
 
-    while (cachedData.next())
+    refreshDataFinished(status, true);
+    return status;
+}
+
+void DeviceSensor::loadPreload(const DevicePreload &preload)
+{
+    // Same as getSqlDeviceInfos() and getSqlLatestValues(), without the queries
+    if (preload.deviceId >= 0) m_dbDeviceId = preload.deviceId;
+    if (!preload.infos.isEmpty()) loadDeviceInfos(preload.infos);
+
+    qint64 lastTs = 0;
+    for (const auto &l: preload.latest)
     {
-        // hygrometer data
-        m_temperature = cachedData.value(1).toFloat();
-        m_humidity = cachedData.value(2).toFloat();
-        // environmental data
-        m_pressure = cachedData.value(3).toFloat();
-        m_luminosity = cachedData.value(4).toInt();
-        m_uv = cachedData.value(5).toFloat();
-        m_sound_level = cachedData.value(6).toFloat();
-        m_water_level = cachedData.value(7).toFloat();
-        m_wind_direction = cachedData.value(8).toFloat();
-        m_wind_speed = cachedData.value(9).toFloat();
-        m_pm_1 = cachedData.value(10).toFloat();
-        m_pm_25 = cachedData.value(11).toFloat();
-        m_pm_10 = cachedData.value(12).toFloat();
-        m_o2 = cachedData.value(13).toFloat();
-        m_o3 = cachedData.value(14).toFloat();
-        m_co = cachedData.value(15).toFloat();
-        m_co2 = cachedData.value(16).toFloat();
-        m_no2 = cachedData.value(17).toFloat();
-        m_so2 = cachedData.value(18).toFloat();
-        m_voc = cachedData.value(19).toFloat();
-        m_hcho = cachedData.value(20).toFloat();
-        m_rh = m_rm = m_rs = cachedData.value(21).toFloat();
-
-        QString datetime = cachedData.value(0).toString();
-        m_lastUpdateDatabase = m_lastUpdate = QDateTime::fromString(datetime, "yyyy-MM-dd hh:mm:ss");
-/*
-        qDebug() << ">> timestamp" << m_lastUpdate;
-        qDebug() << "- m_temperature:" << m_temperature;
-        qDebug() << "- m_humidity:" << m_humidity;
-        qDebug() << "- m_pressure:" << m_pressure;
-        qDebug() << "- m_luminosity:" << m_luminosity;
-        qDebug() << "- m_uv:" << m_uv;
-        qDebug() << "- m_luminosity:" << m_luminosity;
-        qDebug() << "- m_water_level:" << m_water_level;
-        qDebug() << "- m_sound_level:" << m_sound_level;
-        qDebug() << "- m_wind_direction:" << m_wind_direction;
-        qDebug() << "- m_wind_speed:" << m_wind_speed;
-        qDebug() << "- m_pm_1:" << m_pm_1;
-        qDebug() << "- m_pm_25:" << m_pm_25;
-        qDebug() << "- m_pm_10:" << m_pm_10;
-        qDebug() << "- m_o2:" << m_o2;
-        qDebug() << "- m_o3:" << m_o3;
-        qDebug() << "- m_co:" << m_co;
-        qDebug() << "- m_co2:" << m_co2;
-        qDebug() << "- m_no2:" << m_no2;
-        qDebug() << "- m_so2:" << m_so2;
-        qDebug() << "- m_voc:" << m_voc;
-        qDebug() << "- m_hcho:" << m_hcho;
-        qDebug() << "- m_rm:" << m_rm;
-*/
-        status = true;
+        setLatestValue(l.first, l.second.value);
+        lastTs = std::max(lastTs, l.second.ts);
     }
 
+    bool status = !preload.latest.isEmpty();
+    if (status) m_lastUpdateDatabase = m_lastUpdate = QDateTime::fromSecsSinceEpoch(lastTs);
+
     refreshDataFinished(status, true);
-    return status;
 }
 
 /* ************************************************************************** */
@@ -495,23 +475,28 @@ bool DeviceSensor::hasData() const
             m_pm_10 > 0 || m_co2 > 0 || m_voc > 0 || m_rm > 0)
             return true;
 
-        tableName = "sensorData";
+        tableName = DatabasePartitions::getInstance()->baseTable(DeviceReading::TABLE_SENSORDATA);
     }
 
     // Otherwise, check if we have stored data
     if (m_dbInternal || m_dbExternal)
     {
-        QSqlQuery hasData;
-        hasData.prepare("SELECT COUNT(*) FROM " + tableName + " WHERE deviceAddr = :deviceAddr;");
-        hasData.bindValue(":deviceAddr", getAddress());
+        // Latest partition first, that's where we have the best chance to find something
+        const QStringList tables = DatabasePartitions::getInstance()->tables(tableName);
+        for (auto t = tables.crbegin(); t != tables.crend(); ++t)
+        {
+            QSqlQuery hasData;
+            hasData.prepare(DatabaseQueries::get(DatabaseQueries::DATA_COUNT).arg(*t));
+            hasData.bindValue(":deviceId", getDeviceId());
 
-        if (hasData.exec() == false)
-            qWarning() << "> hasData.exec() ERROR" << hasData.lastError().type() << ":" << hasData.lastError().text();
+            if (hasData.exec() == false)
+                qWarning() << "> hasData.exec() ERROR" << hasData.lastError().type() << ":" << hasData.lastError().text();
 
-        while (hasData.next())
-        {
-            if (hasData.value(0).toInt() > 0) // data count
-                return true;
+            while (hasData.next())
+            {
+                if (hasData.value(0).toInt() > 0) // data count
+                    return true;
+            }
         }
     }
 
@@ -520,7 +505,7 @@ bool DeviceSensor::hasData() const
 
 bool DeviceSensor::hasData(const QString &dataName) const
 {
-    QString tableName;
+    DeviceReading::ReadingTable table = DeviceReading::TABLE_PLANTDATA;
 
     if (isPlantSensor() || isThermometer())
     {
@@ -537,8 +522,6 @@ bool DeviceSensor::hasData(const QString &dataName) const
             return true;
         else if (dataName == "luminosity" && m_luminosity > 0)
             return true;
-
-        tableName = "plantData";
     }
     else if (isEnvironmentalSensor())
     {
@@ -548,24 +531,28 @@ bool DeviceSensor::hasData(const QString &dataName) const
         else if (dataName == "humidity" && m_humidity > 0)
             return true;
 
-        tableName = "sensorData";
+        table = DeviceReading::TABLE_SENSORDATA;
     }
-
-    // Otherwise, check if we have stored data
-    if (m_dbInternal || m_dbExternal)
+    else
     {
-        QSqlQuery hasData;
-        hasData.prepare("SELECT COUNT(" + dataName + ") FROM " + tableName + " WHERE deviceAddr = :deviceAddr AND " + dataName + " > 0;");
-        hasData.bindValue(":deviceAddr", getAddress());
-
-        if (hasData.exec() == false)
-            qWarning() << "> hasData.exec() ERROR" << hasData.lastError().type() << ":" << hasData.lastError().text();
+        return false;
+    }
 
-        while (hasData.next())
-        {
-            if (hasData.value(0).toInt() > 0) // data count
-                return true;
-        }
+    // Otherwise, check if we have stored data (daily rollups, they're kept forever)
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
+    {
+        SeriesQuery q;
+        q.deviceAddrs << getAddress();
+        q.table = table;
+        q.metrics << DatabaseWriter::columnMetric(table, dataName);
+        q.tsFrom = 0;
+        q.tsTo = QDateTime::currentSecsSinceEpoch() + 1;
+        q.bucket = SeriesQuery::BUCKET_ALL;
+        q.aggregators = SeriesQuery::AGG_MAX;
+
+        const QVector <float> max = DatabaseSeries::getInstance()->query(q).values(getAddress(), q.metrics.first(), SeriesQuery::AGG_MAX);
+        if (!max.isEmpty() && max.first() > 0.f) // NaN if there is no data
+            return true;
     }
 
     return false;
@@ -574,35 +561,35 @@ bool DeviceSensor::hasData(const QString &dataName) const
 int DeviceSensor::countData(const QString &dataName, int days) const
 {
     // Count stored data
-    if (m_dbInternal || m_dbExternal)
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
     {
-        QString tableName = "plantData";
-        if (isEnvironmentalSensor()) tableName = "sensorData";
-
-        QSqlQuery dataCount;
-        if (m_dbInternal) // sqlite
+        DeviceReading::ReadingTable table = isEnvironmentalSensor() ? DeviceReading::TABLE_SENSORDATA : DeviceReading::TABLE_PLANTDATA;
+
+        SeriesQuery q;
+        q.deviceAddrs << getAddress();
+        q.table = table;
+        q.metrics << DatabaseWriter::columnMetric(table, dataName);
+        q.tsTo = QDateTime::currentSecsSinceEpoch() + 1;
+        q.bucket = SeriesQuery::BUCKET_ALL;
+        q.aggregators = SeriesQuery::AGG_COUNT;
+
+        // Counted from the rollups, so only whole buckets: start on the next one, the
+        // query would otherwise extend the range back to the start of the first one
+        QDateTime from = QDateTime::currentDateTime().addDays(-days);
+        if (q.tsTo - from.toSecsSinceEpoch() > SERIES_HOURLY_RANGE)
         {
-            dataCount.prepare("SELECT COUNT(" + dataName + ")" \
-                              "FROM " + tableName + " " \
-                              "WHERE deviceAddr = :deviceAddr " \
-                                "AND " + dataName + " > -20 AND ts >= datetime('now','-" + QString::number(days) + " day');");
+            if (from.time() != QTime(0, 0)) from = QDateTime(from.date().addDays(1), QTime(0, 0));
+            q.tsFrom = from.toSecsSinceEpoch();
         }
-        else if (m_dbExternal) // mysql
+        else
         {
-            dataCount.prepare("SELECT COUNT(" + dataName + ")" \
-                              "FROM " + tableName + " " \
-                              "WHERE deviceAddr = :deviceAddr " \
-                                "AND " + dataName + " > -20 AND ts >= DATE_SUB(NOW(), INTERVAL " + QString::number(days) + " DAY);");
+            q.tsFrom = from.toSecsSinceEpoch();
+            if (q.tsFrom % 3600) q.tsFrom += 3600 - q.tsFrom % 3600;
         }
-        dataCount.bindValue(":deviceAddr", getAddress());
-
-        if (dataCount.exec() == false)
-            qWarning() << "> dataCount.exec() ERROR" << dataCount.lastError().type() << ":" << dataCount.lastError().text();
 
-        while (dataCount.next())
-        {
-            return dataCount.value(0).toInt();
-        }
+        const QVector <float> count = DatabaseSeries::getInstance()->query(q).values(getAddress(), q.metrics.first(), SeriesQuery::AGG_COUNT);
+        if (!count.isEmpty() && !SeriesResult::isEmpty(count.first()))
+            return static_cast<int>(count.first());
     }
     else
     {
@@ -704,11 +691,12 @@ bool DeviceSensor::setDbLimits()
 {
     bool status = false;
 
+    // Don't overwrite the saved limits with the defaults
+    hydrateLimits();
+
     if (m_dbInternal || m_dbExternal)
     {
-        QSqlQuery updateLimits;
-        updateLimits.prepare("REPLACE INTO plantLimits (deviceAddr, hygroMin, hygroMax, conduMin, conduMax, phMin, phMax, tempMin, tempMax, humiMin, humiMax, luxMin, luxMax, mmolMin, mmolMax)"
-                             " VALUES (:deviceAddr, :hygroMin, :hygroMax, :conduMin, :conduMax, :phMin, :phMax, :tempMin, :tempMax, :humiMin, :humiMax, :luxMin, :luxMax, :mmolMin, :mmolMax)");
+        QSqlQuery &updateLimits = DatabaseManager::getInstance()->getStatement(DatabaseQueries::PLANTLIMITS_REPLACE);
         updateLimits.bindValue(":deviceAddr", getAddress());
         updateLimits.bindValue(":hygroMin", m_limitHygroMin);
         updateLimits.bindValue(":hygroMax", m_limitHygroMax);
@@ -728,6 +716,7 @@ bool DeviceSensor::setDbLimits()
         status = updateLimits.exec();
         if (status == false)
             qWarning() << "> updateLimits.exec() ERROR" << updateLimits.lastError().type() << ":" << updateLimits.lastError().text();
+        updateLimits.finish();
 
         Q_EMIT limitsUpdated();
     }
@@ -790,73 +779,25 @@ QVariantList DeviceSensor::getLegendDays(int maxDays)
 QVariantList DeviceSensor::getDataDays(const QString &dataName, int maxDays)
 {
     QVariantList graphData;
-    QDate currentDay = QDate::currentDate(); // today
-    QDate previousDay;
-    QDate firstDay;
 
-    if (m_dbInternal || m_dbExternal)
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
     {
-        QSqlQuery sqlData;
-        if (m_dbInternal) // sqlite
-        {
-            sqlData.prepare("SELECT strftime('%Y-%m-%d', ts), avg(" + dataName + ") as 'avg'" \
-                            "FROM plantData " \
-                            "WHERE deviceAddr = :deviceAddr " \
-                            "GROUP BY strftime('%Y-%m-%d', ts) " \
-                            "ORDER BY ts DESC;");
-        }
-        else if (m_dbExternal) // mysql
-        {
-            sqlData.prepare("SELECT DATE_FORMAT(ts, '%Y-%m-%d'), avg(" + dataName + ") as 'avg'" \
-                                "FROM plantData " \
-                                "WHERE deviceAddr = :deviceAddr " \
-                                "GROUP BY DATE_FORMAT(ts, '%Y-%m-%d') " \
-                                "ORDER BY ts DESC;");
-        }
-        sqlData.bindValue(":deviceAddr", getAddress());
-
-        if (sqlData.exec() == false)
-        {
-            qWarning() << "> dataPerMonth.exec() ERROR" << sqlData.lastError().type() << ":" << sqlData.lastError().text();
-        }
-
-        while (sqlData.next())
-        {
-            QDate datefromsql = sqlData.value(0).toDate();
-
-            // missing day(s)?
-            if (previousDay.isValid())
-            {
-                int diff = datefromsql.daysTo(previousDay);
-                for (int i = diff; i > 1; i--)
-                {
-                    //qDebug() << "> filling hole for day" << datefromsql.daysTo(previousDay);
-                    graphData.push_front(0);
-                }
-            }
-
-            // data
-            graphData.push_front(sqlData.value(1));
-            previousDay = datefromsql;
-            if (!firstDay.isValid()) firstDay = datefromsql;
-            //qDebug() << "> we have data (" << sqlData.value(1) << ") for date" << datefromsql;
-
-            // max days reached?
-            if (graphData.size() >= maxDays) break;
-        }
-
-        // missing day(s) front?
-        while (graphData.size() < maxDays)
-        {
-            graphData.push_front(0);
-        }
-        // missing day(s) back?
-        int missing = maxDays;
-        if (firstDay.isValid()) missing = firstDay.daysTo(currentDay);
-        for (int i = missing; i > 0; i--)
+        DeviceReading::ReadingTable table = isEnvironmentalSensor() ? DeviceReading::TABLE_SENSORDATA : DeviceReading::TABLE_PLANTDATA;
+        QDate today = QDate::currentDate();
+
+        SeriesQuery q;
+        q.deviceAddrs << getAddress();
+        q.table = table;
+        q.metrics << DatabaseWriter::columnMetric(table, dataName);
+        q.tsFrom = QDateTime(today.addDays(-(maxDays - 1)), QTime(0, 0)).toSecsSinceEpoch();
+        q.tsTo = QDateTime(today.addDays(1), QTime(0, 0)).toSecsSinceEpoch();
+        q.bucket = SeriesQuery::BUCKET_DAY;
+
+        // One value per day, up to today, 0 for the missing days
+        const QVector <float> days = DatabaseSeries::getInstance()->query(q).values(getAddress(), q.metrics.first());
+        for (float v: days)
         {
-            if (graphData.size() >= maxDays) graphData.pop_front();
-            graphData.push_back(0);
+            graphData.append(SeriesResult::isEmpty(v) ? 0.f : v);
         }
     }
 /*
@@ -873,73 +814,28 @@ QVariantList DeviceSensor::getDataDays(const QString &dataName, int maxDays)
 QVariantList DeviceSensor::getDataHours(const QString &dataName)
 {
     QVariantList graphData;
-    QDateTime currentTime = QDateTime::currentDateTime(); // right now
-    QDateTime previousTime;
-    QDateTime firstTime;
 
-    if (m_dbInternal || m_dbExternal)
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
     {
-        QSqlQuery sqlData;
-        if (m_dbInternal) // sqlite
+        DeviceReading::ReadingTable table = isEnvironmentalSensor() ? DeviceReading::TABLE_SENSORDATA : DeviceReading::TABLE_PLANTDATA;
+
+        // The last 24 hours, the current one included
+        qint64 tsTo = QDateTime::currentSecsSinceEpoch();
+        tsTo += 3600 - tsTo % 3600;
+
+        SeriesQuery q;
+        q.deviceAddrs << getAddress();
+        q.table = table;
+        q.metrics << DatabaseWriter::columnMetric(table, dataName);
+        q.tsFrom = tsTo - 24*3600;
+        q.tsTo = tsTo;
+        q.bucket = SeriesQuery::BUCKET_HOUR;
+
+        // One value per hour, 0 for the missing hours
+        const QVector <float> hours = DatabaseSeries::getInstance()->query(q).values(getAddress(), q.metrics.first());
+        for (float v: hours)
         {
-            sqlData.prepare("SELECT strftime('%Y-%m-%d %H:%m:%s', ts), avg(" + dataName + ") as 'avg'" \
-                            "FROM plantData " \
-                            "WHERE deviceAddr = :deviceAddr AND ts >= datetime('now','-1 day') " \
-                            "GROUP BY strftime('%d-%H', ts) " \
-                            "ORDER BY ts DESC;");
-        }
-        else if (m_dbExternal) // mysql
-        {
-            sqlData.prepare("SELECT DATE_FORMAT(ts, '%Y-%m-%d %H:%m:%s'), avg(" + dataName + ") as 'avg'" \
-                            "FROM plantData " \
-                            "WHERE deviceAddr = :deviceAddr AND ts >= datetime('now','-1 day') " \
-                            "GROUP BY DATE_FORMAT(ts, '%d-%H') " \
-                            "ORDER BY ts DESC;");
-        }
-        sqlData.bindValue(":deviceAddr", getAddress());
-
-        if (sqlData.exec() == false)
-        {
-            qWarning() << "> dataPerHour.exec() ERROR" << sqlData.lastError().type() << ":" << sqlData.lastError().text();
-        }
-
-        while (sqlData.next())
-        {
-            QDateTime timefromsql = sqlData.value(0).toDateTime();
-
-            // missing hour(s)?
-            if (previousTime.isValid())
-            {
-                int diff = timefromsql.secsTo(previousTime) / 3600;
-                for (int i = diff; i > 1; i--)
-                {
-                    //qDebug() << "> filling hole for hour" << diff;
-                    graphData.push_front(0);
-                }
-            }
-
-            // data
-            graphData.push_front(sqlData.value(1));
-            previousTime = timefromsql;
-            if (!firstTime.isValid()) firstTime = timefromsql;
-            //qDebug() << "> we have data (" << sqlData.value(1) << ") for hour" << timefromsql;
-
-            // max hours reached?
-            if (graphData.size() >= 24) break;
-        }
-
-        // missing hour(s) front?
-        while (graphData.size() < 24)
-        {
-            graphData.push_front(0);
-        }
-        // missing hour(s) back?
-        int missing = 24;
-        if (firstTime.isValid()) missing = firstTime.secsTo(currentTime) / 3600;
-        for (int i = missing; i > 0; i--)
-        {
-            if (graphData.size() >= 24) graphData.pop_front();
-            graphData.push_back(0);
+            graphData.append(SeriesResult::isEmpty(v) ? 0.f : v);
         }
     }
 /*
@@ -1017,79 +913,42 @@ void DeviceSensor::updateChartData_environmentalVoc(int maxDays)
 {
     qDeleteAll(m_chartData_env);
     m_chartData_env.clear();
-    ChartDataVoc *previousdata = nullptr;
 
-    if (m_dbInternal || m_dbExternal)
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
     {
-        QSqlQuery graphData;
-        if (m_dbInternal) // sqlite
-        {
-            graphData.prepare("SELECT strftime('%Y-%m-%d', timestamp), " \
-                              " min(voc), avg(voc), max(voc), " \
-                              " min(hcho), avg(hcho), max(hcho), " \
-                              " min(co2), avg(co2), max(co2) " \
-                              "FROM sensorData " \
-                              "WHERE deviceAddr = :deviceAddr " \
-                              "GROUP BY strftime('%Y-%m-%d', timestamp) " \
-                              "ORDER BY timestamp DESC;");
-        }
-        else if (m_dbExternal) // mysql
+        QDate today = QDate::currentDate();
+
+        SeriesQuery q;
+        q.deviceAddrs << getAddress();
+        q.table = DeviceReading::TABLE_SENSORDATA;
+        q.metrics << DeviceUtils::SENSOR_VOC << DeviceUtils::SENSOR_HCHO << DeviceUtils::SENSOR_CO2;
+        q.tsFrom = QDateTime(today.addDays(-(maxDays - 1)), QTime(0, 0)).toSecsSinceEpoch();
+        q.tsTo = QDateTime(today.addDays(1), QTime(0, 0)).toSecsSinceEpoch();
+        q.bucket = SeriesQuery::BUCKET_DAY;
+        q.aggregators = SeriesQuery::AGG_MIN | SeriesQuery::AGG_AVG | SeriesQuery::AGG_MAX;
+
+        const SeriesResult r = DatabaseSeries::getInstance()->query(q);
+
+        // min, avg, max for each metric, -99 for the missing values
+        QList <QVector <float>> values;
+        for (quint32 metric: qAsConst(q.metrics))
         {
-            graphData.prepare("SELECT DATE_FORMAT(timestamp, '%Y-%m-%d'), " \
-                              " min(voc), avg(voc), max(voc), " \
-                              " min(hcho), avg(hcho), max(hcho), " \
-                              " min(co2), avg(co2), max(co2) " \
-                              "FROM sensorData " \
-                              "WHERE deviceAddr = :deviceAddr " \
-                              "GROUP BY DATE_FORMAT(timestamp, '%Y-%m-%d') " \
-                              "ORDER BY timestamp DESC;");
+            values << r.values(getAddress(), metric, SeriesQuery::AGG_MIN)
+                   << r.values(getAddress(), metric, SeriesQuery::AGG_AVG)
+                   << r.values(getAddress(), metric, SeriesQuery::AGG_MAX);
         }
-        graphData.bindValue(":deviceAddr", getAddress());
+        auto v = [&values](int series, int day) {
+            float f = values.at(series).value(day, std::numeric_limits<float>::quiet_NaN());
+            return SeriesResult::isEmpty(f) ? -99.f : f;
+        };
 
-        if (graphData.exec() == false)
+        for (int i = 0; i < r.buckets.size(); i++)
         {
-            qWarning() << "> graphData.exec() ERROR" << graphData.lastError().type() << ":" << graphData.lastError().text();
-            return;
-        }
-        while (graphData.next())
-        {
-            // missing day(s)?
-            if (previousdata)
-            {
-                QDate datefromsql = graphData.value(0).toDate();
-                int diff = datefromsql.daysTo(previousdata->getDate());
-                for (int i = diff; i > 1; i--)
-                {
-                    QDate fakedate(datefromsql.addDays(i-1));
-                    m_chartData_env.push_front(new ChartDataVoc(fakedate, -99, -99, -99, -99, -99, -99, -99, -99, -99, this));
-                }
-            }
-
-            // data
-
-            ChartDataVoc *d = new ChartDataVoc(graphData.value(0).toDate(),
-                                   graphData.value(1).toFloat(), graphData.value(2).toFloat(), graphData.value(3).toFloat(),
-                                   graphData.value(4).toFloat(), graphData.value(5).toFloat(), graphData.value(6).toFloat(),
-                                   graphData.value(7).toFloat(), graphData.value(8).toFloat(), graphData.value(9).toFloat(),
-                                   this);
-            m_chartData_env.push_front(d);
-            previousdata = d;
-
-            // max days reached?
-            if (m_chartData_env.size() >= maxDays) break;
-        }
-
-        // missing day(s)?
-        {
-            QDate today = QDate::currentDate();
-            int missing = maxDays;
-            if (previousdata) missing = static_cast<ChartDataVoc *>(m_chartData_env.last())->getDate().daysTo(today);
-
-            for (int i = missing - 1; i >= 0; i--)
-            {
-                QDate fakedate(today.addDays(-i));
-                m_chartData_env.push_front(new ChartDataVoc(fakedate, -99, -99, -99, -99, -99, -99, -99, -99, -99, this));
-            }
+            m_chartData_env.append(new ChartDataVoc(QDateTime::fromSecsSinceEpoch(r.buckets.at(i)).date(),
+                                                    v(0, i), v(1, i), v(2, i),
+                                                    v(3, i), v(4, i), v(5, i),
+                                                    v(6, i), v(7, i), v(8, i),
+                                                    this));
         }
 
         Q_EMIT chartDataEnvUpdated();
@@ -1105,80 +964,49 @@ void DeviceSensor::updateChartData_thermometerMinMax(int maxDays)
     m_chartData_minmax.clear();
     m_tempMin = 999.f;
     m_tempMax = -99.f;
-    ChartDataMinMax *previousdata = nullptr;
 
-    if (m_dbInternal || m_dbExternal)
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
     {
-        QSqlQuery graphData;
-        if (m_dbInternal) // sqlite
+        QDate today = QDate::currentDate();
+
+        SeriesQuery q;
+        q.deviceAddrs << getAddress();
+        q.table = isEnvironmentalSensor() ? DeviceReading::TABLE_SENSORDATA : DeviceReading::TABLE_PLANTDATA;
+        q.metrics << DeviceUtils::SENSOR_TEMPERATURE << DeviceUtils::SENSOR_HUMIDITY;
+        q.tsFrom = QDateTime(today.addDays(-(maxDays - 1)), QTime(0, 0)).toSecsSinceEpoch();
+        q.tsTo = QDateTime(today.addDays(1), QTime(0, 0)).toSecsSinceEpoch();
+        q.bucket = SeriesQuery::BUCKET_DAY;
+        q.aggregators = SeriesQuery::AGG_MIN | SeriesQuery::AGG_AVG | SeriesQuery::AGG_MAX;
+
+        const SeriesResult r = DatabaseSeries::getInstance()->query(q);
+        const QVector <float> tempMin = r.values(getAddress(), DeviceUtils::SENSOR_TEMPERATURE, SeriesQuery::AGG_MIN);
+        const QVector <float> tempAvg = r.values(getAddress(), DeviceUtils::SENSOR_TEMPERATURE, SeriesQuery::AGG_AVG);
+        const QVector <float> tempMax = r.values(getAddress(), DeviceUtils::SENSOR_TEMPERATURE, SeriesQuery::AGG_MAX);
+        const QVector <float> hygroMin = r.values(getAddress(), DeviceUtils::SENSOR_HUMIDITY, SeriesQuery::AGG_MIN);
+        const QVector <float> hygroMax = r.values(getAddress(), DeviceUtils::SENSOR_HUMIDITY, SeriesQuery::AGG_MAX);
+
+        for (int i = 0; i < r.buckets.size(); i++)
         {
-            graphData.prepare("SELECT strftime('%Y-%m-%d', ts), " \
-                              " min(temperature), avg(temperature), max(temperature), " \
-                              " min(humidity), max(humidity) " \
-                              "FROM plantData " \
-                              "WHERE deviceAddr = :deviceAddr " \
-                              "GROUP BY strftime('%Y-%m-%d', ts) " \
-                              "ORDER BY ts DESC;");
-        }
-        else if (m_dbExternal) // mysql
-        {
-            graphData.prepare("SELECT DATE_FORMAT(ts, '%Y-%m-%d'), " \
-                              " min(temperature), avg(temperature), max(temperature), " \
-                              " min(humidity), max(humidity) " \
-                              "FROM plantData " \
-                              "WHERE deviceAddr = :deviceAddr " \
-                              "GROUP BY DATE_FORMAT(ts, '%Y-%m-%d') " \
-                              "ORDER BY ts DESC;");
-        }
-        graphData.bindValue(":deviceAddr", getAddress());
-
-        if (graphData.exec() == false)
-        {
-            qWarning() << "> graphData.exec() ERROR" << graphData.lastError().type() << ":" << graphData.lastError().text();
-            return;
-        }
+            QDate day = QDateTime::fromSecsSinceEpoch(r.buckets.at(i)).date();
 
-        while (graphData.next())
-        {
-            // missing day(s)?
-            if (previousdata)
+            // missing day
+            if (SeriesResult::isEmpty(tempAvg.value(i, std::numeric_limits<float>::quiet_NaN())))
             {
-                QDate datefromsql = graphData.value(0).toDate();
-                int diff = datefromsql.daysTo(previousdata->getDate());
-                for (int i = diff; i > 1; i--)
-                {
-                    QDate fakedate(datefromsql.addDays(i-1));
-                    m_chartData_minmax.push_front(new ChartDataMinMax(fakedate, -99, -99, -99, -99, -99, this));
-                }
+                m_chartData_minmax.append(new ChartDataMinMax(day, -99, -99, -99, -99, -99, this));
+                continue;
             }
 
             // data
-            if (graphData.value(1).toFloat() < m_tempMin) { m_tempMin = graphData.value(1).toFloat(); }
-            if (graphData.value(3).toFloat() > m_tempMax) { m_tempMax = graphData.value(3).toFloat(); }
-            if (graphData.value(4).toInt() < m_hygroMin) { m_hygroMin = graphData.value(4).toInt(); }
-            if (graphData.value(5).toInt() > m_hygroMax) { m_hygroMax = graphData.value(5).toInt(); }
-
-            ChartDataMinMax *d = new ChartDataMinMax(graphData.value(0).toDate(),
-                                         graphData.value(1).toFloat(), graphData.value(2).toFloat(), graphData.value(3).toFloat(),
-                                         graphData.value(4).toInt(), graphData.value(5).toInt(), this);
-            m_chartData_minmax.push_front(d);
-            previousdata = d;
-
-            // max days reached?
-            if (m_chartData_minmax.size() >= maxDays) break;
-        }
+            int hMin = SeriesResult::isEmpty(hygroMin.at(i)) ? -99 : static_cast<int>(hygroMin.at(i));
+            int hMax = SeriesResult::isEmpty(hygroMax.at(i)) ? -99 : static_cast<int>(hygroMax.at(i));
 
-        // missing day(s)?
-        {
-            QDate today = QDate::currentDate();
-            int missing = maxDays;
-            if (previousdata) missing = static_cast<ChartDataMinMax *>(m_chartData_minmax.last())->getDate().daysTo(today);
+            if (tempMin.at(i) < m_tempMin) { m_tempMin = tempMin.at(i); }
+            if (tempMax.at(i) > m_tempMax) { m_tempMax = tempMax.at(i); }
+            if (hMin != -99 && hMin < m_hygroMin) { m_hygroMin = hMin; }
+            if (hMax > m_hygroMax) { m_hygroMax = hMax; }
 
-            for (int i = missing - 1; i >= 0; i--)
-            {
-                QDate fakedate(today.addDays(-i));
-                m_chartData_minmax.push_back(new ChartDataMinMax(fakedate, -99, -99, -99, -99, -99, this));
-            }
+            m_chartData_minmax.append(new ChartDataMinMax(day, tempMin.at(i), tempAvg.at(i), tempMax.at(i),
+                                                          hMin, hMax, this));
         }
 
         Q_EMIT minmaxUpdated();
@@ -1217,55 +1045,60 @@ void DeviceSensor::getChartData_plantAIO(int maxDays,
 {
     if (!axis || !hygro || !condu || !temp || !lumi) return;
 
-    if (m_dbInternal || m_dbExternal)
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
     {
-        QString data = "soilMoisture";
-        if (!hasSoilMoistureSensor()) data = "humidity";
-
-        QString time = "datetime('now', 'localtime', '-" + QString::number(maxDays) + " days')";
-        if (m_dbExternal)  time = "DATE_SUB(NOW(), INTERVAL " + QString::number(maxDays) + " DAY)";
-
-        QSqlQuery graphData;
-        graphData.prepare("SELECT ts_full, " + data + ", soilConductivity, temperature, luminosity " \
-                          "FROM plantData " \
-                          "WHERE deviceAddr = :deviceAddr AND ts_full >= " + time + ";");
-        graphData.bindValue(":deviceAddr", getAddress());
-
-        if (graphData.exec() == false)
-        {
-            qWarning() << "> graphData.exec() ERROR" << graphData.lastError().type() << ":" << graphData.lastError().text();
-            return;
-        }
+        quint32 data = DeviceUtils::SENSOR_SOIL_MOISTURE;
+        if (!hasSoilMoistureSensor()) data = DeviceUtils::SENSOR_HUMIDITY;
 
         axis->setFormat("dd MMM");
         axis->setMax(QDateTime::currentDateTime());
-        bool minSet = false;
         bool minmaxChanged = false;
 
-        while (graphData.next())
+        SeriesQuery q;
+        q.deviceAddrs << getAddress();
+        q.table = DeviceReading::TABLE_PLANTDATA;
+        q.metrics << data << DeviceUtils::SENSOR_SOIL_CONDUCTIVITY << DeviceUtils::SENSOR_TEMPERATURE << DeviceUtils::SENSOR_LUMINOSITY;
+        q.tsFrom = QDateTime::currentDateTime().addDays(-maxDays).toSecsSinceEpoch();
+        q.tsTo = QDateTime::currentSecsSinceEpoch() + 1;
+        q.bucket = SeriesQuery::BUCKET_RAW;
+
+        const SeriesResult r = DatabaseSeries::getInstance()->query(q);
+        const QVector <float> hygroData = r.values(getAddress(), data);
+        const QVector <float> conduData = r.values(getAddress(), DeviceUtils::SENSOR_SOIL_CONDUCTIVITY);
+        const QVector <float> tempData = r.values(getAddress(), DeviceUtils::SENSOR_TEMPERATURE);
+        const QVector <float> lumiData = r.values(getAddress(), DeviceUtils::SENSOR_LUMINOSITY);
+
+        if (!r.buckets.isEmpty()) axis->setMin(QDateTime::fromSecsSinceEpoch(r.buckets.first()));
+
+        for (int i = 0; i < r.buckets.size(); i++)
         {
-            QDateTime date = QDateTime::fromString(graphData.value(0).toString(), "yyyy-MM-dd hh:mm:ss");
-            if (!minSet)
+            qint64 timecode = r.buckets.at(i) * 1000;
+
+            // A reading may not have all of the metrics
+            if (!SeriesResult::isEmpty(hygroData.at(i)))
+            {
+                hygro->append(timecode, hygroData.at(i));
+                if (hygroData.at(i) < m_hygroMin) { m_hygroMin = static_cast<int>(hygroData.at(i)); minmaxChanged = true; }
+                if (hygroData.at(i) > m_hygroMax) { m_hygroMax = static_cast<int>(hygroData.at(i)); minmaxChanged = true; }
+            }
+            if (!SeriesResult::isEmpty(conduData.at(i)))
+            {
+                condu->append(timecode, conduData.at(i));
+                if (conduData.at(i) < m_conduMin) { m_conduMin = static_cast<int>(conduData.at(i)); minmaxChanged = true; }
+                if (conduData.at(i) > m_conduMax) { m_conduMax = static_cast<int>(conduData.at(i)); minmaxChanged = true; }
+            }
+            if (!SeriesResult::isEmpty(tempData.at(i)))
+            {
+                temp->append(timecode, tempData.at(i));
+                if (tempData.at(i) < m_tempMin) { m_tempMin = tempData.at(i); minmaxChanged = true; }
+                if (tempData.at(i) > m_tempMax) { m_tempMax = tempData.at(i); minmaxChanged = true; }
+            }
+            if (!SeriesResult::isEmpty(lumiData.at(i)))
             {
-                axis->setMin(date);
-                minSet = true;
+                lumi->append(timecode, lumiData.at(i));
+                if (lumiData.at(i) < m_luxMin) { m_luxMin = static_cast<int>(lumiData.at(i)); minmaxChanged = true; }
+                if (lumiData.at(i) > m_luxMax) { m_luxMax = static_cast<int>(lumiData.at(i)); minmaxChanged = true; }
             }
-            qint64 timecode = date.toMSecsSinceEpoch();
-
-            hygro->append(timecode, graphData.value(1).toReal());
-            condu->append(timecode, graphData.value(2).toReal());
-            temp->append(timecode, graphData.value(3).toReal());
-            lumi->append(timecode, graphData.value(4).toReal());
-
-            if (graphData.value(1).toInt() < m_hygroMin) { m_hygroMin = graphData.value(1).toInt(); minmaxChanged = true; }
-            if (graphData.value(2).toInt() < m_conduMin) { m_conduMin = graphData.value(2).toInt(); minmaxChanged = true; }
-            if (graphData.value(3).toFloat() < m_tempMin) { m_tempMin = graphData.value(3).toFloat(); minmaxChanged = true; }
-            if (graphData.value(4).toInt() < m_luxMin) { m_luxMin = graphData.value(4).toInt(); minmaxChanged = true; }
-
-            if (graphData.value(1).toInt() > m_hygroMax) { m_hygroMax = graphData.value(1).toInt(); minmaxChanged = true; }
-            if (graphData.value(2).toInt() > m_conduMax) { m_conduMax = graphData.value(2).toInt(); minmaxChanged = true; }
-            if (graphData.value(3).toFloat() > m_tempMax) { m_tempMax = graphData.value(3).toFloat(); minmaxChanged = true; }
-            if (graphData.value(4).toInt() > m_luxMax) { m_luxMax = graphData.value(4).toInt(); minmaxChanged = true; }
         }
 
         if (minmaxChanged) { Q_EMIT minmaxUpdated(); }
@@ -27,6 +27,8 @@
 
 #include "device.h"
 
+struct DevicePreload;
+
 /* ************************************************************************** */
 
 /*!
@@ -113,6 +115,9 @@ Q_SIGNALS:
     void chartDataMinMaxUpdated();
     void chartDataEnvUpdated();
 
+protected slots:
+    void databaseWritten(const QStringList &deviceAddrs);
+
 protected:
     // plant data
     int m_soil_moisture = -99;
@@ -148,6 +153,7 @@ protected:
     float m_rs = -99.f;
 
     // limits
+    mutable bool m_limitsLoaded = false;
     int m_limitHygroMin = 15;
     int m_limitHygroMax = 50;
     int m_limitConduMin = 100;
@@ -199,11 +205,14 @@ protected:
     virtual void refreshDataFinished(bool status, bool cached = false);
     virtual void refreshHistoryFinished(bool status);
 
-    virtual bool getSqlDeviceInfos();
+    virtual void loadDeviceInfos(const QVariantList &infos);
     virtual bool getSqlPlantLimits();
-    virtual bool getSqlPlantData(int minutes);
+    void loadPlantLimits(const QVariantList &limits);
+    void hydrateLimits() const;
     virtual bool getSqlSensorLimits();
-    virtual bool getSqlSensorData(int minutes);
+    virtual bool getSqlLatestValues(int minutes);
+    void setLatestValue(quint32 metric, float value);
+    void loadPreload(const DevicePreload &preload);
 
 public:
     DeviceSensor(QString &deviceAddr, QString &deviceName, QObject *parent = nullptr);
@@ -213,6 +222,8 @@ public:
 public slots:
     virtual bool hasData() const;
     bool hasData(const QString &dataName) const;
+    //! Readings of the last 'days' days, counted from the rollups: whole UTC hours (whole local
+    //! days past SERIES_HOURLY_RANGE), and including readings the retention already dropped
     int countData(const QString &dataName, int days = 31) const;
 
     // Plant sensor data
@@ -258,30 +269,30 @@ public slots:
 
     // BLE device limits
     bool setDbLimits();
-    int getLimitHygroMin() const { return m_limitHygroMin; }
-    int getLimitHygroMax() const { return m_limitHygroMax; }
-    int getLimitConduMin() const { return m_limitConduMin; }
-    int getLimitConduMax() const { return m_limitConduMax; }
-    int getLimitTempMin() const { return m_limitTempMin; }
-    int getLimitTempMax() const { return m_limitTempMax; }
-    int getLimitHumiMin() const { return m_limitHumiMin; }
-    int getLimitHumiMax() const { return m_limitHumiMax; }
-    int getLimitLuxMin() const { return m_limitLuxMin; }
-    int getLimitLuxMax() const { return m_limitLuxMax; }
-    int getLimitMmolMin() const { return m_limitMmolMin; }
-    int getLimitMmolMax() const { return m_limitMmolMax; }
-    void setLimitHygroMin(int limitHygroMin) { if (m_limitHygroMin == limitHygroMin) return; m_limitHygroMin = limitHygroMin; setDbLimits(); }
-    void setLimitHygroMax(int limitHygroMax) { if (m_limitHygroMax == limitHygroMax) return; m_limitHygroMax = limitHygroMax; setDbLimits(); }
-    void setLimitConduMin(int limitConduMin) { if (m_limitConduMin == limitConduMin) return; m_limitConduMin = limitConduMin; setDbLimits(); }
-    void setLimitConduMax(int limitConduMax) { if (m_limitConduMax == limitConduMax) return; m_limitConduMax = limitConduMax; setDbLimits(); }
-    void setLimitTempMin(int limitTempMin) { if (m_limitTempMin == limitTempMin) return; m_limitTempMin = limitTempMin; setDbLimits(); }
-    void setLimitTempMax(int limitTempMax) { if (m_limitTempMax == limitTempMax) return; m_limitTempMax = limitTempMax; setDbLimits(); }
-    void setLimitHumiMin(int limitHumiMin) { if (m_limitHumiMin == limitHumiMin) return; m_limitHumiMin = limitHumiMin; setDbLimits(); }
-    void setLimitHumiMax(int limitHumiMax) { if (m_limitHumiMax == limitHumiMax) return; m_limitHumiMax = limitHumiMax; setDbLimits(); }
-    void setLimitLuxMin(int limitLuxMin) { if (m_limitLuxMin == limitLuxMin) return; m_limitLuxMin = limitLuxMin; setDbLimits(); }
-    void setLimitLuxMax(int limitLuxMax) { if (m_limitLuxMax == limitLuxMax) return; m_limitLuxMax = limitLuxMax; setDbLimits(); }
-    void setLimitMmolMin(int limitMmolMin) { if (m_limitMmolMin == limitMmolMin) return; m_limitMmolMin = limitMmolMin; setDbLimits(); }
-    void setLimitMmolMax(int limitMmolMax) { if (m_limitMmolMax == limitMmolMax) return; m_limitMmolMax = limitMmolMax; setDbLimits(); }
+    int getLimitHygroMin() const { hydrateLimits(); return m_limitHygroMin; }
+    int getLimitHygroMax() const { hydrateLimits(); return m_limitHygroMax; }
+    int getLimitConduMin() const { hydrateLimits(); return m_limitConduMin; }
+    int getLimitConduMax() const { hydrateLimits(); return m_limitConduMax; }
+    int getLimitTempMin() const { hydrateLimits(); return m_limitTempMin; }
+    int getLimitTempMax() const { hydrateLimits(); return m_limitTempMax; }
+    int getLimitHumiMin() const { hydrateLimits(); return m_limitHumiMin; }
+    int getLimitHumiMax() const { hydrateLimits(); return m_limitHumiMax; }
+    int getLimitLuxMin() const { hydrateLimits(); return m_limitLuxMin; }
+    int getLimitLuxMax() const { hydrateLimits(); return m_limitLuxMax; }
+    int getLimitMmolMin() const { hydrateLimits(); return m_limitMmolMin; }
+    int getLimitMmolMax() const { hydrateLimits(); return m_limitMmolMax; }
+    void setLimitHygroMin(int limitHygroMin) { hydrateLimits(); if (m_limitHygroMin == limitHygroMin) return; m_limitHygroMin = limitHygroMin; setDbLimits(); }
+    void setLimitHygroMax(int limitHygroMax) { hydrateLimits(); if (m_limitHygroMax == limitHygroMax) return; m_limitHygroMax = limitHygroMax; setDbLimits(); }
+    void setLimitConduMin(int limitConduMin) { hydrateLimits(); if (m_limitConduMin == limitConduMin) return; m_limitConduMin = limitConduMin; setDbLimits(); }
+    void setLimitConduMax(int limitConduMax) { hydrateLimits(); if (m_limitConduMax == limitConduMax) return; m_limitConduMax = limitConduMax; setDbLimits(); }
+    void setLimitTempMin(int limitTempMin) { hydrateLimits(); if (m_limitTempMin == limitTempMin) return; m_limitTempMin = limitTempMin; setDbLimits(); }
+    void setLimitTempMax(int limitTempMax) { hydrateLimits(); if (m_limitTempMax == limitTempMax) return; m_limitTempMax = limitTempMax; setDbLimits(); }
+    void setLimitHumiMin(int limitHumiMin) { hydrateLimits(); if (m_limitHumiMin == limitHumiMin) return; m_limitHumiMin = limitHumiMin; setDbLimits(); }
+    void setLimitHumiMax(int limitHumiMax) { hydrateLimits(); if (m_limitHumiMax == limitHumiMax) return; m_limitHumiMax = limitHumiMax; setDbLimits(); }
+    void setLimitLuxMin(int limitLuxMin) { hydrateLimits(); if (m_limitLuxMin == limitLuxMin) return; m_limitLuxMin = limitLuxMin; setDbLimits(); }
+    void setLimitLuxMax(int limitLuxMax) { hydrateLimits(); if (m_limitLuxMax == limitLuxMax) return; m_limitLuxMax = limitLuxMax; setDbLimits(); }
+    void setLimitMmolMin(int limitMmolMin) { hydrateLimits(); if (m_limitMmolMin == limitMmolMin) return; m_limitMmolMin = limitMmolMin; setDbLimits(); }
+    void setLimitMmolMax(int limitMmolMax) { hydrateLimits(); if (m_limitMmolMax == limitMmolMax) return; m_limitMmolMax = limitMmolMax; setDbLimits(); }
 
     // Data min/max
     int getHygroMin() const { return m_hygroMin; }
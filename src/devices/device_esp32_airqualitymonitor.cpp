@@ -20,6 +20,7 @@
  */
 
 #include "device_esp32_airqualitymonitor.h"
+#include "DatabaseManager.h"
 #include "utils/utils_versionchecker.h"
 
 #include <cstdint>
@@ -29,9 +30,6 @@
 #include <QBluetoothServiceInfo>
 #include <QLowEnergyService>
 
-#include <QSqlQuery>
-#include <QSqlError>
-
 #include <QDebug>
 
 /* ************************************************************************** */
@@ -228,23 +226,16 @@ void DeviceEsp32AirQualityMonitor::bleReadNotify(const QLowEnergyCharacteristic
 
             m_lastUpdate = QDateTime::currentDateTime();
 
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
-                // SQL date format YYYY-MM-DD HH:MM:SS
-                QString tsStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:00:00");
-
-                QSqlQuery addData;
-                addData.prepare("REPLACE INTO sensorData (deviceAddr, timestamp, temperature, humidity, pressure, voc, co2)"
-                                " VALUES (:deviceAddr, :ts, :temp, :humi, :pres, :voc, :co2)");
-                addData.bindValue(":deviceAddr", getAddress());
-                addData.bindValue(":ts", tsStr);
-                addData.bindValue(":temp", m_temperature);
-                addData.bindValue(":humi", m_humidity);
-                addData.bindValue(":pres", m_pressure);
-                addData.bindValue(":voc", m_voc);
-                addData.bindValue(":co2", m_co2);
-                if (addData.exec() == false)
-                    qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
+                // We only save one value every hour
+                DeviceReading r(DeviceReading::TABLE_SENSORDATA, getAddress(), m_lastUpdate, getReadingInterval());
+                r.set(DeviceUtils::SENSOR_TEMPERATURE, m_temperature);
+                r.set(DeviceUtils::SENSOR_HUMIDITY, m_humidity);
+                r.set(DeviceUtils::SENSOR_PRESSURE, m_pressure);
+                r.set(DeviceUtils::SENSOR_VOC, m_voc);
+                r.set(DeviceUtils::SENSOR_CO2, m_co2);
+                DatabaseManager::getInstance()->addReading(r);
 
                 m_lastUpdateDatabase = m_lastUpdate;
             }
@@ -20,6 +20,9 @@
  */
 
 #include "device_esp32_geigercounter.h"
+#include "DatabaseManager.h"
+#include "DatabaseQueries.h"
+#include "DatabasePartitions.h"
 #include "utils/utils_versionchecker.h"
 
 #include <cstdint>
@@ -235,19 +238,12 @@ void DeviceEsp32GeigerCounter::bleReadNotify(const QLowEnergyCharacteristic &c,
 
             m_lastUpdate = QDateTime::currentDateTime();
 
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
-                // SQL date format YYYY-MM-DD HH:MM:SS
-                QString tsStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-
-                QSqlQuery addData;
-                addData.prepare("REPLACE INTO sensorData (deviceAddr, timestamp, geiger)"
-                                " VALUES (:deviceAddr, :ts, :geiger)");
-                addData.bindValue(":deviceAddr", getAddress());
-                addData.bindValue(":ts", tsStr);
-                addData.bindValue(":geiger", m_rm);
-                if (addData.exec() == false)
-                    qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
+                // We save every value
+                DeviceReading r(DeviceReading::TABLE_SENSORDATA, getAddress(), m_lastUpdate, getReadingInterval());
+                r.set(DeviceUtils::SENSOR_GEIGER, m_rm);
+                DatabaseManager::getInstance()->addReading(r);
 
                 m_lastUpdateDatabase = m_lastUpdate;
             }
@@ -284,17 +280,21 @@ bool DeviceEsp32GeigerCounter::hasData() const
     // Otherwise, check if we have stored data
     if (m_dbInternal || m_dbExternal)
     {
-        QSqlQuery hasData;
-        hasData.prepare("SELECT COUNT(*) FROM sensorData WHERE deviceAddr = :deviceAddr;");
-        hasData.bindValue(":deviceAddr", getAddress());
+        const QStringList tables = DatabasePartitions::getInstance()->tables(DatabasePartitions::getInstance()->baseTable(DeviceReading::TABLE_SENSORDATA));
+        for (auto t = tables.crbegin(); t != tables.crend(); ++t)
+        {
+            QSqlQuery hasData;
+            hasData.prepare(DatabaseQueries::get(DatabaseQueries::DATA_COUNT).arg(*t));
+            hasData.bindValue(":deviceId", getDeviceId());
 
-        if (hasData.exec() == false)
-            qWarning() << "> hasData.exec() ERROR" << hasData.lastError().type() << ":" << hasData.lastError().text();
+            if (hasData.exec() == false)
+                qWarning() << "> hasData.exec() ERROR" << hasData.lastError().type() << ":" << hasData.lastError().text();
 
-        while (hasData.next())
-        {
-            if (hasData.value(0).toInt() > 0) // data count
-                return true;
+            while (hasData.next())
+            {
+                if (hasData.value(0).toInt() > 0) // data count
+                    return true;
+            }
         }
     }
 
@@ -49,6 +49,8 @@ public:
     DeviceEsp32GeigerCounter(const QBluetoothDeviceInfo &d, QObject *parent = nullptr);
     ~DeviceEsp32GeigerCounter();
 
+    int getReadingInterval() const { return 1; } // Every reading is kept
+
 public slots:
     virtual bool hasData() const;
 
@@ -20,6 +20,7 @@
  */
 
 #include "device_esp32_higrow.h"
+#include "DatabaseManager.h"
 #include "utils/utils_versionchecker.h"
 
 #include <cstdint>
@@ -235,33 +236,19 @@ void DeviceEsp32HiGrow::bleReadNotify(const QLowEnergyCharacteristic &c, const Q
 
             m_lastUpdate = QDateTime::currentDateTime();
 
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
-                // SQL date format YYYY-MM-DD HH:MM:SS
-                QString tsStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:00:00");
-                QString tsFullStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-
-                QSqlQuery addData;
-                addData.prepare("REPLACE INTO plantData (deviceAddr, ts, ts_full, soilMoisture, soilConductivity, temperature, humidity, luminosity)"
-                                " VALUES (:deviceAddr, :ts, :ts_full, :hygro, :condu, :temp, :humi, :lumi)");
-                addData.bindValue(":deviceAddr", getAddress());
-                addData.bindValue(":ts", tsStr);
-                addData.bindValue(":ts_full", tsFullStr);
-                addData.bindValue(":hygro", m_soil_moisture);
-                addData.bindValue(":condu", m_soil_conductivity);
-                addData.bindValue(":temp", m_temperature);
-                addData.bindValue(":humi", m_humidity);
-                addData.bindValue(":lumi", m_luminosity);
-                if (addData.exec() == false)
-                    qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
-
-                QSqlQuery updateDevice;
-                updateDevice.prepare("UPDATE devices SET deviceFirmware = :firmware, deviceBattery = :battery WHERE deviceAddr = :deviceAddr");
-                updateDevice.bindValue(":firmware", m_deviceFirmware);
-                updateDevice.bindValue(":battery", m_deviceBattery);
-                updateDevice.bindValue(":deviceAddr", getAddress());
-                if (updateDevice.exec() == false)
-                    qWarning() << "> updateDevice.exec() ERROR" << updateDevice.lastError().type() << ":" << updateDevice.lastError().text();
+                // We only save one value every hour
+                DeviceReading r(DeviceReading::TABLE_PLANTDATA, getAddress(), m_lastUpdate, getReadingInterval());
+                r.set(DeviceUtils::SENSOR_SOIL_MOISTURE, m_soil_moisture);
+                r.set(DeviceUtils::SENSOR_SOIL_CONDUCTIVITY, m_soil_conductivity);
+                r.set(DeviceUtils::SENSOR_TEMPERATURE, m_temperature);
+                r.set(DeviceUtils::SENSOR_HUMIDITY, m_humidity);
+                r.set(DeviceUtils::SENSOR_LUMINOSITY, m_luminosity);
+                DatabaseManager::getInstance()->addReading(r);
+
+                setMetadata("deviceBattery", m_deviceBattery);
+                setMetadata("deviceFirmware", m_deviceFirmware);
 
                 m_lastUpdateDatabase = m_lastUpdate;
             }
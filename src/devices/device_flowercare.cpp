@@ -20,6 +20,7 @@
  */
 
 #include "device_flowercare.h"
+#include "DatabaseManager.h"
 #include "utils/utils_versionchecker.h"
 #include "thirdparty/RC4/rc4.h"
 
@@ -30,9 +31,6 @@
 #include <QBluetoothServiceInfo>
 #include <QLowEnergyService>
 
-#include <QSqlQuery>
-#include <QSqlError>
-
 #include <QDateTime>
 #include <QDebug>
 
@@ -495,23 +493,15 @@ void DeviceFlowerCare::bleReadDone(const QLowEnergyCharacteristic &c, const QByt
             int soil_moisture = data[11];
             int soil_conductivity = data[12] + (data[13] << 8) + (data[14] << 16) + (data[15] << 24);
 
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
-                // SQL date format YYYY-MM-DD HH:MM:SS
                 // We only save one value every hour
-
-                QSqlQuery addData;
-                addData.prepare("REPLACE INTO plantData (deviceAddr, ts, ts_full, soilMoisture, soilConductivity, temperature, luminosity)"
-                                " VALUES (:deviceAddr, :ts, :ts_full, :hygro, :condu, :temp, :lumi)");
-                addData.bindValue(":deviceAddr", getAddress());
-                addData.bindValue(":ts", m_lastHistorySync.toString("yyyy-MM-dd hh:00:00"));
-                addData.bindValue(":ts_full", m_lastHistorySync.toString("yyyy-MM-dd hh:mm:ss"));
-                addData.bindValue(":hygro", soil_moisture);
-                addData.bindValue(":condu", soil_conductivity);
-                addData.bindValue(":temp", temperature);
-                addData.bindValue(":lumi", luminosity);
-                if (addData.exec() == false)
-                    qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
+                DeviceReading r(DeviceReading::TABLE_PLANTDATA, getAddress(), m_lastHistorySync, getReadingInterval());
+                r.set(DeviceUtils::SENSOR_SOIL_MOISTURE, soil_moisture);
+                r.set(DeviceUtils::SENSOR_SOIL_CONDUCTIVITY, soil_conductivity);
+                r.set(DeviceUtils::SENSOR_TEMPERATURE, temperature);
+                r.set(DeviceUtils::SENSOR_LUMINOSITY, luminosity);
+                DatabaseManager::getInstance()->addReading(r);
             }
 
 #ifndef QT_NO_DEBUG
@@ -576,26 +566,17 @@ void DeviceFlowerCare::bleReadDone(const QLowEnergyCharacteristic &c, const QByt
 
             m_lastUpdate = QDateTime::currentDateTime();
 
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
                 if (needsUpdateDb())
                 {
-                    // SQL date format YYYY-MM-DD HH:MM:SS
-                    QString tsStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:00:00");
-                    QString tsFullStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-
-                    QSqlQuery addData;
-                    addData.prepare("REPLACE INTO plantData (deviceAddr, ts, ts_full, soilMoisture, soilConductivity, temperature, luminosity)"
-                                    " VALUES (:deviceAddr, :ts, :ts_full, :hygro, :condu, :temp, :lumi)");
-                    addData.bindValue(":deviceAddr", getAddress());
-                    addData.bindValue(":ts", tsStr);
-                    addData.bindValue(":ts_full", tsFullStr);
-                    addData.bindValue(":hygro", m_soil_moisture);
-                    addData.bindValue(":condu", m_soil_conductivity);
-                    addData.bindValue(":temp", m_temperature);
-                    addData.bindValue(":lumi", m_luminosity);
-                    if (addData.exec() == false)
-                        qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
+                    // We only save one value every hour
+                    DeviceReading r(DeviceReading::TABLE_PLANTDATA, getAddress(), m_lastUpdate, getReadingInterval());
+                    r.set(DeviceUtils::SENSOR_SOIL_MOISTURE, m_soil_moisture);
+                    r.set(DeviceUtils::SENSOR_SOIL_CONDUCTIVITY, m_soil_conductivity);
+                    r.set(DeviceUtils::SENSOR_TEMPERATURE, m_temperature);
+                    r.set(DeviceUtils::SENSOR_LUMINOSITY, m_luminosity);
+                    DatabaseManager::getInstance()->addReading(r);
 
                     m_lastUpdateDatabase = m_lastUpdate;
                 }
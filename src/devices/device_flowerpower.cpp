@@ -20,6 +20,7 @@
  */
 
 #include "device_flowerpower.h"
+#include "DatabaseManager.h"
 #include "utils/utils_versionchecker.h"
 
 #include <cstdint>
@@ -249,15 +250,7 @@ void DeviceFlowerPower::serviceDetailsDiscovered_infos(QLowEnergyService::Servic
                 }
             }
 
-            if (m_dbInternal || m_dbExternal)
-            {
-                QSqlQuery updateDevice;
-                updateDevice.prepare("UPDATE devices SET deviceFirmware = :firmware WHERE deviceAddr = :deviceAddr");
-                updateDevice.bindValue(":firmware", m_deviceFirmware);
-                updateDevice.bindValue(":deviceAddr", getAddress());
-                if (updateDevice.exec() == false)
-                    qWarning() << "> updateDevice.exec() ERROR" << updateDevice.lastError().type() << ":" << updateDevice.lastError().text();
-            }
+            setMetadata("deviceFirmware", m_deviceFirmware);
 
             Q_EMIT sensorUpdated();
         }
@@ -398,25 +391,16 @@ void DeviceFlowerPower::serviceDetailsDiscovered_live(QLowEnergyService::Service
             if (m_soil_temperature > -10.f && m_temperature > -10.f &&
                 m_soil_temperature < 100.f && m_temperature < 100.f)
             {
-                if (m_dbInternal || m_dbExternal)
+                if (m_dbInternal || m_dbExternal || m_dbMemory)
                 {
-                    // SQL date format YYYY-MM-DD HH:MM:SS
-                    QString tsStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:00:00");
-                    QString tsFullStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-
-                    QSqlQuery addData;
-                    addData.prepare("REPLACE INTO plantData (deviceAddr, ts, ts_full, soilMoisture, soilConductivity, soilTemperature, temperature, luminosity)"
-                                    " VALUES (:deviceAddr, :ts, :ts_full, :hygro, :condu, :stemp, :atemp, :lumi)");
-                    addData.bindValue(":deviceAddr", getAddress());
-                    addData.bindValue(":ts", tsStr);
-                    addData.bindValue(":ts_full", tsFullStr);
-                    addData.bindValue(":hygro", m_soil_moisture);
-                    addData.bindValue(":condu", m_soil_conductivity);
-                    addData.bindValue(":stemp", m_soil_temperature);
-                    addData.bindValue(":atemp", m_temperature);
-                    addData.bindValue(":lumi", m_luminosity);
-                    if (addData.exec() == false)
-                        qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
+                    // We only save one value every hour
+                    DeviceReading r(DeviceReading::TABLE_PLANTDATA, getAddress(), m_lastUpdate, getReadingInterval());
+                    r.set(DeviceUtils::SENSOR_SOIL_MOISTURE, m_soil_moisture);
+                    r.set(DeviceUtils::SENSOR_SOIL_CONDUCTIVITY, m_soil_conductivity);
+                    r.set(DeviceUtils::SENSOR_SOIL_TEMPERATURE, m_soil_temperature);
+                    r.set(DeviceUtils::SENSOR_TEMPERATURE, m_temperature);
+                    r.set(DeviceUtils::SENSOR_LUMINOSITY, m_luminosity);
+                    DatabaseManager::getInstance()->addReading(r);
                 }
             }
             else
@@ -20,6 +20,7 @@
  */
 
 #include "device_hygrotemp_cgg1.h"
+#include "DatabaseManager.h"
 #include "utils/utils_versionchecker.h"
 
 #include <cstdint>
@@ -29,9 +30,6 @@
 #include <QBluetoothServiceInfo>
 #include <QLowEnergyService>
 
-#include <QSqlQuery>
-#include <QSqlError>
-
 #include <QDebug>
 
 /* ************************************************************************** */
@@ -253,22 +251,13 @@ void DeviceHygrotempCGG1::bleReadNotify(const QLowEnergyCharacteristic &c, const
 
             m_lastUpdate = QDateTime::currentDateTime();
 
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
-                // SQL date format YYYY-MM-DD HH:MM:SS
-                QString tsStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:00:00");
-                QString tsFullStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-
-                QSqlQuery addData;
-                addData.prepare("REPLACE INTO plantData (deviceAddr, ts, ts_full, temperature, humidity)"
-                                " VALUES (:deviceAddr, :ts, :ts_full, :temp, :humi)");
-                addData.bindValue(":deviceAddr", getAddress());
-                addData.bindValue(":ts", tsStr);
-                addData.bindValue(":ts_full", tsFullStr);
-                addData.bindValue(":temp", m_temperature);
-                addData.bindValue(":humi", m_humidity);
-                if (addData.exec() == false)
-                    qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
+                // We only save one value every hour
+                DeviceReading r(DeviceReading::TABLE_PLANTDATA, getAddress(), m_lastUpdate, getReadingInterval());
+                r.set(DeviceUtils::SENSOR_TEMPERATURE, m_temperature);
+                r.set(DeviceUtils::SENSOR_HUMIDITY, m_humidity);
+                DatabaseManager::getInstance()->addReading(r);
             }
 
             if (m_ble_action == DeviceUtils::ACTION_UPDATE_REALTIME)
@@ -20,6 +20,7 @@
  */
 
 #include "device_ropot.h"
+#include "DatabaseManager.h"
 #include "utils/utils_versionchecker.h"
 #include "thirdparty/RC4/rc4.h"
 
@@ -30,9 +31,6 @@
 #include <QBluetoothServiceInfo>
 #include <QLowEnergyService>
 
-#include <QSqlQuery>
-#include <QSqlError>
-
 #include <QDateTime>
 #include <QDebug>
 
@@ -482,25 +480,16 @@ void DeviceRopot::bleReadDone(const QLowEnergyCharacteristic &c, const QByteArra
 
             m_lastUpdate = QDateTime::currentDateTime();
 
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
                 if (needsUpdateDb())
                 {
-                    // SQL date format YYYY-MM-DD HH:MM:SS
-                    QString tsStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:00:00");
-                    QString tsFullStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-
-                    QSqlQuery addData;
-                    addData.prepare("REPLACE INTO plantData (deviceAddr, ts, ts_full, soilMoisture, soilConductivity, temperature)"
-                                    " VALUES (:deviceAddr, :ts, :ts_full, :hygro, :condu, :temp)");
-                    addData.bindValue(":deviceAddr", getAddress());
-                    addData.bindValue(":ts", tsStr);
-                    addData.bindValue(":ts_full", tsFullStr);
-                    addData.bindValue(":hygro", m_soil_moisture);
-                    addData.bindValue(":condu", m_soil_conductivity);
-                    addData.bindValue(":temp", m_temperature);
-                    if (addData.exec() == false)
-                        qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
+                    // We only save one value every hour
+                    DeviceReading r(DeviceReading::TABLE_PLANTDATA, getAddress(), m_lastUpdate, getReadingInterval());
+                    r.set(DeviceUtils::SENSOR_SOIL_MOISTURE, m_soil_moisture);
+                    r.set(DeviceUtils::SENSOR_SOIL_CONDUCTIVITY, m_soil_conductivity);
+                    r.set(DeviceUtils::SENSOR_TEMPERATURE, m_temperature);
+                    DatabaseManager::getInstance()->addReading(r);
 
                     m_lastUpdateDatabase = m_lastUpdate;
                 }
@@ -20,6 +20,7 @@
  */
 
 #include "device_thermobeacon.h"
+#include "DatabaseManager.h"
 #include "SettingsManager.h"
 #include "utils/utils_versionchecker.h"
 
@@ -30,9 +31,6 @@
 #include <QBluetoothServiceInfo>
 #include <QLowEnergyService>
 
-#include <QSqlQuery>
-#include <QSqlError>
-
 #include <QDateTime>
 #include <QTimeZone>
 
@@ -469,32 +467,18 @@ bool DeviceThermoBeacon::addDatabaseRecord(const int64_t timestamp, const float
 
     if (t <= 0.f && h <= 0.f) return status;
 
-    if (m_dbInternal || m_dbExternal)
+    if (m_dbInternal || m_dbExternal || m_dbMemory)
     {
-        // SQL date format YYYY-MM-DD HH:MM:SS
         // We only save one value every 30m
-
         QDateTime tmcd = QDateTime::fromSecsSinceEpoch(timestamp);
-        QDateTime tmcd_rounded = QDateTime::fromSecsSinceEpoch(timestamp + (1800 - timestamp % 1800) - 1800);
-
-        QSqlQuery addData;
-        addData.prepare("REPLACE INTO plantData (deviceAddr, ts, ts_full, temperature, humidity)"
-                        " VALUES (:deviceAddr, :ts, :ts_full, :temp, :hygro)");
-        addData.bindValue(":deviceAddr", getAddress());
-        addData.bindValue(":ts", tmcd_rounded.toString("yyyy-MM-dd hh:mm:00"));
-        addData.bindValue(":ts_full", tmcd.toString("yyyy-MM-dd hh:mm:ss"));
-        addData.bindValue(":temp", t);
-        addData.bindValue(":hygro", h);
-        status = addData.exec();
-
-        if (status)
-        {
-            m_lastUpdateDatabase = tmcd;
-        }
-        else
-        {
-            qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
-        }
+
+        DeviceReading r(DeviceReading::TABLE_PLANTDATA, getAddress(), tmcd, getReadingInterval());
+        r.set(DeviceUtils::SENSOR_TEMPERATURE, t);
+        r.set(DeviceUtils::SENSOR_HUMIDITY, h);
+        DatabaseManager::getInstance()->addReading(r);
+
+        m_lastUpdateDatabase = tmcd;
+        status = true;
     }
 
     return status;
@@ -50,6 +50,8 @@ public:
     DeviceThermoBeacon(const QBluetoothDeviceInfo &d, QObject *parent = nullptr);
     ~DeviceThermoBeacon();
 
+    int getReadingInterval() const { return 1800; } // Half hour history records
+
     void parseAdvertisementData(const QByteArray &value);
 
 private:
@@ -20,6 +20,7 @@
  */
 
 #include "device_wp6003.h"
+#include "DatabaseManager.h"
 #include "utils/utils_versionchecker.h"
 
 #include <cstdint>
@@ -29,9 +30,6 @@
 #include <QBluetoothServiceInfo>
 #include <QLowEnergyService>
 
-#include <QSqlQuery>
-#include <QSqlError>
-
 #include <QDateTime>
 #include <QDebug>
 
@@ -208,22 +206,15 @@ void DeviceWP6003::bleReadNotify(const QLowEnergyCharacteristic &c, const QByteA
 
             m_lastUpdate = QDateTime::currentDateTime();
 
-            if (m_dbInternal || m_dbExternal)
+            if (m_dbInternal || m_dbExternal || m_dbMemory)
             {
-                // SQL date format YYYY-MM-DD HH:MM:SS
-                QString tsStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-
-                QSqlQuery addData;
-                addData.prepare("REPLACE INTO sensorData (deviceAddr, timestamp, temperature, co2, voc, hcho)"
-                                " VALUES (:deviceAddr, :ts, :temp, :co2, :voc, :hcho)");
-                addData.bindValue(":deviceAddr", getAddress());
-                addData.bindValue(":ts", tsStr);
-                addData.bindValue(":temp", m_temperature);
-                addData.bindValue(":co2", m_co2);
-                addData.bindValue(":voc", m_voc);
-                addData.bindValue(":hcho", m_hcho);
-                if (addData.exec() == false)
-                    qWarning() << "> addData.exec() ERROR" << addData.lastError().type() << ":" << addData.lastError().text();
+                // We save every value
+                DeviceReading r(DeviceReading::TABLE_SENSORDATA, getAddress(), m_lastUpdate, getReadingInterval());
+                r.set(DeviceUtils::SENSOR_TEMPERATURE, m_temperature);
+                r.set(DeviceUtils::SENSOR_CO2, m_co2);
+                r.set(DeviceUtils::SENSOR_VOC, m_voc);
+                r.set(DeviceUtils::SENSOR_HCHO, m_hcho);
+                DatabaseManager::getInstance()->addReading(r);
 
                 m_lastUpdateDatabase = m_lastUpdate;
             }
@@ -48,6 +48,8 @@ public:
     DeviceWP6003(const QBluetoothDeviceInfo &d, QObject *parent = nullptr);
     ~DeviceWP6003();
 
+    int getReadingInterval() const { return 1; } // Every reading is kept
+
 private:
     // QLowEnergyController related
     void serviceScanDone();
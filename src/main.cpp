@@ -20,6 +20,7 @@
  */
 
 #include "DatabaseManager.h"
+#include "DatabaseBenchmark.h"
 #include "SettingsManager.h"
 #include "SystrayManager.h"
 #include "NotificationManager.h"
@@ -56,6 +57,12 @@ int main(int argc, char *argv[])
     bool start_minimized = false;
     bool refresh_only = false;
     bool background_service = false;
+    bool benchmark = false;
+    bool check_db = false;
+    bool export_incremental = false;
+    QString benchmark_directory;
+    QString export_directory;
+    QString import_file;
     for (int i = 1; i < argc; i++)
     {
         if (argv[i])
@@ -68,9 +75,98 @@ int main(int argc, char *argv[])
                 background_service = true;
             if (QString::fromLocal8Bit(argv[i]) == "--refresh")
                 refresh_only = true;
+            if (QString::fromLocal8Bit(argv[i]) == "--check-db")
+                check_db = true;
+            if (QString::fromLocal8Bit(argv[i]) == "--benchmark")
+            {
+                benchmark = true;
+                if (i+1 < argc && !QString::fromLocal8Bit(argv[i+1]).startsWith("--"))
+                    benchmark_directory = QString::fromLocal8Bit(argv[++i]);
+            }
+            if (QString::fromLocal8Bit(argv[i]) == "--export-incremental")
+            {
+                export_incremental = true;
+                if (i+1 < argc && !QString::fromLocal8Bit(argv[i+1]).startsWith("--"))
+                    export_directory = QString::fromLocal8Bit(argv[++i]);
+            }
+            if (QString::fromLocal8Bit(argv[i]) == "--import" && i+1 < argc)
+                import_file = QString::fromLocal8Bit(argv[++i]);
         }
     }
 
+    // Database benchmark //////////////////////////////////////////////////////
+
+    // Measure the database workloads on the current storage, then exit
+    if (benchmark)
+    {
+        QCoreApplication app(argc, argv);
+        app.setApplicationName("WatchFlower");
+        app.setOrganizationName("WatchFlower");
+
+        DatabaseBenchmark bench(benchmark_directory);
+        bench.run();
+
+        return EXIT_SUCCESS;
+    }
+
+    // Check the query plans of the current database, fails on full table scans
+    if (check_db)
+    {
+        QCoreApplication app(argc, argv);
+        app.setApplicationName("WatchFlower");
+        app.setOrganizationName("WatchFlower");
+
+        // Doesn't go through DatabaseManager::getInstance(), that would migrate it and start the writer
+        if (!DatabaseManager::checkQueryPlans()) return EXIT_FAILURE;
+
+        qInfo() << "Database query plans: OK";
+        return EXIT_SUCCESS;
+    }
+
+    // Export what's new since the previous run (for cron jobs and such), then exit
+    if (export_incremental)
+    {
+        QCoreApplication app(argc, argv);
+        app.setApplicationName("WatchFlower");
+        app.setOrganizationName("WatchFlower");
+
+        SettingsManager *sm = SettingsManager::getInstance();
+        DatabaseManager *db = DatabaseManager::getInstance();
+        DeviceManager *dm = new DeviceManager;
+        if (!sm || !db || !dm) return EXIT_FAILURE;
+
+        QObject::connect(dm, &DeviceManager::exportFinished, &app, [&app] (bool status, const QString &path) {
+            if (status) qInfo() << "Incremental export:" << path;
+            app.exit(status ? EXIT_SUCCESS : EXIT_FAILURE);
+        });
+
+        if (!dm->exportDataIncremental(export_directory)) return EXIT_FAILURE;
+
+        return app.exec();
+    }
+
+    // Import historical readings (CSV or JSON Lines) into the database, then exit
+    if (!import_file.isEmpty())
+    {
+        QCoreApplication app(argc, argv);
+        app.setApplicationName("WatchFlower");
+        app.setOrganizationName("WatchFlower");
+
+        SettingsManager *sm = SettingsManager::getInstance();
+        DatabaseManager *db = DatabaseManager::getInstance();
+        DeviceManager *dm = new DeviceManager;
+        if (!sm || !db || !dm) return EXIT_FAILURE;
+
+        QObject::connect(dm, &DeviceManager::importFinished, &app, [&app] (bool status, qint64 imported, qint64 rejected) {
+            qInfo() << "Import:" << imported << "readings imported," << rejected << "lines rejected";
+            app.exit(status ? EXIT_SUCCESS : EXIT_FAILURE);
+        });
+
+        if (!dm->importData(import_file)) return EXIT_FAILURE;
+
+        return app.exec();
+    }
+
     // Background service application //////////////////////////////////////////
 
     // Refresh data in the background, without starting the UI, then exit